@@ -37,6 +37,15 @@ public:
     virtual const Real ActivityCoefficient(Real T, Real yA, Real yB, Real yEtc1, Real yEtc2){
         return 0;
     };
+
+    // Activity Coeffiecients (gamma) of n cells
+    virtual void ActivityCoefficient(const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            gamma[i] = ActivityCoefficient(T[i], yA[i], yB[i], yEtc1[i], yEtc2[i]);
+        }
+    };
 };
 
 #endif // ACTIVITY_MODEL_H
@@ -0,0 +1,260 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef ADAPTIVE_ACTIVITY_MODEL_H
+#define ADAPTIVE_ACTIVITY_MODEL_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include <atomic>
+#include <vector>
+#include "activity_model.h"
+#include "pitzer_activity_model.h"
+#include "debye_huckel_activity_model.h"
+
+// ActivityModel evaluating each cell with the cheapest of the Debye-Huckel
+// limiting law, Davies, Truesdell-Jones and Pitzer's eq. that stays within a
+// tolerance of Pitzer's eq. at the cell's ionic strength. Calibrate() finds
+// the ionic strength up to which each cheap form holds the tolerance; a batch
+// is then sorted into these regimes, so every regime runs its vector kernel
+// over contiguous cells instead of branching per lane.
+class AdaptiveActivityModel : public ActivityModel
+{
+public:
+    // Regimes by increasing cost and ionic strength
+    enum Regime
+    {
+        DEBYE_HUCKEL,
+        DAVIES,
+        TRUESDELL_JONES,
+        PITZER,
+        REGIMES
+    };
+
+    struct Statistics
+    {
+        std::atomic<long> cells[REGIMES];
+    };
+
+    // Ionic strength grid of Calibrate(), per decade from I_LOW to I_HIGH
+    static constexpr Real I_LOW = 1e-6;
+    static constexpr Real I_HIGH = 10;
+    static const int PER_DECADE = 20;
+    static const int TEMPERATURES = 9;
+
+    PitzerActivityModel &pitzer;
+    DebyeHuckelActivityModel debyeHuckel;
+    DaviesActivityModel davies;
+    TruesdellJonesActivityModel truesdellJones;
+
+    // Ionic strength up to which each cheap form holds the tolerance
+    Real validity[PITZER] = {};
+    // Upper ionic strength of the regimes below PITZER, non-decreasing; a
+    // form that is valid no further than a cheaper one gets no cells
+    Real bounds[PITZER] = {};
+
+    Statistics statistics;
+
+    AdaptiveActivityModel(PitzerActivityModel &pitzer) : pitzer(pitzer),
+                                                         debyeHuckel(pitzer.Z_A, pitzer.Z_B),
+                                                         davies(pitzer.Z_A, pitzer.Z_B),
+                                                         truesdellJones(pitzer.Z_A, pitzer.Z_B)
+    {
+    }
+
+    static const char *Name(int regime)
+    {
+        static const char *names[REGIMES] = {"Debye-Huckel", "Davies", "Truesdell-Jones", "Pitzer"};
+        return names[regime];
+    }
+
+    // Matches Truesdell-Jones to Pitzer's eq. at low ionic strength, then
+    // finds the validity of each cheap form: the largest I of the grid up to
+    // which |ln(gamma) - ln(gamma_Pitzer)| <= tolerance at every temperature
+    // of [T_min, T_max]. The virial terms of Pitzer's eq. are evaluated with
+    // the salt alone making up the ionic strength, their largest value for
+    // a salt in a mixture.
+    void Calibrate(Real T_min, Real T_max, Real tolerance)
+    {
+        // ln(gamma_Pitzer) = -|Z_A Z_B| A / 3 (3 sqrt(I) - 2 b I) + M B_factor
+        // 2 (beta_0 + beta_1 + beta_2) + O(I^1.5), with the mean molality
+        // M = k I of the salt alone
+        const Real k = MeanMolality(1);
+        truesdellJones.Ba = 2 * pitzer.b / 3;
+        truesdellJones.b = k * pitzer.BFactor() * 2 * (pitzer.beta_0 + pitzer.beta_1 + pitzer.beta_2);
+
+        const int points = (int)(PER_DECADE * log10(I_HIGH / I_LOW) + 0.5);
+        for (int regime = 0; regime < PITZER; regime++)
+        {
+            validity[regime] = 0;
+            for (int i = 0; i <= points; i++)
+            {
+                const Real I = I_LOW * pow(10, (Real)i / PER_DECADE);
+                Real error = 0;
+                for (int j = 0; j < TEMPERATURES; j++)
+                {
+                    const Real T = T_min + (T_max - T_min) * j / (TEMPERATURES - 1);
+                    const Real reference = log(pitzer.pitzerActivityCoefficient(T, I, MeanMolality(I)));
+                    error = fmax(error, fabs(log(ActivityCoefficient(regime, T, I)) - reference));
+                }
+                if (!(error <= tolerance))
+                    break;
+                validity[regime] = I;
+            }
+            bounds[regime] = regime == 0 ? validity[regime] : fmax(validity[regime], bounds[regime - 1]);
+        }
+    }
+
+    // Regime of a cell of ionic strength I
+    int RegimeOf(Real I) const
+    {
+        return (I > bounds[DEBYE_HUCKEL]) + (I > bounds[DAVIES]) + (I > bounds[TRUESDELL_JONES]);
+    }
+
+    // Activity Coeffiecient (gamma)
+    const Real ActivityCoefficient(Real T, Real yA, Real yB, Real yEtc1, Real yEtc2) override
+    {
+        const Real I = debyeHuckel.IonicStrength(yEtc1, yEtc2);
+        const int regime = RegimeOf(I);
+        statistics.cells[regime]++;
+        if (regime == PITZER)
+            return pitzer.ActivityCoefficient(T, yA, yB, yEtc1, yEtc2);
+        return ActivityCoefficient(regime, T, I);
+    }
+
+    // Activity Coeffiecients (gamma) of n cells, one kernel per regime
+    void ActivityCoefficient(const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n) override
+    {
+        thread_local std::vector<Real> I;
+        I.resize(n);
+        DebyeHuckelBatch::IonicStrength(debyeHuckel.BatchCoefficients(), yEtc1, yEtc2, I.data(), n);
+
+        // Cells above the bound of each regime, as sums that vectorize
+        int above[PITZER] = {};
+        for (int i = 0; i < n; i++)
+        {
+            above[DEBYE_HUCKEL] += I[i] > bounds[DEBYE_HUCKEL];
+            above[DAVIES] += I[i] > bounds[DAVIES];
+            above[TRUESDELL_JONES] += I[i] > bounds[TRUESDELL_JONES];
+        }
+        const int count[REGIMES] = {n - above[DEBYE_HUCKEL],
+                                    above[DEBYE_HUCKEL] - above[DAVIES],
+                                    above[DAVIES] - above[TRUESDELL_JONES],
+                                    above[TRUESDELL_JONES]};
+        for (int regime = 0; regime < REGIMES; regime++)
+        {
+            if (count[regime] > 0)
+                statistics.cells[regime] += count[regime];
+        }
+
+        // A batch within one regime runs in place
+        for (int regime = 0; regime < REGIMES; regime++)
+        {
+            if (count[regime] == n)
+            {
+                Evaluate(regime, T, yA, yB, yEtc1, yEtc2, I.data(), gamma, n);
+                return;
+            }
+        }
+
+        // Otherwise the cells are ordered by regime and gathered; yA, yB and
+        // the spectators are only needed by Pitzer's eq.
+        thread_local std::vector<int> order;
+        thread_local std::vector<Real> gathered;
+        order.resize(n);
+        gathered.resize(7 * (size_t)n);
+        int start[REGIMES + 1] = {};
+        for (int regime = 0; regime < REGIMES; regime++)
+            start[regime + 1] = start[regime] + count[regime];
+        int next[REGIMES];
+        for (int regime = 0; regime < REGIMES; regime++)
+            next[regime] = start[regime];
+        for (int i = 0; i < n; i++)
+            order[next[RegimeOf(I[i])]++] = i;
+
+        Real *g[7];
+        for (int k = 0; k < 7; k++)
+            g[k] = gathered.data() + (size_t)k * n;
+        for (int j = 0; j < n; j++)
+        {
+            g[0][j] = T[order[j]];
+            g[1][j] = I[order[j]];
+        }
+        for (int j = start[PITZER]; j < n; j++)
+        {
+            g[2][j] = yA[order[j]];
+            g[3][j] = yB[order[j]];
+            g[4][j] = yEtc1[order[j]];
+            g[5][j] = yEtc2[order[j]];
+        }
+        for (int regime = 0; regime < REGIMES; regime++)
+        {
+            const int s = start[regime];
+            if (count[regime] > 0)
+                Evaluate(regime, g[0] + s, g[2] + s, g[3] + s, g[4] + s, g[5] + s, g[1] + s, g[6] + s, count[regime]);
+        }
+        for (int j = 0; j < n; j++)
+            gamma[order[j]] = g[6][j];
+    }
+
+private:
+    // Mean molality of the salt alone at ionic strength I
+    const Real MeanMolality(Real I)
+    {
+        const Real m = I / (0.5 * (pitzer.nu_A * pitzer.Z_A * pitzer.Z_A + pitzer.nu_B * pitzer.Z_B * pitzer.Z_B));
+        return pitzer.MeanMolality(pitzer.nu_A * m, pitzer.nu_B * m);
+    }
+
+    // gamma of a cheap form at ionic strength I
+    const Real ActivityCoefficient(int regime, Real T, Real I)
+    {
+        if (regime == DEBYE_HUCKEL)
+            return debyeHuckel.ActivityCoefficient(T, I);
+        if (regime == DAVIES)
+            return davies.ActivityCoefficient(T, I);
+        return truesdellJones.ActivityCoefficient(T, I);
+    }
+
+    // gamma of n contiguous cells of one regime
+    void Evaluate(int regime, const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, const Real *I, Real *gamma, int n)
+    {
+        switch (regime)
+        {
+        case DEBYE_HUCKEL:
+            debyeHuckel.ActivityCoefficient(T, I, gamma, n);
+            break;
+        case DAVIES:
+            davies.ActivityCoefficient(T, I, gamma, n);
+            break;
+        case TRUESDELL_JONES:
+            truesdellJones.ActivityCoefficient(T, I, gamma, n);
+            break;
+        default:
+            pitzer.ActivityCoefficient(T, yA, yB, yEtc1, yEtc2, gamma, n);
+        }
+    }
+};
+
+#endif // ADAPTIVE_ACTIVITY_MODEL_H
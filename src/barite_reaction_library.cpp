@@ -25,58 +25,824 @@ SOFTWARE.
 #include <stdio.h>
 #include <math.h>
 #include <cstdlib>
+#include <deque>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "isa_variant.h"
+
+// Compiled once more per instruction set variant (isa_avx2.cpp, ...) into
+// its own namespace
+#ifdef SCALE_ISA_NAMESPACE
+namespace SCALE_ISA_NAMESPACE
+{
+#endif
+
 #include "uclib.h"
 #include "equilibrium_formulation.h"
 #include "hoff_equilibrium.h"
+#include "empirical_equilibrium.h"
 #include "chemistry.h"
 #include "simple_reaction.h"
 #include "activity_model.h"
 #include "pitzer_activity_model.h"
+#include "static_pitzer_activity_model.h"
+#include "adaptive_activity_model.h"
+#include "saturation_model.h"
+#include "runtime_config.h"
+#include "isat_table.h"
+#include "thread_pool.h"
+#include "mineral_database.h"
+#include "mineral_engine.h"
+#include "multicomponent_pitzer.h"
+#include "output_cache.h"
+#include "speciation_solver.h"
+#include "kinetics_batch.h"
+#include "profiler.h"
+#include "temporal_cache.h"
+#include "trace_writer.h"
+#include "deduplicator.h"
 
 using namespace std;
 
+// The objects with constructors are built by ConstructModels() from Uclib(),
+// see IsaVariant::Deferred
+using IsaVariant::Deferred;
+
+// Optional threads splitting the cells of a call
+Deferred<ThreadPool> threadPool;
+
+// Equilibrium Model
+const Real log_k = -9.87;
+const Real delta_h = 6.35 * 4186.80;
+Deferred<HoffEquilibrium> equilibriumModel;
+
+// Acticity Coefficient Model of barite, Ba2+ and SO4 2- (1:1, 2-2)
+typedef StaticPitzerActivityModel<1, 1, 2, -2> BariteActivityModel;
+static Real beta_0 = 0;
+static Real beta_1 = 0;
+static Real beta_2 = 0;
+static Real C_phi = 0;
+Deferred<BariteActivityModel> activityModel;
+
+// Opt-in choice of the cheapest activity model meeting a tolerance per cell
+bool useAdaptiveActivity = false;
+Deferred<AdaptiveActivityModel> adaptiveActivityModel;
+
+// Saturation of barite from both models
+Deferred<SaturationModel<HoffEquilibrium, BariteActivityModel> > saturationModel;
+
+// Opt-in ISAT tables of ln(gamma) over (T, yA, yB, yEtc1, yEtc2), one per
+// thread of the pool
+bool useActivityTable = false;
+std::vector<IsatTable<5> > activityTables;
+
+// Opt-in float lanes for the Pitzer and saturation kernels of a double build
+bool useMixedPrecision = false;
+
+const double LogActivityCoefficient(const double *x)
+{
+    return log(activityModel->ActivityCoefficient(x[0], x[1], x[2], x[3], x[4]));
+}
+
+// Opt-in trace of the inputs of EquilibriumConstant and PitzerActivity,
+// closed by ReportStatistics
+Deferred<TraceWriter> trace;
+int traceEquilibrium = -1;
+int tracePitzer = -1;
+
+// Opt-in evaluation of each distinct input state of a call once
+bool useDeduplication = false;
+Deduplicator<1> equilibriumDeduplicator;
+Deduplicator<5> activityDeduplicator;
+
 void EquilibriumConstant(Real *result, int size, Real *Temperature, Real *yA, Real *yB, Real *yEtc_1, Real *yEtc_2)
 {
-    // Equilibrium Model
-    const Real log_k = -9.87;
-    const Real delta_h = 6.35 * 4186.80;
-    const Real T0 = ChemistryFunctions::T0();
-    HoffEquilibrium equilibriumModel = HoffEquilibrium(log_k, delta_h, T0);
+    if (trace->IsOpen())
+        trace->Call(traceEquilibrium, size, &Temperature, 1);
+    if (useDeduplication)
+    {
+        threadPool->ParallelFor(size, [&](int begin, int end)
+                               {
+                                   const Real *T = Temperature + begin;
+                                   equilibriumDeduplicator.Evaluate(&T, result + begin, end - begin, [](const Real *const *x, Real *K, int n)
+                                                                    { equilibriumModel->Equilibrium(x[0], K, n); });
+                               });
+        return;
+    }
+    threadPool->ParallelFor(size, [&](int begin, int end)
+                           { equilibriumModel->Equilibrium(Temperature + begin, result + begin, end - begin); });
+}
+
+void EquilibriumConstantDerivative(Real *result, int size, Real *Temperature, Real *yA, Real *yB, Real *yEtc_1, Real *yEtc_2)
+{
+    threadPool->ParallelFor(size, [&](int begin, int end)
+                           { equilibriumModel->EquilibriumDerivative(Temperature + begin, result + begin, end - begin); });
+}
+
+// Built-in barite functions of n cells in the calling thread, inputs T, yA,
+// yB, yEtc1 and yEtc2
+void ActivityCoefficientCells(const Real *const *x, Real *gamma, int n)
+{
+    if (useActivityTable)
+    {
+        IsatTable<5> &table = activityTables[ThreadPool::Index()];
+        for (int i = 0; i < n; i++)
+        {
+            const double xi[5] = {x[0][i], x[1][i], x[2][i], x[3][i], x[4][i]};
+            gamma[i] = table.Query(xi, LogActivityCoefficient);
+        }
+        typedef Simd::Pack<Real>::V V;
+        Simd::Map([](V lnGamma)
+                  { return Simd::Exp(lnGamma); },
+                  gamma, n, gamma);
+        return;
+    }
+    if (useAdaptiveActivity)
+    {
+        adaptiveActivityModel->ActivityCoefficient(x[0], x[1], x[2], x[3], x[4], gamma, n);
+        return;
+    }
+#if DOUBLE_PRECISION
+    if (useMixedPrecision)
+    {
+        activityModel->ActivityCoefficientMixed(x[0], x[1], x[2], x[3], x[4], gamma, n);
+        return;
+    }
+#endif
+    activityModel->ActivityCoefficient(x[0], x[1], x[2], x[3], x[4], gamma, n);
+}
+
+void DeduplicatedActivityCoefficientCells(const Real *const *x, Real *gamma, int n)
+{
+    activityDeduplicator.Evaluate(x, gamma, n, ActivityCoefficientCells);
+}
+
+void SaturationIndexCells(const Real *const *x, Real *SI, int n)
+{
+#if DOUBLE_PRECISION
+    if (useMixedPrecision)
+    {
+        saturationModel->SaturationIndexMixed(x[0], x[1], x[2], x[3], x[4], SI, n);
+        return;
+    }
+#endif
+    saturationModel->SaturationIndex(x[0], x[1], x[2], x[3], x[4], SI, n);
+}
+
+void SaturationRatioCells(const Real *const *x, Real *S, int n)
+{
+#if DOUBLE_PRECISION
+    if (useMixedPrecision)
+    {
+        saturationModel->SaturationRatioMixed(x[0], x[1], x[2], x[3], x[4], S, n);
+        return;
+    }
+#endif
+    saturationModel->SaturationRatio(x[0], x[1], x[2], x[3], x[4], S, n);
+}
+
+// Opt-in reuse of the results of cells whose inputs have not changed since
+// the previous call, per built-in barite function
+bool useTemporalCache = false;
+TemporalCache<5> activityCache;
+TemporalCache<5> saturationIndexCache;
+TemporalCache<5> saturationRatioCache;
 
-    for (int i = 0; i < size; i++)
+// Calls cells on the cells of a built-in barite function, split over the
+// threads and through its temporal cache with SCALE_MEMO
+void EvaluateBarite(TemporalCache<5> &cache, void (*cells)(const Real *const *, Real *, int), Real *result, int size, const Real *const *input)
+{
+    if (useTemporalCache)
     {
-        result[i] = equilibriumModel.Equilibrium(Temperature[i]);
+        TemporalCache<5>::Layout &layout = cache.Find(input, size);
+        threadPool->ParallelFor(size, [&](int begin, int end)
+                               { cache.Evaluate(layout, input, result, begin, end, cells); });
+        return;
     }
+
+    threadPool->ParallelFor(size, [&](int begin, int end)
+                           {
+                               const Real *x[5] = {input[0] + begin, input[1] + begin, input[2] + begin, input[3] + begin, input[4] + begin};
+                               cells(x, result + begin, end - begin);
+                           });
 }
 
 void PitzerActivity(Real *result, int size, Real *Temperature, Real *yA, Real *yB, Real *yEtc_1, Real *yEtc_2)
 {
-    // Acticity Coefficient Model
-    static Real nu_A = 1;
-    static Real nu_B = 1;
-    static Real nu_P = -1;
-    static Real Z_A = 2;
-    static Real Z_B = -2;
-    static Real beta_0 = 0;
-    static Real beta_1 = 0;
-    static Real beta_2 = 0;
-    static Real C_phi = 0;
-    PitzerActivityModel activityModel = PitzerActivityModel(nu_A, nu_B, Z_A, Z_B, beta_0, beta_1, beta_2, C_phi);
-    for (int i = 0; i < size; i++)
+    const Real *input[] = {Temperature, yA, yB, yEtc_1, yEtc_2};
+    if (trace->IsOpen())
+        trace->Call(tracePitzer, size, input, 5);
+    EvaluateBarite(activityCache, useDeduplication ? DeduplicatedActivityCoefficientCells : ActivityCoefficientCells, result, size, input);
+}
+
+void SaturationIndex(Real *result, int size, Real *Temperature, Real *yA, Real *yB, Real *yEtc_1, Real *yEtc_2)
+{
+    const Real *input[] = {Temperature, yA, yB, yEtc_1, yEtc_2};
+    EvaluateBarite(saturationIndexCache, SaturationIndexCells, result, size, input);
+}
+
+void SupersaturationRatio(Real *result, int size, Real *Temperature, Real *yA, Real *yB, Real *yEtc_1, Real *yEtc_2)
+{
+    const Real *input[] = {Temperature, yA, yB, yEtc_1, yEtc_2};
+    EvaluateBarite(saturationRatioCache, SaturationRatioCells, result, size, input);
+}
+
+// Opt-in minerals of the SCALE_DATABASE file, one saturation index field
+// function each
+MineralDatabase database;
+
+template <int Slot>
+void MineralSaturationIndex(Real *result, int size, Real *Temperature, Real *yA, Real *yB, Real *yEtc_1, Real *yEtc_2)
+{
+    const SaturationBatch::Coefficients &c = database.saturation[Slot];
+    const SaturationBatch::Kernel kernel = database.saturationIndex[Slot];
+    threadPool->ParallelFor(size, [&](int begin, int end)
+                           { kernel(c, Temperature + begin, yA + begin, yB + begin, yEtc_1 + begin, yEtc_2 + begin, result + begin, end - begin); });
+}
+
+typedef void (*MineralFunction)(Real *, int, Real *, Real *, Real *, Real *, Real *);
+
+template <size_t... Slot>
+const std::vector<MineralFunction> MineralFunctions(std::index_sequence<Slot...>)
+{
+    return {MineralSaturationIndex<Slot>...};
+}
+
+// Groups of field functions computed together in one pass over the cells;
+// each function of a group takes the same inputs, T and the mass fractions,
+// and the first call of a pass leaves the other outputs for their calls
+typedef void (*GroupEvaluation)(const Real *const *inputs, Real *const *outputs, int begin, int end);
+
+struct FieldGroup
+{
+    OutputCache cache;
+    GroupEvaluation evaluate;
+    void (*prepare)(int size); // NULL or called with the size of a pass before it is split
+};
+
+enum
+{
+    MINERAL_ENGINE,
+    MULTICOMPONENT_PITZER,
+    PITZER_DERIVATIVES,
+    SPECIATION,
+    KINETICS,
+    FIELD_GROUPS
+};
+FieldGroup fieldGroups[FIELD_GROUPS];
+
+template <size_t K>
+using RealPointer = Real *;
+
+template <int Group, int Slot, size_t... K>
+void GroupFunction(Real *result, int size, Real *Temperature, RealPointer<K>... y)
+{
+    FieldGroup &group = fieldGroups[Group];
+    const Real *inputs[] = {Temperature, y...};
+    if (group.cache.Take(Slot, result, size, inputs))
+        return;
+
+    Real *const *outputs = group.cache.Pass(Slot, result, size, inputs);
+    if (group.prepare != NULL)
+        group.prepare(size);
+    threadPool->ParallelFor(size, [&](int begin, int end)
+                           { group.evaluate(inputs, outputs, begin, end); });
+}
+
+template <int Group, size_t... Slot, size_t... K>
+const std::vector<void *> GroupFunctions(std::index_sequence<Slot...>, std::index_sequence<K...>)
+{
+    return {(void *)GroupFunction<Group, Slot, K...>...};
+}
+
+// Functions of all Slots of a group taking T and the given number of mass
+// fractions
+template <int Group, int Slots, size_t... Fractions>
+const std::vector<void *> GroupFunctions(int fractions, std::index_sequence<Fractions...>)
+{
+    const std::vector<void *> functions[] = {GroupFunctions<Group>(std::make_index_sequence<Slots>(), std::make_index_sequence<Fractions>())...};
+    return functions[fractions];
+}
+
+// Opt-in engine evaluating all database minerals in one pass, each mineral
+// function taking every species of the brine
+bool useMineralEngine = false;
+MineralEngine mineralEngine;
+
+// Opt-in activity coefficients of all ions of the database from the
+// multicomponent Pitzer model, each taking every ion of the brine
+bool useMulticomponentPitzer = false;
+Deferred<MulticomponentPitzer> multicomponentPitzer;
+
+// Opt-in derivatives of the built-in equilibrium constant and activity
+// coefficient for the linearization of source terms
+bool useDerivatives = false;
+
+// Opt-in speciation of the barite ions, with the carbonate system at the pH
+// of the cell on request
+bool useSpeciation = false;
+static Real nu_Ba = 1;
+static Real nu_SO4 = 1;
+static Real nu_BaSO4 = 1;
+static Real Z_Ba = 2;
+static Real Z_SO4 = -2;
+Deferred<SimpleReaction> bariteReaction;
+Deferred<SpeciationSolver> speciation;
+
+// Opt-in precipitation kinetics of barite over the time step
+bool useKinetics = false;
+KineticsBatch::Coefficients kinetics;
+KineticsBatch::Statistics kineticsStatistics = {};
+
+// Names passed to ucfunc/ucarg, kept for the lifetime of the library
+std::deque<std::string> registeredNames;
+
+char *RegisteredName(const std::string &name)
+{
+    registeredNames.push_back(name);
+    return (char *)registeredNames.back().c_str();
+}
+
+// Registers a scalar field function of the cell fields named in arguments,
+// through a profiling wrapper in builds with SCALE_PROFILE
+void RegisterFunction(void *function, const std::string &name, const std::vector<std::string> &arguments)
+{
+#if SCALE_PROFILE
+    function = Profiler::Instance().Wrap(function, name, arguments);
+#endif
+    ucfunc(function, "ScalarFieldFunction", RegisteredName(name));
+    for (const std::string &argument : arguments)
     {
-        result[i] = activityModel.ActivityCoefficient(Temperature[i], yA[i], yB[i], yEtc_1[i], yEtc_2[i]);
+        ucarg(function, "Cell", RegisteredName(argument), sizeof(Real));
     }
 }
 
-void uclib()
+// Registers the functions of a group taking T, the mass fractions of species
+// and then the fields named in others
+void RegisterGroup(int group, const std::vector<void *> &functions, const std::vector<std::string> &names, const std::vector<std::string> &species, const std::vector<std::string> &others = {})
+{
+    fieldGroups[group].cache.Configure(species.size() + others.size() + 1, names.size());
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        std::vector<std::string> arguments = {"Temperature"};
+        for (const std::string &s : species)
+        {
+            arguments.push_back("$y" + s);
+        }
+        arguments.insert(arguments.end(), others.begin(), others.end());
+        RegisterFunction(functions[i], names[i], arguments);
+    }
+}
+
+void RegisterDerivatives()
+{
+    RegisterFunction((void *)EquilibriumConstantDerivative, "Equilibrium Constant Derivative Temperature", {"Temperature"});
+
+    fieldGroups[PITZER_DERIVATIVES].evaluate = [](const Real *const *inputs, Real *const *outputs, int begin, int end)
+    { activityModel->ActivityCoefficientDerivatives(inputs, outputs, begin, end); };
+    const std::vector<std::string> species = {"Ba_2+", "SO4_2-", "Etc_1-", "Etc_2-"};
+    std::vector<std::string> names = {"Pitzer Activity Coefficient Derivative Temperature"};
+    for (const std::string &name : species)
+    {
+        names.push_back("Pitzer Activity Coefficient Derivative y" + name);
+    }
+    RegisterGroup(PITZER_DERIVATIVES,
+                  GroupFunctions<PITZER_DERIVATIVES, PitzerBatch::DERIVATIVES>(species.size(), std::make_index_sequence<5>()),
+                  names, species);
+}
+
+void RegisterSpeciation()
+{
+    const Real kcal = 4186.80;
+    speciation->tolerance = RuntimeConfig::Number("SCALE_SPECIATION_TOL", sizeof(Real) == sizeof(double) ? 1e-8 : 1e-4);
+    speciation->AddComplex("BaSO4", {1, 1}, 0, 2.7, 0);
+    if (RuntimeConfig::Flag("SCALE_SPECIATION_CARBONATE"))
+    {
+        // Total inorganic carbon as CO3_2-, logK and delta_h from phreeqc.dat
+        speciation->AddComponent("CO3_2-", -2);
+        speciation->AddComplex("HCO3_1-", {0, 0, 1}, 1, 10.329, -3.561 * kcal);
+        speciation->AddComplex("CO2", {0, 0, 1}, 2, 16.681, -5.738 * kcal);
+        speciation->AddComplex("BaCO3", {1, 0, 1}, 0, 2.71, 3.55 * kcal);
+        speciation->AddComplex("BaHCO3_1+", {1, 0, 1}, 1, 11.311, 1.999 * kcal);
+    }
+
+    fieldGroups[SPECIATION].evaluate = [](const Real *const *inputs, Real *const *outputs, int begin, int end)
+    { speciation->Solve(inputs, outputs, begin, end); };
+    fieldGroups[SPECIATION].prepare = [](int size)
+    { speciation->Prepare(size); };
+
+    std::vector<std::string> names = {"Speciated Saturation Index"};
+    std::vector<std::string> species = {"Ba_2+", "SO4_2-", "Etc_1-", "Etc_2-"};
+    for (int j = 0; j < speciation->Components(); j++)
+    {
+        names.push_back("Free " + speciation->component[j] + " Molality");
+        if (j >= 2)
+            species.push_back(speciation->component[j]);
+    }
+    for (const AqueousComplex &complex : speciation->complexes)
+    {
+        names.push_back(complex.name + " Molality");
+    }
+    const std::vector<std::string> others = speciation->FixedPH() ? std::vector<std::string>{"pH"} : std::vector<std::string>{};
+    RegisterGroup(SPECIATION,
+                  GroupFunctions<SPECIATION, SpeciationSolver::MAX_OUTPUTS>(speciation->Inputs() - 1, std::make_index_sequence<SpeciationSolver::MAX_COMPONENTS + 4>()),
+                  names, species, others);
+}
+
+void RegisterKinetics()
+{
+    kinetics.saturation = saturationModel->BatchCoefficients();
+    kinetics.nu_A = activityModel->nu_A;
+    kinetics.nu_B = activityModel->nu_B;
+    kinetics.k_growth = RuntimeConfig::Number("SCALE_KINETICS_KG", 1e-6);
+    kinetics.E_a_R = RuntimeConfig::Number("SCALE_KINETICS_EA", 25e3) / ChemistryFunctions::R();
+    kinetics.T0 = ChemistryFunctions::T0();
+    kinetics.order = RuntimeConfig::Number("SCALE_KINETICS_ORDER", 2);
+    kinetics.k_nucleation = RuntimeConfig::Number("SCALE_KINETICS_KN", 1e-8);
+    kinetics.B_nucleation = RuntimeConfig::Number("SCALE_KINETICS_BN", 40);
+    kinetics.stiffness = RuntimeConfig::Number("SCALE_KINETICS_STIFFNESS", 1);
+    kinetics.maxSubsteps = 1;
+    while (kinetics.maxSubsteps < RuntimeConfig::Number("SCALE_KINETICS_MAX_SUBSTEPS", 64) && kinetics.maxSubsteps < (1 << 30))
+        kinetics.maxSubsteps *= 2;
+
+    fieldGroups[KINETICS].evaluate = [](const Real *const *inputs, Real *const *outputs, int begin, int end)
+    { KineticsBatch::PrecipitationRate<BariteActivityModel::Salt>(kinetics, inputs, outputs, begin, end, kineticsStatistics); };
+    RegisterGroup(KINETICS,
+                  GroupFunctions<KINETICS, 3>(5, std::make_index_sequence<6>()),
+                  {"Barite Precipitation Rate", "Barite Growth Rate", "Barite Nucleation Rate"},
+                  {"Ba_2+", "SO4_2-", "Etc_1-", "Etc_2-"}, {"$TimeStep"});
+}
+
+void RegisterDatabase(const char *path)
+{
+    if (!database.Load(path))
+    {
+        printf("Not loading %s\n", database.error.c_str());
+        return;
+    }
+
+    database.Compile();
+
+    useMulticomponentPitzer = RuntimeConfig::Flag("SCALE_DATABASE_PITZER");
+    if (useMulticomponentPitzer && !multicomponentPitzer->Build(database, activityModel->BatchCoefficients()))
+    {
+        printf("Not using the multicomponent Pitzer model: more than %d ions, %d pairs, %d alphas or %d charge pairs\n",
+               MulticomponentPitzer::MAX_IONS, MulticomponentPitzer::MAX_PAIRS, MulticomponentPitzer::MAX_ALPHAS, MulticomponentPitzer::MAX_MIXING);
+        useMulticomponentPitzer = false;
+    }
+    if (useMulticomponentPitzer)
+    {
+        fieldGroups[MULTICOMPONENT_PITZER].evaluate = [](const Real *const *inputs, Real *const *outputs, int begin, int end)
+        { multicomponentPitzer->ActivityCoefficients(inputs, outputs, begin, end); };
+        std::vector<std::string> names;
+        for (int i = 0; i < multicomponentPitzer->Ions(); i++)
+        {
+            names.push_back("Activity Coefficient " + multicomponentPitzer->ion[i]);
+        }
+        RegisterGroup(MULTICOMPONENT_PITZER,
+                      GroupFunctions<MULTICOMPONENT_PITZER, MulticomponentPitzer::MAX_IONS>(multicomponentPitzer->Ions(), std::make_index_sequence<MulticomponentPitzer::MAX_IONS + 1>()),
+                      names, multicomponentPitzer->ion);
+        printf("Loaded Pitzer parameters of %d ions from %s: %zu binary pairs, %zu mixing pairs, %zu triplet terms\n",
+               multicomponentPitzer->Ions(), path, multicomponentPitzer->pairCation.size(), multicomponentPitzer->likeI.size(), multicomponentPitzer->tripletPsi.size());
+    }
+
+    useMineralEngine = RuntimeConfig::Flag("SCALE_DATABASE_ENGINE");
+    if (useMineralEngine && !mineralEngine.Build(database))
+    {
+        printf("Not using the mineral engine: more than %d species\n", MineralEngine::MAX_SPECIES);
+        useMineralEngine = false;
+    }
+    if (useMineralEngine)
+    {
+        fieldGroups[MINERAL_ENGINE].evaluate = [](const Real *const *inputs, Real *const *outputs, int begin, int end)
+        { mineralEngine.SaturationIndex(inputs, outputs, begin, end); };
+        std::vector<std::string> names;
+        for (int i = 0; i < database.Size(); i++)
+        {
+            names.push_back("Saturation Index " + database.name[i]);
+        }
+        std::vector<std::string> species = mineralEngine.species;
+        species.push_back("Etc_1-");
+        species.push_back("Etc_2-");
+        RegisterGroup(MINERAL_ENGINE,
+                      GroupFunctions<MINERAL_ENGINE, MineralDatabase::MAX_MINERALS>(species.size(), std::make_index_sequence<MineralEngine::MAX_SPECIES + 3>()),
+                      names, species);
+        printf("Loaded %d minerals of %zu species from %s into one engine\n", database.Size(), mineralEngine.species.size(), path);
+        return;
+    }
+
+    const std::vector<MineralFunction> functions = MineralFunctions(std::make_index_sequence<MineralDatabase::MAX_MINERALS>());
+    for (int i = 0; i < database.Size(); i++)
+    {
+        RegisterFunction((void *)functions[i], "Saturation Index " + database.name[i],
+                         {"Temperature", "$y" + database.cation[i], "$y" + database.anion[i], "$yEtc_1-", "$yEtc_2-"});
+    }
+    printf("Loaded %d minerals from %s\n", database.Size(), path);
+}
+
+#if DOUBLE_PRECISION
+// Largest deviation of the mixed precision kernels from double over random
+// cells spanning the ranges of the field functions, down to I ~ 1e-6
+void ReportMixedPrecision()
 {
-    ucfunc((void *)EquilibriumConstant, "ScalarFieldFunction", "Equilibrium Constant");
-    ucarg((void *)EquilibriumConstant, "Cell", "Temperature", sizeof(Real));
+    const int n = 1 << 16;
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> u(0, 1);
+    std::vector<double> T(n), yA(n), yB(n), yEtc1(n), yEtc2(n), exact(n), mixed(n);
+    for (int i = 0; i < n; i++)
+    {
+        T[i] = 273.15 + 200 * u(rng);
+        yA[i] = 1e-7 * pow(1e4, u(rng));
+        yB[i] = 1e-6 * pow(1e4, u(rng));
+        yEtc1[i] = 0.1 * pow(u(rng), 4);
+        yEtc2[i] = 0.03 * pow(u(rng), 4);
+    }
+
+    auto report = [&](const char *name, bool relative)
+    {
+        double error = 0;
+        for (int i = 0; i < n; i++)
+        {
+            error = fmax(error, fabs(mixed[i] - exact[i]) / (relative ? fabs(exact[i]) : 1));
+        }
+        printf("Mixed precision %s: max %s error %.3g against double over %d cells\n", name, relative ? "relative" : "absolute", error, n);
+    };
+    activityModel->ActivityCoefficient(T.data(), yA.data(), yB.data(), yEtc1.data(), yEtc2.data(), exact.data(), n);
+    activityModel->ActivityCoefficientMixed(T.data(), yA.data(), yB.data(), yEtc1.data(), yEtc2.data(), mixed.data(), n);
+    report("Pitzer Activity Coefficient", true);
+    saturationModel->SaturationIndex(T.data(), yA.data(), yB.data(), yEtc1.data(), yEtc2.data(), exact.data(), n);
+    saturationModel->SaturationIndexMixed(T.data(), yA.data(), yB.data(), yEtc1.data(), yEtc2.data(), mixed.data(), n);
+    report("Saturation Index", false);
+    saturationModel->SaturationRatio(T.data(), yA.data(), yB.data(), yEtc1.data(), yEtc2.data(), exact.data(), n);
+    saturationModel->SaturationRatioMixed(T.data(), yA.data(), yB.data(), yEtc1.data(), yEtc2.data(), mixed.data(), n);
+    report("Supersaturation Ratio", true);
+}
+#endif
 
-    ucfunc((void *)PitzerActivity, "ScalarFieldFunction", "Pitzer Activity Coefficient");
-    ucarg((void *)PitzerActivity, "Cell", "Temperature", sizeof(Real));
-    ucarg((void *)PitzerActivity, "Cell", "$yBa_2+", sizeof(Real));
-    ucarg((void *)PitzerActivity, "Cell", "$ySO4_2-", sizeof(Real));
-    ucarg((void *)PitzerActivity, "Cell", "$yEtc_1-", sizeof(Real));
-    ucarg((void *)PitzerActivity, "Cell", "$yEtc_2-", sizeof(Real));
+// Registered with atexit by Uclib(), so it runs at unload before the
+// objects of ConstructModels() are destroyed, and only for the variant in use
+void ReportStatistics()
+{
+    if (trace->IsOpen())
+    {
+        trace->Close();
+        const TraceWriter::Statistics &s = trace->statistics;
+        printf("Trace: %ld calls (%.1f MB) written to %s, %ld calls dropped\n", s.calls.load(), s.bytes / 1048576.0, trace->path.c_str(), s.dropped.load());
+    }
+#if SCALE_PROFILE
+    std::string profile;
+    if (Profiler::Instance().Write(RuntimeConfig::String("SCALE_PROFILE_DIR", "."), profile))
+        printf("Profile of %zu field functions written to %s\n", Profiler::Instance().functions.size(), profile.c_str());
+    else
+        printf("Could not write profile to %s\n", profile.c_str());
+#endif
+    if (useMineralEngine)
+    {
+        const OutputCache::Statistics &s = fieldGroups[MINERAL_ENGINE].cache.statistics;
+        printf("Mineral engine: %ld passes over all %d minerals, %ld results taken from a previous pass, %ld new passes as the inputs changed in place\n", s.passes, mineralEngine.Minerals(), s.cached, s.changed);
+    }
+    if (useMulticomponentPitzer)
+    {
+        const OutputCache::Statistics &s = fieldGroups[MULTICOMPONENT_PITZER].cache.statistics;
+        printf("Multicomponent Pitzer: %ld passes over all %d ions, %ld results taken from a previous pass, %ld new passes as the inputs changed in place\n", s.passes, multicomponentPitzer->Ions(), s.cached, s.changed);
+    }
+    if (useDerivatives)
+    {
+        const OutputCache::Statistics &s = fieldGroups[PITZER_DERIVATIVES].cache.statistics;
+        printf("Pitzer derivatives: %ld passes over all %d derivatives, %ld results taken from a previous pass, %ld new passes as the inputs changed in place\n", s.passes, (int)PitzerBatch::DERIVATIVES, s.cached, s.changed);
+    }
+    if (useSpeciation)
+    {
+        const SpeciationSolver::Statistics &s = speciation->statistics;
+        const long coldStarts = s.coldStarts;
+        const long warmStarts = s.solves - coldStarts;
+        printf("Speciation: %ld cells solved, %ld cold started (%.2f Newton iterations each), %ld warm started (%.2f Newton iterations each), %ld not converged, %ld arena reallocations\n",
+               s.solves.load(), coldStarts, s.coldIterations / fmax(coldStarts, 1), warmStarts, s.warmIterations / fmax(warmStarts, 1), s.failures.load(), s.reallocations.load());
+    }
+    if (useKinetics)
+    {
+        const KineticsBatch::Statistics &s = kineticsStatistics;
+        const long cells = s.cells;
+        const long stiff = s.stiff;
+        printf("Precipitation kinetics: %ld cells, %.2f%% stiff (%.2f implicit sub-steps and %.2f Newton iterations each)\n",
+               cells, 100.0 * stiff / fmax(cells, 1), s.substeps / fmax(stiff, 1), s.newtonIterations / fmax(stiff, 1));
+    }
+    if (useActivityTable)
+    {
+        IsatTable<5>::Statistics s = IsatTable<5>::Statistics();
+        size_t entries = 0;
+        size_t bytes = 0;
+        for (const IsatTable<5> &table : activityTables)
+        {
+            s.queries += table.statistics.queries;
+            s.retrieves += table.statistics.retrieves;
+            s.grows += table.statistics.grows;
+            s.adds += table.statistics.adds;
+            s.directs += table.statistics.directs;
+            s.checks += table.statistics.checks;
+            s.shrinks += table.statistics.shrinks;
+            entries += table.Entries();
+            bytes += table.Bytes();
+        }
+        printf("ISAT Pitzer Activity Coefficient: %ld queries, %.2f%% retrieved, %ld grown, %ld added, %ld direct, %ld checked (%ld shrunk), %zu entries in %zu tables (%.1f MB)\n",
+               s.queries, 100.0 * s.retrieves / fmax(s.queries, 1), s.grows, s.adds, s.directs, s.checks, s.shrinks, entries, activityTables.size(), bytes / 1048576.0);
+    }
+    if (useAdaptiveActivity)
+    {
+        const AdaptiveActivityModel::Statistics &s = adaptiveActivityModel->statistics;
+        long counts[AdaptiveActivityModel::REGIMES];
+        long cells = 0;
+        for (int regime = 0; regime < AdaptiveActivityModel::REGIMES; regime++)
+        {
+            counts[regime] = s.cells[regime];
+            cells += counts[regime];
+        }
+        printf("Adaptive activity: %ld cells, %.2f%% Debye-Huckel, %.2f%% Davies, %.2f%% Truesdell-Jones, %.2f%% Pitzer\n",
+               cells, 100.0 * counts[0] / fmax(cells, 1), 100.0 * counts[1] / fmax(cells, 1), 100.0 * counts[2] / fmax(cells, 1), 100.0 * counts[3] / fmax(cells, 1));
+    }
+    if (useTemporalCache)
+    {
+        const std::pair<const char *, const TemporalCache<5> *> caches[] = {{"Pitzer Activity Coefficient", &activityCache},
+                                                                             {"Saturation Index", &saturationIndexCache},
+                                                                             {"Supersaturation Ratio", &saturationRatioCache}};
+        for (const auto &cache : caches)
+        {
+            const TemporalCache<5>::Statistics &s = cache.second->statistics;
+            const long cells = s.cells;
+            printf("Memoized %s: %ld calls, %ld cells, %.2f%% reused, %ld layouts started cold (%.1f MB)\n",
+                   cache.first, s.calls.load(), cells, 100.0 * s.reused / fmax(cells, 1), s.layouts.load(), cache.second->Bytes() / 1048576.0);
+        }
+    }
+    if (useDeduplication)
+    {
+        auto report = [](const char *name, const auto &s)
+        {
+            const long cells = s.cells;
+            const long evaluated = s.evaluated;
+            printf("Deduplicated %s: %ld cells, %ld evaluated (dedup ratio %.2f), %.2f%% bypassed\n",
+                   name, cells, evaluated, cells / fmax(evaluated, 1), 100.0 * s.bypassed / fmax(cells, 1));
+        };
+        report("Equilibrium Constant", equilibriumDeduplicator.statistics);
+        report("Pitzer Activity Coefficient", activityDeduplicator.statistics);
+    }
+}
+
+// Builds the models and the other objects with constructors of this variant
+void ConstructModels()
+{
+    threadPool.Construct();
+    equilibriumModel.Construct(log_k, delta_h, ChemistryFunctions::T0());
+    activityModel.Construct(beta_0, beta_1, beta_2, C_phi);
+    adaptiveActivityModel.Construct(*activityModel);
+    saturationModel.Construct(*equilibriumModel, *activityModel);
+    trace.Construct();
+    multicomponentPitzer.Construct();
+    bariteReaction.Construct(nu_Ba, nu_SO4, nu_BaSO4, Z_Ba, Z_SO4);
+    speciation.Construct(*bariteReaction, *activityModel, *equilibriumModel, "Ba_2+", "SO4_2-");
+}
+
+// Registers the field functions of this variant
+void Uclib()
+{
+    ConstructModels();
+    atexit(ReportStatistics);
+#if SCALE_PROFILE
+    Profiler::Instance().stride = fmax(RuntimeConfig::Number("SCALE_PROFILE_STRIDE", 64), 1);
+#endif
+
+    // Opt-in threads, serial below SCALE_THREADS_MIN_CELLS cells per call.
+    // Pinned threads of MPI ranks that share an affinity mask start at
+    // rank * threads, so that the ranks do not pile onto the same CPUs.
+    const int threads = RuntimeConfig::Number("SCALE_THREADS", 1);
+    if (threads > 1)
+    {
+        threadPool->Start(threads, RuntimeConfig::Number("SCALE_THREADS_MIN_CELLS", 16384), RuntimeConfig::Flag("SCALE_THREADS_PIN"),
+                         RuntimeConfig::Rank() > 0 ? RuntimeConfig::Rank() * threads : 0);
+    }
+
+    // Opt-in float lanes of a double build, checked against double once
+    if (RuntimeConfig::Flag("SCALE_MIXED_PRECISION"))
+    {
+#if DOUBLE_PRECISION
+        useMixedPrecision = true;
+        ReportMixedPrecision();
+#else
+        printf("Not using mixed precision: the library is built in float\n");
+#endif
+    }
+
+    // Opt-in ISAT of the activity coefficient, inputs scaled by typical
+    // values, a table and a share of the memory cap per thread
+    useActivityTable = RuntimeConfig::Flag("SCALE_ISAT");
+    if (useActivityTable)
+    {
+        const double scale[5] = {300, 1e-4, 1e-3, 3e-2, 5e-3};
+        activityTables.resize(threadPool->Threads());
+        for (IsatTable<5> &table : activityTables)
+        {
+            table.Configure(RuntimeConfig::Number("SCALE_ISAT_TOL", 1e-4),
+                            RuntimeConfig::Number("SCALE_ISAT_RADIUS", 1e-3),
+                            scale,
+                            RuntimeConfig::Number("SCALE_ISAT_MAXMB", 64) * 1048576 / activityTables.size(),
+                            RuntimeConfig::Number("SCALE_ISAT_CHECK", 64));
+        }
+    }
+
+    // Opt-in activity models by ionic strength, calibrated against Pitzer's
+    // eq. over the temperatures of SCALE_ADAPTIVE_ACTIVITY_TMIN/TMAX
+    useAdaptiveActivity = RuntimeConfig::Flag("SCALE_ADAPTIVE_ACTIVITY");
+    if (useAdaptiveActivity)
+    {
+        const Real tolerance = RuntimeConfig::Number("SCALE_ADAPTIVE_ACTIVITY_TOL", 1e-3);
+        adaptiveActivityModel->Calibrate(RuntimeConfig::Number("SCALE_ADAPTIVE_ACTIVITY_TMIN", 273.15), RuntimeConfig::Number("SCALE_ADAPTIVE_ACTIVITY_TMAX", 473.15), tolerance);
+        printf("Adaptive activity within %g of ln(gamma): Debye-Huckel up to I = %.3g, Davies up to %.3g, Truesdell-Jones up to %.3g mol/kg\n",
+               tolerance, adaptiveActivityModel->validity[0], adaptiveActivityModel->validity[1], adaptiveActivityModel->validity[2]);
+    }
+
+    // Opt-in reuse of unchanged cells by the built-in barite functions
+    useTemporalCache = RuntimeConfig::Flag("SCALE_MEMO");
+    if (useTemporalCache)
+    {
+        const Real tolerance = RuntimeConfig::Number("SCALE_MEMO_RTOL", 1e-6);
+        const int layouts = RuntimeConfig::Number("SCALE_MEMO_LAYOUTS", 4);
+        activityCache.Configure(tolerance, layouts);
+        saturationIndexCache.Configure(tolerance, layouts);
+        saturationRatioCache.Configure(tolerance, layouts);
+    }
+
+    // Opt-in evaluation of each distinct state of a call once
+    useDeduplication = RuntimeConfig::Flag("SCALE_DEDUP");
+
+    // Opt-in trace of the solver's inputs, one file per rank
+    const char *traceDirectory = RuntimeConfig::String("SCALE_TRACE_DIR", NULL);
+    if (traceDirectory != NULL)
+    {
+        const std::string path = std::string(traceDirectory) + "/scale_trace." + RuntimeConfig::RankName() + ".bin";
+        if (trace->Open(path, RuntimeConfig::Number("SCALE_TRACE_BUFFER_MB", 256) * 1048576))
+        {
+            traceEquilibrium = trace->Function("Equilibrium Constant", 1);
+            tracePitzer = trace->Function("Pitzer Activity Coefficient", 5);
+        }
+        else
+        {
+            printf("Could not create trace %s\n", path.c_str());
+        }
+    }
+
+    RegisterFunction((void *)EquilibriumConstant, "Equilibrium Constant", {"Temperature"});
+
+    RegisterFunction((void *)PitzerActivity, "Pitzer Activity Coefficient", {"Temperature", "$yBa_2+", "$ySO4_2-", "$yEtc_1-", "$yEtc_2-"});
+
+    RegisterFunction((void *)SaturationIndex, "Saturation Index", {"Temperature", "$yBa_2+", "$ySO4_2-", "$yEtc_1-", "$yEtc_2-"});
+
+    RegisterFunction((void *)SupersaturationRatio, "Supersaturation Ratio", {"Temperature", "$yBa_2+", "$ySO4_2-", "$yEtc_1-", "$yEtc_2-"});
+
+    // Opt-in derivatives with respect to T and the mass fractions
+    useDerivatives = RuntimeConfig::Flag("SCALE_DERIVATIVES");
+    if (useDerivatives)
+    {
+        RegisterDerivatives();
+    }
+
+    // Opt-in speciation with a warm-started Newton solve per cell
+    useSpeciation = RuntimeConfig::Flag("SCALE_SPECIATION");
+    if (useSpeciation)
+    {
+        RegisterSpeciation();
+    }
+
+    // Opt-in precipitation source term with stiff sub-cycling
+    useKinetics = RuntimeConfig::Flag("SCALE_KINETICS");
+    if (useKinetics)
+    {
+        RegisterKinetics();
+    }
+
+    // Opt-in minerals of a PHREEQC-like parameter file
+    const char *path = RuntimeConfig::String("SCALE_DATABASE", NULL);
+    if (path != NULL)
+    {
+        RegisterDatabase(path);
+    }
+}
+
+#ifdef SCALE_ISA_NAMESPACE
+}; // namespace SCALE_ISA_NAMESPACE
+#else
+// Entry point of STAR-CCM+: hands over to the variant for the instruction
+// set of this CPU (or SCALE_ISA)
+void uclib()
+{
+    const int isa = IsaVariant::Select();
+    printf("Batch kernels: %s\n", IsaVariant::Name(isa));
+#if SCALE_ISA_VARIANTS
+    if (isa == IsaVariant::AVX512)
+        return Avx512::Uclib();
+    if (isa == IsaVariant::AVX2)
+        return Avx2::Uclib();
+#endif
+    Uclib();
 }
+#endif
@@ -25,9 +25,27 @@ SOFTWARE.
 #ifndef CHEMFUNC_H
 #define CHEMFUNC_H
 
+#include "fast_math.h"
+#include <type_traits>
+#include <utility>
+
 namespace ChemistryFunctions
 {
 
+// Lane type of V, a scalar or a vector, to which the constants of the water
+// correlations are rounded, so that float lanes of a double build use them
+template <typename V, typename = void>
+struct Lane
+{
+    typedef V type;
+};
+
+template <typename V>
+struct Lane<V, std::void_t<decltype(std::declval<V>()[0])> >
+{
+    typedef typename std::decay<decltype(std::declval<V>()[0])>::type type;
+};
+
 const Real k_b()
 {
     return 1.38064852e-23;
@@ -63,16 +81,64 @@ const Real permittivityVacuum()
     return 8.8542e-12;
 }
 
+// Relative permittivity of water, Malmberg and Maryott (1956), fitted on
+// 0-100 C; a polynomial so it costs no transcendental per cell
+template <typename V>
+const V permittivityWater(V T)
+{
+    typedef typename Lane<V>::type S;
+    const V t = T - (S)273.15;
+    return (S)87.740 + t * ((S)-0.40008 + t * ((S)9.398e-4 + t * (S)-1.410e-6));
+}
+
+// Density of liquid water at 1 atm in kg/m3, Kell (1975), fitted on 0-150 C
+template <typename V>
+const V densityWater(V T)
+{
+    typedef typename Lane<V>::type S;
+    const V t = T - (S)273.15;
+    const V numerator = (S)999.83952 + t * ((S)16.945176 + t * ((S)-7.9870401e-3 + t * ((S)-46.170461e-6 + t * ((S)105.56302e-9 + t * (S)-280.54253e-12))));
+    return numerator / (1 + (S)16.879850e-3 * t);
+}
+
+// d eps_r / dT
+template <typename V>
+const V permittivityWaterDerivative(V T)
+{
+    typedef typename Lane<V>::type S;
+    const V t = T - (S)273.15;
+    return (S)-0.40008 + t * ((S)(2 * 9.398e-4) + t * (S)(3 * -1.410e-6));
+}
+
+// d rho_w / dT in kg/m3/K
+template <typename V>
+const V densityWaterDerivative(V T)
+{
+    typedef typename Lane<V>::type S;
+    const V t = T - (S)273.15;
+    const V numerator = (S)16.945176 + t * ((S)(2 * -7.9870401e-3) + t * ((S)(3 * -46.170461e-6) + t * ((S)(4 * 105.56302e-9) + t * (S)(5 * -280.54253e-12))));
+    return (numerator - densityWater(T) * (S)16.879850e-3) / (1 + (S)16.879850e-3 * t);
+}
+
 const Real permittivityWater()
 {
-    //Make function of T
-    return 78.4;
+    return permittivityWater(T0());
 }
 
 const Real densityWater()
 {
-    //Make function of T
-    return 997;
+    return densityWater(T0());
+}
+
+// e^2 / (4 pi eps_0 k_b), the Bjerrum length times eps_r T
+const Real BjerrumConstant()
+{
+    return electronicCharge() * electronicCharge() / (4 * M_PI * permittivityVacuum() * k_b());
+}
+
+const Real SmallIonicStrength()
+{
+    return 1e-18;
 }
 
 const Real IonicStrength(const Real *m, const Real *Z, const int noReactants)
@@ -80,14 +146,14 @@ const Real IonicStrength(const Real *m, const Real *Z, const int noReactants)
     Real I = 0;
     for (int j = 0; j < noReactants; j++)
     {
-        I = I + m[j] * pow(Z[j], 2); //0.5 should be taken outside loop for better performance
+        I = I + m[j] * Math::IntPow<2>(Z[j]); //0.5 should be taken outside loop for better performance
     }
 
     I = 0.5 * I;
     // AVOID zero
-    if (I < 1e-18)
+    if (I < SmallIonicStrength())
     {
-        I = 1e-18;
+        I = SmallIonicStrength();
     }
     return I;
 }
@@ -0,0 +1,219 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef DEBYE_HUCKEL_ACTIVITY_MODEL_H
+#define DEBYE_HUCKEL_ACTIVITY_MODEL_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include "fast_math.h"
+#include <cstdlib>
+#include "activity_model.h"
+#include "pitzer_batch.h"
+#include "simd.h"
+#include "simd_math.h"
+
+namespace DebyeHuckelBatch
+{
+
+// Mean activity coefficient of a salt from the ionic strength alone, with A
+// the Debye-Huckel parameter of PitzerActivityModel (ln basis). Cheaper than
+// Pitzer's eq., and close to it at low ionic strength.
+enum Form
+{
+    LIMITING,       // ln(gamma) = -|Z_A Z_B| A sqrt(I)
+    DAVIES,         // ln(gamma) = -|Z_A Z_B| A (sqrt(I) / (1 + sqrt(I)) - 0.3 I)
+    TRUESDELL_JONES // ln(gamma) = -|Z_A Z_B| A sqrt(I) / (1 + Ba sqrt(I)) + b I
+};
+
+// Constants of the forms, folded once per batch
+struct Coefficients
+{
+    Real SMALL;
+    Real I_min;
+    Real M_w;
+    Real A_0;  // sqrt(2 pi N_A)
+    Real l_B;  // e^2 / (4 pi eps_0 k_b)
+    Real Z_AB; // |Z_A Z_B|
+    Real Ba;   // ion size times B of Truesdell-Jones [(kg/mol)^0.5]
+    Real b;    // linear term of Truesdell-Jones [kg/mol]
+};
+
+// IonicStrength of PitzerActivityModel with the spectator charges {1, 2}
+template <typename V>
+inline V IonicStrength(const Coefficients &c, V yEtc1, V yEtc2)
+{
+    const V mTot = 1 / (c.M_w / (1 - (yEtc1 + yEtc2)) + c.SMALL);
+    return Simd::Max(0.5 * (yEtc1 * mTot + 4 * (yEtc2 * mTot)), Simd::Broadcast<V>(c.I_min));
+}
+
+// ln(gamma) of the form at temperature T and ionic strength I
+template <Form FORM, typename V>
+inline V LogActivityCoefficient(const Coefficients &c, V T, V I)
+{
+    const V sqrtI = Simd::Sqrt(I);
+    if constexpr (FORM == LIMITING)
+    {
+        return -c.Z_AB * PitzerBatch::DebyeHuckelParam(c, T) * sqrtI;
+    }
+    else if constexpr (FORM == DAVIES)
+    {
+        const V A = PitzerBatch::DebyeHuckelParam(c, T);
+        return -c.Z_AB * A * (sqrtI / (1 + sqrtI) - (Real)0.3 * I);
+    }
+    else
+    {
+        const V A = PitzerBatch::DebyeHuckelParam(c, T);
+        return -c.Z_AB * A * sqrtI / (1 + c.Ba * sqrtI) + c.b * I;
+    }
+}
+
+// Activity coefficient of one vector of cells, 1 where I < SMALL as in
+// PitzerActivityModel
+template <Form FORM, typename V>
+inline V ActivityCoefficient(const Coefficients &c, V T, V I)
+{
+    const V ln_gamma = LogActivityCoefficient<FORM>(c, T, I);
+    return I < c.SMALL ? Simd::Broadcast<V>(1) : Simd::Exp(ln_gamma);
+}
+
+// Ionic strengths of n cells
+inline void IonicStrength(const Coefficients &c, const Real *yEtc1, const Real *yEtc2, Real *I, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V yEtc1, V yEtc2)
+              { return IonicStrength(c, yEtc1, yEtc2); },
+              I, n, yEtc1, yEtc2);
+}
+
+// Activity coefficients of n cells of known ionic strength
+template <Form FORM>
+inline void ActivityCoefficient(const Coefficients &c, const Real *T, const Real *I, Real *gamma, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T, V I)
+              { return ActivityCoefficient<FORM>(c, T, I); },
+              gamma, n, T, I);
+}
+
+// Activity coefficients of n cells from the spectator mass fractions
+template <Form FORM>
+inline void ActivityCoefficient(const Coefficients &c, const Real *T, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T, V yEtc1, V yEtc2)
+              { return ActivityCoefficient<FORM>(c, T, IonicStrength(c, yEtc1, yEtc2)); },
+              gamma, n, T, yEtc1, yEtc2);
+}
+
+}; // namespace DebyeHuckelBatch
+
+// ActivityModel of one of the forms of DebyeHuckelBatch. The molalities of
+// the salt's own ions do not enter, only T and the spectators through I.
+template <DebyeHuckelBatch::Form FORM>
+class IonicStrengthActivityModel : public ActivityModel
+{
+public:
+    const Real SMALL = 1e-16;
+
+    const Real Z_A;
+    const Real Z_B;
+
+    // Truesdell-Jones ion size times B [(kg/mol)^0.5] and linear term
+    // [kg/mol], unused otherwise. Ba is taken constant, as b of Pitzer's eq.
+    Real Ba;
+    Real b;
+
+    IonicStrengthActivityModel(Real Z_A, Real Z_B, Real Ba = 0, Real b = 0) : Z_A(Z_A), Z_B(Z_B), Ba(Ba), b(b)
+    {
+    }
+
+    // Activity Coeffiecient (gamma)
+    const Real ActivityCoefficient(Real T, Real /*yA*/, Real /*yB*/, Real yEtc1, Real yEtc2) override
+    {
+        return ActivityCoefficient(T, IonicStrength(yEtc1, yEtc2));
+    }
+
+    // Activity Coeffiecient (gamma) at ionic strength I
+    const Real ActivityCoefficient(Real T, Real I)
+    {
+        if (I < SMALL)
+            return 1;
+        const Real sqrtI = sqrt(I);
+        const Real Z_AB = fabs(Z_A * Z_B);
+        if (FORM == DebyeHuckelBatch::LIMITING)
+            return Math::Exp(-Z_AB * DebyeHuckelParam(T) * sqrtI);
+        if (FORM == DebyeHuckelBatch::DAVIES)
+            return Math::Exp(-Z_AB * DebyeHuckelParam(T) * (sqrtI / (1 + sqrtI) - 0.3 * I));
+        return Math::Exp(-Z_AB * DebyeHuckelParam(T) * sqrtI / (1 + Ba * sqrtI) + b * I);
+    }
+
+    // Activity Coeffiecients (gamma) of n cells
+    void ActivityCoefficient(const Real *T, const Real * /*yA*/, const Real * /*yB*/, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n) override
+    {
+        DebyeHuckelBatch::ActivityCoefficient<FORM>(BatchCoefficients(), T, yEtc1, yEtc2, gamma, n);
+    }
+
+    // Activity Coeffiecients (gamma) of n cells at the ionic strengths I
+    void ActivityCoefficient(const Real *T, const Real *I, Real *gamma, int n)
+    {
+        DebyeHuckelBatch::ActivityCoefficient<FORM>(BatchCoefficients(), T, I, gamma, n);
+    }
+
+    // IonicStrength of PitzerActivityModel
+    const Real IonicStrength(Real yEtc1, Real yEtc2)
+    {
+        const Real mTot = 1 / (ChemistryFunctions::MolarMassOfWater() / (1 - (yEtc1 + yEtc2)) + SMALL);
+        return fmax(0.5 * (yEtc1 * mTot + 4 * (yEtc2 * mTot)), ChemistryFunctions::SmallIonicStrength());
+    }
+
+    ///A, as PitzerActivityModel::DebyeHuckelParam
+    const Real DebyeHuckelParam(Real T)
+    {
+        const Real q = ChemistryFunctions::BjerrumConstant() / (ChemistryFunctions::permittivityWater(T) * T);
+        return sqrt(2 * M_PI * ChemistryFunctions::N_A() * ChemistryFunctions::densityWater(T)) * q * sqrt(q); //kg/mol
+    }
+
+    // Model constants for the batch kernels
+    const DebyeHuckelBatch::Coefficients BatchCoefficients()
+    {
+        DebyeHuckelBatch::Coefficients c;
+        c.SMALL = SMALL;
+        c.I_min = ChemistryFunctions::SmallIonicStrength();
+        c.M_w = ChemistryFunctions::MolarMassOfWater();
+        c.A_0 = sqrt(2 * M_PI * ChemistryFunctions::N_A());
+        c.l_B = ChemistryFunctions::BjerrumConstant();
+        c.Z_AB = fabs(Z_A * Z_B);
+        c.Ba = Ba;
+        c.b = b;
+        return c;
+    }
+};
+
+typedef IonicStrengthActivityModel<DebyeHuckelBatch::LIMITING> DebyeHuckelActivityModel;
+typedef IonicStrengthActivityModel<DebyeHuckelBatch::DAVIES> DaviesActivityModel;
+typedef IonicStrengthActivityModel<DebyeHuckelBatch::TRUESDELL_JONES> TruesdellJonesActivityModel;
+
+#endif // DEBYE_HUCKEL_ACTIVITY_MODEL_H
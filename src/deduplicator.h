@@ -0,0 +1,226 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef DEDUPLICATOR_H
+#define DEDUPLICATOR_H
+
+#include "uclib.h"
+#include "math.h"
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// Evaluates each distinct input state of a range of cells once. A cell equal
+// to its predecessor in all D inputs joins its run; the other cells are
+// looked up by a hash of their input bits in an open-addressing table, so
+// equal states anywhere in the range share one evaluation. The distinct
+// states are gathered into contiguous arrays, evaluated in one batch and
+// their results scattered back. Equality is bitwise, so the results are
+// those of evaluating every cell.
+//
+// A lookup costs 5-30 ns, more than a cheap function of one cell. The first
+// BLOCK cells of a range are evaluated directly and timed, the others are
+// looked up a BLOCK at a time and the lookups timed, taking the fastest
+// block as a thread preempted during one only adds to its time. The chance
+// that the next cell is a new state is estimated by the fraction of the
+// cells looked up that are the only cell of their state (Good-Turing), and
+// once a lookup and that chance of an evaluation cost more than evaluating
+// a cell, the rest of the range is evaluated directly. Without repetition
+// every cell of a block is its own state, so a range pays for the lookups
+// of one block.
+//
+// The range is looked up and evaluated in chunks of CHUNK cells, each with
+// a table of its own, so the thread-local buffers stay within a chunk
+// however large the range; a state is evaluated once per chunk it
+// appears in.
+template <int D>
+class Deduplicator
+{
+public:
+    struct Statistics
+    {
+        std::atomic<long> cells;
+        std::atomic<long> evaluated; // distinct states and cells evaluated directly
+        std::atomic<long> bypassed;  // cells evaluated directly
+    } statistics = {};
+
+    static const int BLOCK = 1024;
+    static const int CHUNK = 16 * BLOCK;
+
+    // result of the n cells of input, through evaluate(inputs, outputs, n)
+    // once per distinct state. Threads may evaluate disjoint ranges
+    // concurrently.
+    template <typename F>
+    void Evaluate(const Real *const *input, Real *result, int n, F evaluate)
+    {
+        statistics.cells += n;
+        if (n < 2 * BLOCK)
+        {
+            statistics.evaluated += n;
+            statistics.bypassed += n;
+            evaluate(input, result, n);
+            return;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        evaluate(input, result, BLOCK);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        const double cell = std::chrono::duration<double>(end - start).count() / BLOCK;
+
+        thread_local std::vector<int> slots;
+        thread_local std::vector<Real> gathered;
+        thread_local std::vector<uint64_t> entries;
+        thread_local std::vector<char> onlies;
+        thread_local uint32_t generation = 0;
+        const int most = n < CHUNK + 2 * BLOCK ? n : CHUNK + 2 * BLOCK; // cells of a chunk
+        slots.resize(most);
+        gathered.resize((size_t)(D + 1) * most);
+        onlies.resize(most);
+        int *const slot = slots.data();   // states of the cells of the chunk
+        char *const only = onlies.data(); // state j was seen in one cell
+
+        const Real *x[D];
+        Real *distinct[D + 1];
+        for (int k = 0; k < D; k++)
+            x[k] = input[k];
+        for (int k = 0; k <= D; k++)
+            distinct[k] = &gathered[(size_t)k * most];
+        long evaluated = BLOCK;
+        int looked = BLOCK; // cells evaluated or looked up, the rest are evaluated directly
+        double lookup = INFINITY;
+        bool repays = true;
+        while (looked < n && repays)
+        {
+            // Cells [first, stop) share a table and one batch of distinct states
+            const int first = looked;
+            const int stop = n - first < CHUNK + 2 * BLOCK ? n : first + CHUNK;
+            const uint64_t mask = Table(entries, generation, 2 * (stop - first));
+            const uint64_t stamp = (uint64_t)generation << 32;
+            uint64_t *const table = entries.data();
+            int count = 0;
+            int singles = 0; // states seen in one cell
+            while (looked < stop && repays)
+            {
+                const int last = stop - looked < 2 * BLOCK ? stop : looked + BLOCK;
+                start = std::chrono::steady_clock::now();
+                for (int i = looked; i < last; i++)
+                {
+                    const int j = i > first && Equal(x, i, x, i - 1) ? slot[i - 1 - first] : Insert(table, mask, stamp, x, i, distinct, count);
+                    if (j == count)
+                    {
+                        for (int k = 0; k < D; k++)
+                            distinct[k][count] = x[k][i];
+                        only[count++] = 1;
+                        singles++;
+                    }
+                    else
+                    {
+                        singles -= only[j];
+                        only[j] = 0;
+                    }
+                    slot[i - first] = j;
+                }
+                end = std::chrono::steady_clock::now();
+                lookup = fmin(lookup, std::chrono::duration<double>(end - start).count() / (last - looked));
+                looked = last;
+                repays = lookup + (double)singles / (looked - first) * cell < cell;
+            }
+            evaluate(distinct, distinct[D], count);
+            for (int i = first; i < looked; i++)
+                result[i] = distinct[D][slot[i - first]];
+            evaluated += count;
+        }
+        statistics.evaluated += evaluated + (n - looked);
+        statistics.bypassed += BLOCK + (n - looked);
+
+        if (looked < n)
+        {
+            for (int k = 0; k < D; k++)
+                x[k] += looked;
+            evaluate(x, result + looked, n - looked);
+        }
+    }
+
+private:
+    static uint64_t Bits(Real x)
+    {
+        uint64_t bits = 0;
+        memcpy(&bits, &x, sizeof(x));
+        return bits;
+    }
+
+    static bool Equal(const Real *const *a, int i, const Real *const *b, int j)
+    {
+        bool equal = true;
+        for (int k = 0; k < D; k++)
+            equal &= Bits(a[k][i]) == Bits(b[k][j]);
+        return equal;
+    }
+
+    // Index among the count distinct states of the state of cell i, count if
+    // it is new and was entered
+    static int Insert(uint64_t *table, uint64_t mask, uint64_t stamp, const Real *const *x, int i, Real *const *distinct, int count)
+    {
+        for (uint64_t h = Hash(x, i);; h++)
+        {
+            uint64_t &entry = table[h & mask];
+            if ((entry & ~0xFFFFFFFFull) != stamp)
+            {
+                entry = stamp | (uint32_t)count;
+                return count;
+            }
+            if (Equal(x, i, distinct, (uint32_t)entry))
+                return (uint32_t)entry;
+        }
+    }
+
+    // Independent multiplies of the inputs rather than a chain, mixed once
+    static uint64_t Hash(const Real *const *input, int i)
+    {
+        uint64_t h = 0;
+        for (int k = 0; k < D; k++)
+            h += Bits(input[k][i]) * (0x9E3779B97F4A7C15ull + 2 * k);
+        h ^= h >> 32;
+        return h * 0xD6E8FEB86659FD93ull >> 16;
+    }
+
+    // Empties table, of at least size entries, by a new generation of its
+    // stamps rather than by clearing it; its mask
+    static uint64_t Table(std::vector<uint64_t> &table, uint32_t &generation, int size)
+    {
+        size_t entries = 16;
+        while (entries < (size_t)size)
+            entries *= 2;
+        if (++generation == 0 || table.size() < entries)
+        {
+            table.assign(table.size() < entries ? entries : table.size(), 0);
+            generation = 1;
+        }
+        return entries - 1;
+    }
+};
+
+#endif // DEDUPLICATOR_H
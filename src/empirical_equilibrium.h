@@ -28,15 +28,17 @@ SOFTWARE.
 #include "chemistry.h"
 #include "uclib.h"
 #include "math.h"
+#include "fast_math.h"
 #include <cstdlib>
 #include "equilibrium_formulation.h"
+#include "equilibrium_batch.h"
 
 class EmpiricalEquilibrium : public EquilibriumFormulation
 {
 public:
     const Real analytical_expression[4];
 
-    EmpiricalEquilibrium(Real A, Real B, Real C, Real D) : analytical_expression({A, B, C, D})
+    EmpiricalEquilibrium(Real A, Real B, Real C, Real D) : analytical_expression{A, B, C, D}
     {
         //{-282.43, -8.972e-2, 5822, 113.08}
     }
@@ -44,7 +46,36 @@ public:
     // Equilibrium concentration at T
     const Real Equilibrium(Real T)
     {
-        return pow(10.0, analytical_expression[0] + analytical_expression[1] * T + analytical_expression[2] / T + analytical_expression[3] * log10(T));
+        return Math::Exp10(analytical_expression[0] + analytical_expression[1] * T + analytical_expression[2] / T + analytical_expression[3] * Math::Log10(T));
+    }
+
+    // Equilibrium concentrations of n cells
+    void Equilibrium(const Real *T, Real *K, int n)
+    {
+        EquilibriumBatch::Equilibrium(BatchCoefficients(), T, K, n);
+    }
+
+    // dK/dT at T
+    const Real EquilibriumDerivative(Real T)
+    {
+        return Equilibrium(T) * (M_LN10 * (analytical_expression[1] - analytical_expression[2] / (T * T)) + analytical_expression[3] / T);
+    }
+
+    // dK/dT of n cells
+    void EquilibriumDerivative(const Real *T, Real *dK, int n)
+    {
+        EquilibriumBatch::EquilibriumDerivative(BatchCoefficients(), T, dK, n);
+    }
+
+    // ln K = ln(10) (A + B T + C / T) + D ln T
+    const EquilibriumBatch::Coefficients BatchCoefficients()
+    {
+        EquilibriumBatch::Coefficients c;
+        c.a_0 = M_LN10 * analytical_expression[0];
+        c.a_1 = M_LN10 * analytical_expression[1];
+        c.a_2 = M_LN10 * analytical_expression[2];
+        c.a_3 = analytical_expression[3];
+        return c;
     }
 };
 
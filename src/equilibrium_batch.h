@@ -0,0 +1,95 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef EQUILIBRIUM_BATCH_H
+#define EQUILIBRIUM_BATCH_H
+
+#include "uclib.h"
+#include "math.h"
+#include "simd.h"
+#include "simd_math.h"
+
+namespace EquilibriumBatch
+{
+
+// Equilibrium constants of the form ln K = a_0 + a_1 T + a_2 / T + a_3 ln T,
+// with all unit conversions folded into the coefficients
+struct Coefficients
+{
+    Real a_0;
+    Real a_1;
+    Real a_2;
+    Real a_3;
+};
+
+template <typename V>
+inline V LogEquilibrium(const Coefficients &c, V T)
+{
+    V lnK = c.a_0 + c.a_2 / T;
+    if (c.a_1 != 0)
+        lnK += c.a_1 * T;
+    if (c.a_3 != 0)
+        lnK += c.a_3 * Simd::Log(T);
+    return lnK;
+}
+
+template <typename V>
+inline V Equilibrium(const Coefficients &c, V T)
+{
+    return Simd::Exp(LogEquilibrium(c, T));
+}
+
+// dK/dT = K (a_1 - a_2 / T^2 + a_3 / T)
+template <typename V>
+inline V EquilibriumDerivative(const Coefficients &c, V T)
+{
+    V dlnK = -c.a_2 / (T * T);
+    if (c.a_1 != 0)
+        dlnK += c.a_1;
+    if (c.a_3 != 0)
+        dlnK += c.a_3 / T;
+    return Simd::Exp(LogEquilibrium(c, T)) * dlnK;
+}
+
+// Equilibrium constants of n cells
+inline void Equilibrium(const Coefficients &c, const Real *T, Real *K, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T)
+              { return Equilibrium(c, T); },
+              K, n, T);
+}
+
+// dK/dT of n cells
+inline void EquilibriumDerivative(const Coefficients &c, const Real *T, Real *dK, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T)
+              { return EquilibriumDerivative(c, T); },
+              dK, n, T);
+}
+
+}; // namespace EquilibriumBatch
+
+#endif // EQUILIBRIUM_BATCH_H
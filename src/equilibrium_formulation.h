@@ -37,6 +37,29 @@ public:
     virtual const Real Equilibrium(Real T) {
         return 0;
     };
+
+    // Equilibrium concentrations of n cells
+    virtual void Equilibrium(const Real *T, Real *K, int n)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            K[i] = Equilibrium(T[i]);
+        }
+    };
+
+    // dK/dT at T
+    virtual const Real EquilibriumDerivative(Real T) {
+        return 0;
+    };
+
+    // dK/dT of n cells
+    virtual void EquilibriumDerivative(const Real *T, Real *dK, int n)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            dK[i] = EquilibriumDerivative(T[i]);
+        }
+    };
 };
 
 #endif // EQUILIBRIUM_FROMULATION_H
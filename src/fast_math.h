@@ -0,0 +1,438 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include "uclib.h"
+#include "math.h"
+#include <string.h>
+
+#ifndef SCALE_FAST_MATH
+#define SCALE_FAST_MATH 1
+#endif
+
+// Scalar exp, exp10, log and log10 for the model paths that work on one cell,
+// and the powers of the models. The batch kernels use the polynomial vector
+// functions of simd_math.h, which need no table lookups; one cell at a time
+// the table-driven reductions here are faster (and faster than libm for exp10
+// and the powers). Errors against the correctly rounded result, from
+// tools/fast_math_accuracy.cpp (exhaustive over float, sampled over every
+// binade of double):
+//
+//   function          domain                    scalar    vector
+//   Exp               [-708, 709], [-87, 88]    0.6 ulp   1.5 ulp
+//   Exp10             [-307, 308], [-37, 38]    0.6 ulp   2 ulp
+//   Log               positive normal x         0.8 ulp   1.5 ulp
+//   Log10             positive normal x         2 ulp     2.5 ulp
+//   Pow (x^y), Root   x > 0, y = 1 / N          2 + 3 |y ln x| ulp
+//   Pow, IntPow,      integer or half-integer   1 + |2 y| ulp
+//   HalfPow           y up to 8
+//
+// Arguments outside the domain are clamped (Exp, Exp10; NaN is passed
+// through) or undefined (Log of zero, negative or subnormal x). The models
+// stay well inside: ln gamma and log10 K are within +-40 and the molalities
+// above 1e-16. Float arguments go through the double functions.
+namespace FastMath
+{
+
+// GCC evaluates the long double libm calls of the tables at compile time,
+// so no constructor of an instruction set variant (see isa_variant.h) runs
+// when the library is loaded. Other compilers fill them at load.
+#if defined(__GNUC__) && !defined(__clang__)
+#define FAST_MATH_CONSTEXPR constexpr
+#else
+#define FAST_MATH_CONSTEXPR
+#endif
+
+// x = k ln2 / N + r with |r| <= ln2 / 2N, exp(x) = 2^(k / N) e^r. 2^(j / N)
+// is tabulated in two parts, so only e^r - 1 is rounded, relative to 1.
+// log(x) = e ln2 + log(c_j) + log1p((m - c_j) / c_j) with m in
+// [sqrt(1/2), sqrt(2)) and c_j the center of one of N intervals, 1 next to 1.
+struct Tables
+{
+    static const int N = 128; // 2^7
+
+    double expHi[N];
+    double expTail[N];
+    double c[N];
+    double invC[N];
+    double logHi[N];
+    double logLo[N];
+    double log10Hi[N];
+    double log10Lo[N];
+
+    FAST_MATH_CONSTEXPR Tables() : expHi(), expTail(), c(), invC(), logHi(), logLo(), log10Hi(), log10Lo()
+    {
+        for (int j = 0; j < N; j++)
+        {
+            const long double exp2 = exp2l((long double)j / N);
+            expHi[j] = (double)exp2;
+            expTail[j] = (double)((exp2 - expHi[j]) / expHi[j]);
+
+            // Interval j of the leading mantissa bits, halved above sqrt(2)
+            const bool half = 1 + (j + 1.0) / N > M_SQRT2;
+            c[j] = j == 0 || j == N - 1 ? 1 : (1 + (j + 0.5) / N) * (half ? 0.5 : 1);
+            invC[j] = 1 / c[j];
+            // The high parts are multiples of the ulp of the high part of
+            // ln2 (log10(2)), so e ln2_hi + logHi has no rounding error
+            const long double log = logl(c[j]);
+            logHi[j] = (double)(roundl(ldexpl(log, 42)) / 0x1p42L);
+            logLo[j] = (double)(log - logHi[j]);
+            const long double log10 = log10l(c[j]);
+            log10Hi[j] = (double)(roundl(ldexpl(log10, 43)) / 0x1p43L);
+            log10Lo[j] = (double)(log10 - log10Hi[j]);
+        }
+    }
+};
+
+inline FAST_MATH_CONSTEXPR const Tables tables;
+
+inline unsigned long Bits(double x)
+{
+    unsigned long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+inline double FromBits(unsigned long bits)
+{
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// e^r 2^(j / N) / expHi[j] - 1 for |r| <= ln2 / 2N
+inline double ExpPolynomial(int j, double r)
+{
+    const double r2 = r * r;
+    return (tables.expTail[j] + r) + r2 * (0.5 + r * (1.0 / 6)) + (r2 * r2) * (1.0 / 24 + r * (1.0 / 120));
+}
+
+// 2^(k / N) e^r for |r| <= ln2 / 2N, with k the integer in the low bits of
+// t after adding shift. The power of two goes into the exponent bits of the
+// table entry, off the dependency chain through r; for results below
+// 2^-1000 it is applied last, so that scale * p stays normal.
+template <bool TINY = false>
+inline double ScaleExp(double t, double shift, double r)
+{
+    const unsigned long k = Bits(t) - Bits(shift);
+    const int j = k & (Tables::N - 1);
+    const double p = ExpPolynomial(j, r);
+    if constexpr (TINY)
+    {
+        const double s = tables.expHi[j] + tables.expHi[j] * p;
+        return s * FromBits((((k >> 7) + 1023) & 0x7FF) << 52);
+    }
+    const double scale = FromBits(Bits(tables.expHi[j]) + ((k >> 7) << 52));
+    return scale + scale * p;
+}
+
+// exp(x) of x in [-708, 709], without a range check
+template <bool TINY>
+inline double ExpKernel(double x)
+{
+    const double shift = 6755399441055744.0; // 1.5 * 2^52
+    const double t = x * 184.6649652337873 + shift;
+    const double kd = t - shift;
+    const double r = (x - kd * 0.005415212347998022) - kd * 1.2655086083325438e-13;
+    return ScaleExp<TINY>(t, shift, r);
+}
+
+// 10^x of x in [-307, 308], without a range check. The reduction is done
+// in log10 units, so only the small remainder is multiplied by ln10.
+template <bool TINY>
+inline double Exp10Kernel(double x)
+{
+    const double shift = 6755399441055744.0;
+    const double t = x * 425.20679614558236 + shift;
+    const double kd = t - shift;
+    const double r10 = (x - kd * 0.0023517968410260437) - kd * 9.880939360664394e-14;
+    return ScaleExp<TINY>(t, shift, r10 * 2.302585092994046);
+}
+
+// Out of line, rarely taken: NaN (passed through), tiny results and the
+// clamped arguments
+__attribute__((noinline)) inline double ExpSlow(double x)
+{
+    if (x != x)
+        return x;
+    return ExpKernel<true>(x < -708.0 ? -708.0 : x > 709.0 ? 709.0 : x);
+}
+
+__attribute__((noinline)) inline double Exp10Slow(double x)
+{
+    if (x != x)
+        return x;
+    return Exp10Kernel<true>(x < -307.0 ? -307.0 : x > 308.0 ? 308.0 : x);
+}
+
+// exp(x), arguments are clamped to [-708, 709]. The range check is a
+// predicted branch rather than a min/max on the dependency chain.
+inline double Exp(double x)
+{
+    if (__builtin_expect(!(x >= -700.0 && x <= 709.0), 0))
+        return ExpSlow(x);
+    return ExpKernel<false>(x);
+}
+
+// 10^x, arguments are clamped to [-307, 308]
+inline double Exp10(double x)
+{
+    if (__builtin_expect(!(x >= -305.0 && x <= 308.0), 0))
+        return Exp10Slow(x);
+    return Exp10Kernel<false>(x);
+}
+
+// Exponent e, table index j and r = (m - c_j) / c_j of positive, normal x
+inline void ReduceLog(double x, double &e, int &j, double &r)
+{
+    const unsigned long bits = Bits(x);
+    j = (int)(bits >> (52 - 7)) & (Tables::N - 1);
+    const bool half = tables.c[j] < 1 || j == Tables::N - 1;
+    e = (double)((long)(bits >> 52) - 1023 + half);
+    const double m = FromBits((bits & 0x000FFFFFFFFFFFFFUL) | (half ? 0x3FE0000000000000UL : 0x3FF0000000000000UL));
+    r = (m - tables.c[j]) * tables.invC[j];
+}
+
+// log1p(r) - r for |r| <= 1 / N, in Estrin's scheme for a short dependency
+// chain
+inline double Log1pTail(double r)
+{
+    const double r2 = r * r;
+    const double r4 = r2 * r2;
+    const double p = (-1.0 / 2 + r * (1.0 / 3)) + r2 * (-1.0 / 4 + r * (1.0 / 5)) + r4 * ((-1.0 / 6 + r * (1.0 / 7)) + r2 * (-1.0 / 8));
+    return r2 * p;
+}
+
+// Natural logarithm of positive, normal x
+inline double Log(double x)
+{
+    double e, r;
+    int j;
+    ReduceLog(x, e, j, r);
+    const double w = e * 0.6931471805598903 + tables.logHi[j];
+    // w + r in two parts, |w| >= |r| unless w is 0
+    const double hi = w + r;
+    const double lo = (w - hi) + r;
+    return hi + (lo + (e * 5.497923018708371e-14 + tables.logLo[j] + Log1pTail(r)));
+}
+
+// log10(x) of positive, normal x
+inline double Log10(double x)
+{
+    double e, r;
+    int j;
+    ReduceLog(x, e, j, r);
+    const double w = e * 0.30102999566395283 + tables.log10Hi[j];
+    return w + ((r + Log1pTail(r)) * 0.4342944819032518 + (e * 2.8363394551044964e-14 + tables.log10Lo[j]));
+}
+
+inline float Exp(float x)
+{
+    return (float)Exp((double)(x < -87.0f ? -87.0f : x > 88.0f ? 88.0f : x));
+}
+
+inline float Exp10(float x)
+{
+    return (float)Exp10((double)(x < -37.0f ? -37.0f : x > 38.0f ? 38.0f : x));
+}
+
+inline float Log(float x)
+{
+    return (float)Log((double)x);
+}
+
+inline float Log10(float x)
+{
+    return (float)Log10((double)x);
+}
+
+// x^N by multiplication, 1 / x^-N for negative N
+template <int N, typename T>
+inline T IntPow(T x)
+{
+    if constexpr (N < 0)
+        return 1 / IntPow<-N>(x);
+    else if constexpr (N == 0)
+        return 1;
+    else if constexpr (N == 1)
+        return x;
+    else if constexpr (N % 2 == 0)
+        return IntPow<N / 2>(x * x);
+    else
+        return x * IntPow<N - 1>(x);
+}
+
+// x^(N / 2)
+template <int N, typename T>
+inline T HalfPow(T x)
+{
+    if constexpr (N < 0)
+        return 1 / HalfPow<-N>(x);
+    else if constexpr (N % 2 == 0)
+        return IntPow<N / 2>(x);
+    else
+        return IntPow<N / 2>(x) * sqrt(x);
+}
+
+// x^(1 / N), as PitzerBatch::Root
+template <int N, typename T>
+inline T Root(T x)
+{
+    if constexpr (N == 1)
+        return x;
+    else if constexpr (N == 2)
+        return sqrt(x);
+    else
+        return Exp(Log(x) * (T)(1.0 / N));
+}
+
+// x^y of x > 0. Integer and half-integer exponents up to 8, which the models
+// use for stoichiometries, charges and Pitzer factors, go by multiplication
+// and sqrt; the rest by exp(y ln x).
+template <typename T>
+inline T Pow(T x, T y)
+{
+    const T twice = 2 * y;
+    if (fabs(twice) <= 16 && twice == (int)twice)
+    {
+        const int n = (int)fabs(twice);
+        T power = n % 2 == 1 ? sqrt(x) : 1;
+        T square = x;
+        for (int k = n / 2; k > 0; k >>= 1)
+        {
+            if (k & 1)
+                power *= square;
+            square *= square;
+        }
+        return y < 0 ? 1 / power : power;
+    }
+    return Exp(Log(x) * y);
+}
+
+}; // namespace FastMath
+
+// Elementary functions of the scalar model paths: FastMath, or libm (with the
+// argument types of the calls it replaces) in builds with -DSCALE_FAST_MATH=0.
+// The same switch selects the vector functions of simd_math.h.
+namespace Math
+{
+
+#if SCALE_FAST_MATH
+inline Real Exp(Real x)
+{
+    return FastMath::Exp(x);
+}
+
+inline Real Exp10(Real x)
+{
+    return FastMath::Exp10(x);
+}
+
+inline Real Log(Real x)
+{
+    return FastMath::Log(x);
+}
+
+inline Real Log10(Real x)
+{
+    return FastMath::Log10(x);
+}
+
+template <typename X, typename Y>
+inline Real Pow(X x, Y y)
+{
+    return FastMath::Pow<Real>(x, y);
+}
+
+template <int N, typename T>
+inline T IntPow(T x)
+{
+    return FastMath::IntPow<N>(x);
+}
+
+template <int N, typename T>
+inline T HalfPow(T x)
+{
+    return FastMath::HalfPow<N>(x);
+}
+
+template <int N, typename T>
+inline T Root(T x)
+{
+    return FastMath::Root<N>(x);
+}
+#else
+inline Real Exp(Real x)
+{
+    return exp(x);
+}
+
+inline Real Exp10(Real x)
+{
+    return pow(10.0, x);
+}
+
+inline Real Log(Real x)
+{
+    return log(x);
+}
+
+inline Real Log10(Real x)
+{
+    return log10(x);
+}
+
+template <typename X, typename Y>
+inline auto Pow(X x, Y y)
+{
+    return pow(x, y);
+}
+
+template <int N, typename T>
+inline auto IntPow(T x)
+{
+    return pow(x, N);
+}
+
+template <int N, typename T>
+inline auto HalfPow(T x)
+{
+    return pow(x, N / 2.0);
+}
+
+template <int N, typename T>
+inline auto Root(T x)
+{
+    if constexpr (N == 2)
+        return sqrt(x);
+    else
+        return pow(x, 1.0 / N);
+}
+#endif
+
+}; // namespace Math
+
+#endif // FAST_MATH_H
@@ -28,8 +28,10 @@ SOFTWARE.
 #include "chemistry.h"
 #include "uclib.h"
 #include "math.h"
+#include "fast_math.h"
 #include <cstdlib>
 #include "equilibrium_formulation.h"
+#include "equilibrium_batch.h"
 
 class HoffEquilibrium : public EquilibriumFormulation
 {
@@ -48,7 +50,37 @@ public:
     // Equilibrium concentration at T
     const Real Equilibrium(Real T)
     {
-        return pow(10.0, log_k + delta_h / ChemistryFunctions::R() * (1 / T0 - 1 / T));
+        return Math::Exp10(log_k + delta_h / ChemistryFunctions::R() * (1 / T0 - 1 / T));
+    }
+
+    // Equilibrium concentrations of n cells
+    void Equilibrium(const Real *T, Real *K, int n)
+    {
+        EquilibriumBatch::Equilibrium(BatchCoefficients(), T, K, n);
+    }
+
+    // dK/dT at T
+    const Real EquilibriumDerivative(Real T)
+    {
+        return Equilibrium(T) * M_LN10 * delta_h / ChemistryFunctions::R() / (T * T);
+    }
+
+    // dK/dT of n cells
+    void EquilibriumDerivative(const Real *T, Real *dK, int n)
+    {
+        EquilibriumBatch::EquilibriumDerivative(BatchCoefficients(), T, dK, n);
+    }
+
+    // ln K = ln(10) (log_k + delta_h / (R T0)) - ln(10) delta_h / R / T
+    const EquilibriumBatch::Coefficients BatchCoefficients()
+    {
+        const double delta_h_R = delta_h / ChemistryFunctions::R();
+        EquilibriumBatch::Coefficients c;
+        c.a_0 = M_LN10 * (log_k + delta_h_R / T0);
+        c.a_1 = 0;
+        c.a_2 = -M_LN10 * delta_h_R;
+        c.a_3 = 0;
+        return c;
     }
 };
 
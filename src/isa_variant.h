@@ -0,0 +1,216 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef ISA_VARIANT_H
+#define ISA_VARIANT_H
+
+// Instruction set variants of the library in one libuser.so. The generic
+// build is compiled for the target of the command line (SSE2 by default);
+// isa_avx2.cpp and isa_avx512.cpp compile barite_reaction_library.cpp once
+// more each, under #pragma GCC target and with SIMD_LEVEL set, into the
+// namespaces Avx2 and Avx512. uclib() picks one variant from CPUID and
+// SCALE_ISA and hands over to its Uclib(), which registers that variant's
+// field functions; the others stay unused.
+//
+// Everything of the standard library the variants use is included here,
+// before the target pragma, so its inline functions are compiled for the
+// generic target in every translation unit and the linker may keep any
+// copy of them. Only the library's own code, inside the namespaces, gets
+// the wider instructions.
+#include "uclib.h"
+#include "runtime_config.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <x86intrin.h>
+#endif
+
+// Variants are built by GCC for x86-64; -DSCALE_ISA_VARIANTS=0 leaves them out
+#ifndef SCALE_ISA_VARIANTS
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define SCALE_ISA_VARIANTS 1
+#else
+#define SCALE_ISA_VARIANTS 0
+#endif
+#endif
+
+namespace IsaVariant
+{
+
+enum Isa
+{
+    GENERIC,
+    AVX2,
+    AVX512,
+    COUNT
+};
+
+inline const char *Name(int isa)
+{
+    static const char *const names[COUNT] = {"generic", "avx2", "avx512"};
+    return names[isa];
+}
+
+// Level of the generic build, as simd.h picks it from the compiler target
+inline int GenericLevel()
+{
+#if defined(__AVX512F__)
+    return AVX512;
+#elif defined(__AVX2__) && defined(__FMA__)
+    return AVX2;
+#else
+    return GENERIC;
+#endif
+}
+
+// Whether this CPU (and OS, for the wider registers) runs the variant
+inline bool Supported(int isa)
+{
+#if SCALE_ISA_VARIANTS
+    __builtin_cpu_init();
+    const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (isa == AVX2)
+        return avx2;
+    if (isa == AVX512)
+        return avx2 && __builtin_cpu_supports("avx512f");
+#endif
+    return isa == GENERIC;
+}
+
+// The widest supported variant, or the one SCALE_ISA names if the CPU
+// supports it. Variants narrower than the generic build are not used.
+inline int Select()
+{
+    int best = GENERIC;
+    for (int isa = GenericLevel() + 1; isa < COUNT; isa++)
+    {
+        if (Supported(isa))
+            best = isa;
+    }
+
+    const char *forced = RuntimeConfig::String("SCALE_ISA", "auto");
+    if (strcmp(forced, "auto") == 0)
+        return best;
+    for (int isa = 0; isa < COUNT; isa++)
+    {
+        if (strcmp(forced, Name(isa)) != 0)
+            continue;
+        if (isa != GENERIC && (isa <= GenericLevel() || !Supported(isa)))
+        {
+            printf("SCALE_ISA=%s is not available on this CPU or below the generic build, using %s\n", forced, Name(best));
+            return best;
+        }
+        return isa;
+    }
+    printf("Unknown SCALE_ISA=%s (auto, generic, avx2 or avx512), using %s\n", forced, Name(best));
+    return best;
+}
+
+// An object of the library constructed by Construct() in Uclib() instead of
+// when libuser.so is loaded. Every variant is loaded, but the constructors
+// of a variant are compiled for its instruction set, so they may only run
+// once uclib() has picked that variant. This template is compiled for the
+// generic target, so holding and destroying an unconstructed object runs
+// none of the variant's code.
+template <typename T>
+class Deferred
+{
+public:
+    constexpr Deferred() : storage(), constructed(false)
+    {
+    }
+
+    ~Deferred()
+    {
+        if (constructed)
+            Get().~T();
+    }
+
+    template <typename... Args>
+    void Construct(Args &&...args)
+    {
+        new (storage) T(std::forward<Args>(args)...);
+        constructed = true;
+    }
+
+    T &operator*()
+    {
+        return Get();
+    }
+
+    T *operator->()
+    {
+        return &Get();
+    }
+
+private:
+    alignas(T) unsigned char storage[sizeof(T)];
+    bool constructed;
+
+    T &Get()
+    {
+        return *std::launder(reinterpret_cast<T *>(storage));
+    }
+};
+
+}; // namespace IsaVariant
+
+#if SCALE_ISA_VARIANTS
+namespace Avx2
+{
+void Uclib();
+};
+
+namespace Avx512
+{
+void Uclib();
+};
+#endif
+
+#endif // ISA_VARIANT_H
@@ -0,0 +1,391 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef ISAT_TABLE_H
+#define ISAT_TABLE_H
+
+#include "uclib.h"
+#include "math.h"
+#include <string.h>
+#include <vector>
+
+// In-situ adaptive tabulation (Pope 1997) of a scalar function f of D inputs.
+//
+// Each entry stores a point x0, f(x0), the gradient of f at x0 and an
+// ellipsoid of accuracy (EOA) {x : (x - x0)^T M (x - x0) <= 1} in which the
+// linear approximation is trusted. Instead of Pope's binary tree of cutting
+// planes, which inputs arriving in order degenerate into long chains, the
+// entries are hashed by the cell of relative width 2 radius that holds x0.
+// A query first tries the entry that served the previous query (neighbouring
+// cells are usually close), then the entries of its own cell, and
+//   - retrieves the linear approximation when x is inside one of their EOAs,
+//   - otherwise evaluates f(x) and grows the EOA of the nearest of them to x
+//     when its linear approximation was within the tolerance after all,
+//   - or else adds x as a new entry (while below the memory cap).
+// An EOA reaching into a neighbouring cell is not found from there, which
+// only costs an entry more.
+// A new EOA is sized per input from a second difference of f, so that the
+// quadratic term of each input stays within tolerance / D, and never beyond
+// radius. Every checkInterval-th retrieve is also evaluated directly, and a
+// retrieve in error shrinks its EOA along x - x0 to where the error would be
+// the tolerance.
+// Inputs are scaled by scale[] before anything else, so tolerances and radii
+// are in units of the typical size of each input.
+template <int D>
+class IsatTable
+{
+public:
+    static const int PACKED = D * (D + 1) / 2;
+
+    struct Entry
+    {
+        double x0[D];
+        double f0;
+        double gradient[D];
+        double M[PACKED]; // upper triangle of the EOA matrix, row by row
+        int next;         // entry of the same hash bucket, -1 at the end
+    };
+
+    struct Statistics
+    {
+        long queries;
+        long retrieves;
+        long grows;
+        long adds;
+        long directs; // misses that could not be added because of the cap
+        long checks;  // retrieves evaluated directly
+        long shrinks; // checks in error
+    };
+
+    double tolerance;    // max absolute error of f
+    double radius;       // largest initial EOA radius in scaled inputs
+    int cellBits;        // mantissa bits of the hash cells
+    double scale[D];     // typical size of each input
+    size_t maxEntries;
+    long checkInterval;  // retrieves per direct check, 0 for none
+    Statistics statistics;
+
+    IsatTable() : tolerance(1e-4), radius(1e-3), cellBits(9), maxEntries(0), checkInterval(0), last(-1), unchecked(0)
+    {
+        for (int i = 0; i < D; i++)
+        {
+            scale[i] = 1;
+            inverseScale[i] = 1;
+        }
+        statistics = Statistics();
+    }
+
+    void Configure(double tolerance, double radius, const double *scale, size_t maxBytes, long checkInterval)
+    {
+        this->tolerance = tolerance;
+        this->radius = radius;
+        this->checkInterval = checkInterval;
+        cellBits = 0;
+        while (cellBits < 52 && ldexp(1.0, -cellBits) > 2 * radius)
+        {
+            cellBits++;
+        }
+        for (int i = 0; i < D; i++)
+        {
+            this->scale[i] = scale[i];
+            inverseScale[i] = 1 / scale[i];
+        }
+        // Two buckets per entry at most
+        maxEntries = maxBytes / (sizeof(Entry) + 2 * sizeof(int));
+    }
+
+    const size_t Entries() const
+    {
+        return entries.size();
+    }
+
+    const size_t Bytes() const
+    {
+        return entries.capacity() * sizeof(Entry) + buckets.capacity() * sizeof(int);
+    }
+
+    // f at the unscaled point x, tabulated within the tolerance
+    template <typename F>
+    double Query(const double *x, F f)
+    {
+        statistics.queries++;
+
+        double xs[D];
+        for (int i = 0; i < D; i++)
+        {
+            xs[i] = x[i] * inverseScale[i];
+        }
+
+        double dx[D];
+        if (last >= 0)
+        {
+            const double rho2 = Distance(entries[last], xs, dx);
+            if (rho2 <= 1)
+            {
+                return Retrieve(entries[last], x, dx, rho2, f);
+            }
+        }
+
+        int nearest = -1;
+        double nearestRho2 = INFINITY;
+        double nearestDx[D];
+        const size_t bucket = buckets.empty() ? 0 : Bucket(xs);
+        for (int e = buckets.empty() ? -1 : buckets[bucket]; e >= 0; e = entries[e].next)
+        {
+            const double rho2 = Distance(entries[e], xs, dx);
+            if (rho2 <= 1)
+            {
+                last = e;
+                return Retrieve(entries[e], x, dx, rho2, f);
+            }
+            if (rho2 < nearestRho2)
+            {
+                nearest = e;
+                nearestRho2 = rho2;
+                for (int i = 0; i < D; i++)
+                {
+                    nearestDx[i] = dx[i];
+                }
+            }
+        }
+
+        const double exact = f(x);
+        if (nearest >= 0)
+        {
+            Entry &entry = entries[nearest];
+            if (fabs(exact - (entry.f0 + Dot(entry.gradient, nearestDx))) <= tolerance)
+            {
+                Reshape(entry, nearestDx, nearestRho2, 1);
+                statistics.grows++;
+                return exact;
+            }
+        }
+        if (entries.size() >= maxEntries)
+        {
+            statistics.directs++;
+            return exact;
+        }
+        return Add(x, xs, exact, f);
+    }
+
+private:
+    std::vector<Entry> entries;
+    std::vector<int> buckets; // first entry of each, a power of two of them
+    double inverseScale[D];
+    int last;       // entry of the last retrieve
+    long unchecked; // retrieves since the last direct check
+
+    // dx = xs - x0 of an entry, and dx^T M dx
+    static double Distance(const Entry &entry, const double *xs, double *dx)
+    {
+        for (int i = 0; i < D; i++)
+        {
+            dx[i] = xs[i] - entry.x0[i];
+        }
+        return Norm2(entry.M, dx);
+    }
+
+    // Bucket of the cell that holds the scaled point xs. A cell spans about a
+    // relative width of 2 radius in every input: its index is the
+    // sign, exponent and leading cellBits mantissa bits of the input, so that
+    // the dilute inputs, decades below their typical size, do not all share
+    // the cell at zero. The indices are hashed by independent multiplies, as
+    // the hash is on the path of every query.
+    size_t Bucket(const double *xs) const
+    {
+        static const unsigned long long PRIMES[] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+                                                    0xD6E8FEB86659FD93ull, 0xFF51AFD7ED558CCDull, 0xC4CEB9FE1A85EC53ull};
+        unsigned long long h = 0;
+        for (int i = 0; i < D; i++)
+        {
+            unsigned long long bits;
+            memcpy(&bits, &xs[i], sizeof(bits));
+            h += (bits >> (52 - cellBits)) * PRIMES[i % 6];
+        }
+        return (h ^ (h >> 29) ^ (h >> 47)) & (buckets.size() - 1);
+    }
+
+    // Linear approximation of an entry at x0 + dx, dx^T M dx = rho2 <= 1
+    template <typename F>
+    double Retrieve(Entry &entry, const double *x, const double *dx, double rho2, F f)
+    {
+        statistics.retrieves++;
+        const double linear = entry.f0 + Dot(entry.gradient, dx);
+        if (checkInterval <= 0 || ++unchecked < checkInterval)
+        {
+            return linear;
+        }
+        unchecked = 0;
+        statistics.checks++;
+        const double exact = f(x);
+        const double error = fabs(exact - linear);
+        if (error <= tolerance)
+        {
+            return linear;
+        }
+        // The error grows with the square of the distance, so it is the
+        // tolerance at rho2 = 1 once x0 + dx is at error / tolerance
+        Reshape(entry, dx, rho2, error / tolerance);
+        statistics.shrinks++;
+        return exact;
+    }
+
+    static double Dot(const double *a, const double *b)
+    {
+        double s = 0;
+        for (int i = 0; i < D; i++)
+        {
+            s += a[i] * b[i];
+        }
+        return s;
+    }
+
+    // dx^T M dx, by rows that do not wait on each other
+    static double Norm2(const double *M, const double *dx)
+    {
+        double row[D];
+        int k = 0;
+        for (int i = 0; i < D; i++)
+        {
+            const int diagonal = k++;
+            double offDiagonal = 0;
+            for (int j = i + 1; j < D; j++)
+            {
+                offDiagonal += M[k++] * dx[j];
+            }
+            row[i] = (M[diagonal] * dx[i] + 2 * offDiagonal) * dx[i];
+        }
+        double s = 0;
+        for (int i = 0; i < D; i++)
+        {
+            s += row[i];
+        }
+        return s;
+    }
+
+    // Rank-one update of the EOA that moves x0 + dx, at rho2 = dx^T M dx, to
+    // target while keeping the directions M-orthogonal to dx:
+    // M += (target / rho2 - 1) / rho2 (M dx) (M dx)^T. With target 1 and
+    // rho2 > 1 this is the smallest centred ellipsoid containing the EOA and
+    // x0 + dx; with target > rho2 it shrinks the EOA along dx.
+    static void Reshape(Entry &entry, const double *dx, double rho2, double target)
+    {
+        double Mdx[D] = {0};
+        int k = 0;
+        for (int i = 0; i < D; i++)
+        {
+            Mdx[i] += entry.M[k++] * dx[i];
+            for (int j = i + 1; j < D; j++)
+            {
+                Mdx[i] += entry.M[k] * dx[j];
+                Mdx[j] += entry.M[k] * dx[i];
+                k++;
+            }
+        }
+        const double c = (target / rho2 - 1) / rho2;
+        k = 0;
+        for (int i = 0; i < D; i++)
+        {
+            for (int j = i; j < D; j++)
+            {
+                entry.M[k++] += c * Mdx[i] * Mdx[j];
+            }
+        }
+    }
+
+    // New entry at x with a forward-difference gradient and a diagonal EOA
+    // from forward second differences over a step of radius (at most half of
+    // a positive input, so that dilute inputs are not stepped past), first in
+    // the bucket of its cell
+    template <typename F>
+    double Add(const double *x, const double *xs, double exact, F f)
+    {
+        Entry entry;
+        entry.f0 = exact;
+        for (int i = 0; i < D; i++)
+        {
+            entry.x0[i] = xs[i];
+        }
+
+        double xh[D];
+        for (int i = 0; i < D; i++)
+        {
+            xh[i] = x[i];
+        }
+        double r[D];
+        for (int i = 0; i < D; i++)
+        {
+            const double h = 1e-6 * fmax(fabs(x[i]), scale[i]);
+            xh[i] = x[i] + h;
+            entry.gradient[i] = (f(xh) - exact) / (h / scale[i]);
+
+            // Quadratic error of the linear approximation at distance r:
+            // |f''| r^2 / 2 <= tolerance / D
+            const double step = x[i] > 0 ? fmin(radius * scale[i], 0.5 * x[i]) : radius * scale[i];
+            xh[i] = x[i] + step;
+            const double f1 = f(xh);
+            xh[i] = x[i] + 2 * step;
+            const double f2 = f(xh);
+            const double curvature = fabs(f2 - 2 * f1 + exact) / ((step / scale[i]) * (step / scale[i]));
+            r[i] = fmin(radius, sqrt(2 * tolerance / (D * curvature)));
+            if (x[i] > 0)
+            {
+                r[i] = fmin(r[i], 0.5 * xs[i]);
+            }
+            xh[i] = x[i];
+        }
+
+        int k = 0;
+        for (int i = 0; i < D; i++)
+        {
+            for (int j = i; j < D; j++)
+            {
+                entry.M[k++] = i == j ? 1 / (r[i] * r[i]) : 0;
+            }
+        }
+
+        // Rehashed at half a bucket per entry
+        if (2 * (entries.size() + 1) > buckets.size())
+        {
+            buckets.assign(buckets.empty() ? 1024 : 2 * buckets.size(), -1);
+            for (size_t e = 0; e < entries.size(); e++)
+            {
+                Link((int)e);
+            }
+        }
+        entries.push_back(entry);
+        Link((int)entries.size() - 1);
+        statistics.adds++;
+        return exact;
+    }
+
+    void Link(int e)
+    {
+        const size_t bucket = Bucket(entries[e].x0);
+        entries[e].next = buckets[bucket];
+        buckets[bucket] = e;
+    }
+};
+
+#endif // ISAT_TABLE_H
@@ -0,0 +1,300 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef KINETICS_BATCH_H
+#define KINETICS_BATCH_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include "simd.h"
+#include "simd_math.h"
+#include "saturation_batch.h"
+
+// Precipitation of a mineral over the time step of the flow solver. Per cell
+// the precipitated molality x obeys dx/dt = R(x), with growth
+// G = k_g (S^(1/nu) - 1)^g and nucleation J = k_n exp(-B / ln(S)^2) where the
+// supersaturation ratio S(x) > 1. Cells with |dR/dx| dt below a stiffness
+// limit take one exponential Euler step. Stiff cells are compacted into
+// vectors of cells with the same number of implicit (SDIRK) sub-steps, so a
+// few stiff cells do not hold up the lanes of the others.
+namespace KineticsBatch
+{
+
+struct Coefficients
+{
+    SaturationBatch::Coefficients saturation;
+    Real nu_A;
+    Real nu_B;
+    Real k_growth;     // mol/kg/s at T0
+    Real E_a_R;        // activation energy of growth / R in K
+    Real T0;
+    Real order;        // g
+    Real k_nucleation; // mol/kg/s
+    Real B_nucleation;
+    Real stiffness;    // |dR/dx| dt above which a cell is sub-cycled
+    int maxSubsteps;   // a power of 2
+};
+
+struct Statistics
+{
+    std::atomic<long> cells;
+    std::atomic<long> stiff;
+    std::atomic<long> substeps;
+    std::atomic<long> newtonIterations;
+};
+
+// ln S(x) = lnC + nu_A ln(m_A - nu_A x) + nu_B ln(m_B - nu_B x) and the growth
+// rate constant of a cell
+template <typename V>
+struct Cell
+{
+    V mA;
+    V mB;
+    V lnC; // nu ln(gamma) - ln K
+    V k_g;
+};
+
+// R(x) = G + J with its derivative
+template <typename V>
+inline V Rate(const Coefficients &c, const Cell<V> &cell, V x, V &G, V &J, V &dR)
+{
+    const V SMALL = Simd::Broadcast<V>(c.saturation.activity.SMALL);
+    const V a = Simd::Max(cell.mA - c.nu_A * x, SMALL);
+    const V b = Simd::Max(cell.mB - c.nu_B * x, SMALL);
+    const V lnS = cell.lnC + c.nu_A * Simd::Log(a) + c.nu_B * Simd::Log(b);
+    const V dlnS = -(c.nu_A * c.nu_A / a + c.nu_B * c.nu_B / b);
+    const auto supersaturated = lnS > 0;
+    const V lnS_ = supersaturated ? lnS : Simd::Broadcast<V>(1);
+
+    // S^(1 / nu) - 1 > 0
+    const V root = Simd::Exp(lnS_ * c.saturation.activity.inv_nu);
+    const V sigma = Simd::Max(root - 1, SMALL);
+    const V growth = c.order == 2 ? cell.k_g * (sigma * sigma) : cell.k_g * Simd::Exp(c.order * Simd::Log(sigma));
+    const V dGrowth = c.order * growth / sigma * root * c.saturation.activity.inv_nu * dlnS;
+
+    const V nucleation = c.k_nucleation == 0 ? V{} : c.k_nucleation * Simd::Exp(-c.B_nucleation / (lnS_ * lnS_));
+    const V dNucleation = nucleation * (2 * c.B_nucleation) / (lnS_ * lnS_ * lnS_) * dlnS;
+
+    G = supersaturated ? growth : V{};
+    J = supersaturated ? nucleation : V{};
+    dR = supersaturated ? dGrowth + dNucleation : V{};
+    return G + J;
+}
+
+// Cell of one vector of inputs T, yA, yB, yEtc1, yEtc2
+template <typename Salt = PitzerBatch::RuntimeSalt, typename V>
+inline Cell<V> State(const Coefficients &c, V T, V yA, V yB, V yEtc1, V yEtc2)
+{
+    const PitzerBatch::Coefficients &p = c.saturation.activity;
+    const PitzerBatch::IonicState<V> s = PitzerBatch::State<Salt>(p, yA, yB, yEtc1, yEtc2);
+    const V ln_gamma = PitzerBatch::LogActivityCoefficient<Salt>(p, T, s);
+    const V lnK = EquilibriumBatch::LogEquilibrium(c.saturation.equilibrium, T);
+
+    Cell<V> cell;
+    cell.mA = Simd::Max(yA * s.mTot, Simd::Broadcast<V>(p.SMALL));
+    cell.mB = Simd::Max(yB * s.mTot, Simd::Broadcast<V>(p.SMALL));
+    cell.lnC = c.saturation.nu * ln_gamma - lnK;
+    cell.k_g = c.k_growth * Simd::Exp(-c.E_a_R * (1 / T - 1 / c.T0));
+    return cell;
+}
+
+// y = base + h R(y) by Newton's method on F(y) = y - base - h R(y),
+// F' = 1 - h dR/dx >= 1, in lockstep over the lanes, with y between base and
+// the molality x_max of the limiting ion
+template <typename V>
+inline V SolveStage(const Coefficients &c, const Cell<V> &cell, V base, V h, V x_max, V &R, long &iterations)
+{
+    const Real rtol = sizeof(Real) == sizeof(double) ? 1e-9 : 1e-5;
+    V y = base;
+    for (int k = 0; k < 8; k++)
+    {
+        V G, J, dR;
+        R = Rate(c, cell, y, G, J, dR);
+        const V F = y - base - h * R;
+        y = Simd::Min(Simd::Max(y - F / (1 - h * dR), base), x_max);
+        iterations++;
+        if (Simd::All(F * F <= (rtol * rtol) * (x_max * x_max)))
+            break;
+    }
+    return y;
+}
+
+// x after n steps of dt / n of the two-stage, second order, L-stable SDIRK
+// method of Alexander (1977), gamma = 1 - 1 / sqrt(2):
+// y_1 = x + gamma h R(y_1), x' = x + (1 - gamma) h R(y_1) + gamma h R(x')
+template <typename V>
+inline V Integrate(const Coefficients &c, const Cell<V> &cell, V dt, int n, long &iterations)
+{
+    const Real gamma = 1 - M_SQRT1_2;
+    const V h = dt / (Real)n;
+    const V x_max = Simd::Min(cell.mA / c.nu_A, cell.mB / c.nu_B);
+    V x = V{};
+    for (int step = 0; step < n; step++)
+    {
+        V R_1, R_2;
+        // The first stage only contributes its rate R_1
+        SolveStage(c, cell, x, gamma * h, x_max, R_1, iterations);
+        x = SolveStage(c, cell, Simd::Min(x + (1 - gamma) * h * R_1, x_max), gamma * h, x_max, R_2, iterations);
+    }
+    return x;
+}
+
+// log2 of the sub-steps of a stiff cell, the power of 2 at or above
+// |dR/dx| dt / stiffness up to maxSubsteps
+inline int Bucket(const Coefficients &c, Real stiffness)
+{
+    int bucket = 0;
+    while ((1 << bucket) < c.maxSubsteps && (1 << bucket) < stiffness)
+        bucket++;
+    return bucket;
+}
+
+// Precipitation rate x(dt) / dt, growth and nucleation rates at the start of
+// the step for the cells [begin, end) of the inputs T, yA, yB, yEtc1, yEtc2
+// and dt
+template <typename Salt = PitzerBatch::RuntimeSalt>
+inline void PrecipitationRate(const Coefficients &c, const Real *const *inputs, Real *const *outputs, int begin, int end, Statistics &statistics)
+{
+    typedef Simd::Pack<Real>::V V;
+    typedef Simd::Pack<Real>::I I;
+    const int W = Simd::Pack<Real>::WIDTH;
+    const int BUCKETS = 32;
+
+    // Stiff cells of this range, compacted
+    thread_local std::vector<int> index;
+    thread_local std::vector<int> bucket;
+    thread_local std::vector<Real> mA, mB, lnC, k_g, dt;
+    index.clear();
+    bucket.clear();
+    mA.clear();
+    mB.clear();
+    lnC.clear();
+    k_g.clear();
+    dt.clear();
+    int count[BUCKETS] = {};
+
+    Real lanes[6][W];
+    for (int i = begin; i < end; i += W)
+    {
+        // The remainder is padded with copies of the last cell as in Simd::Map
+        V in[6];
+        for (int k = 0; k < 6; k++)
+        {
+            for (int l = 0; l < W; l++)
+                lanes[k][l] = inputs[k][i + l < end ? i + l : end - 1];
+            in[k] = Simd::Load(lanes[k]);
+        }
+        const Cell<V> cell = State<Salt>(c, in[0], in[1], in[2], in[3], in[4]);
+        V G, J, dR;
+        // One exponential Euler step, exact for R linear in x: x(dt) / dt =
+        // R(0) (1 - exp(-kappa)) / kappa with kappa = -dR/dx dt
+        const V R = Rate(c, cell, V{}, G, J, dR);
+        const V kappa = -dR * in[5];
+        const V phi = kappa > (Real)1e-4 ? (1 - Simd::Exp(-kappa)) / kappa : 1 - 0.5 * kappa;
+        const V stiffness = kappa / c.stiffness;
+
+        V out[3] = {R * phi, G, J};
+        for (int j = 0; j < 3; j++)
+        {
+            Simd::Store(lanes[j], out[j]);
+            for (int l = 0; l < W && i + l < end; l++)
+                outputs[j][i + l] = lanes[j][l];
+        }
+        if (Simd::All(stiffness <= 1))
+            continue;
+
+        Real cellLanes[5][W];
+        const V values[5] = {cell.mA, cell.mB, cell.lnC, cell.k_g, stiffness};
+        for (int k = 0; k < 5; k++)
+            Simd::Store(cellLanes[k], values[k]);
+        for (int l = 0; l < W && i + l < end; l++)
+        {
+            if (cellLanes[4][l] <= 1)
+                continue;
+            bucket.push_back(Bucket(c, cellLanes[4][l]));
+            count[bucket.back()]++;
+            index.push_back(i + l);
+            mA.push_back(cellLanes[0][l]);
+            mB.push_back(cellLanes[1][l]);
+            lnC.push_back(cellLanes[2][l]);
+            k_g.push_back(cellLanes[3][l]);
+            dt.push_back(lanes[5][l]);
+        }
+    }
+
+    // Stiff cells ordered by bucket, then integrated W at a time
+    const int stiff = (int)index.size();
+    thread_local std::vector<int> order;
+    order.resize(stiff);
+    int start[BUCKETS + 1] = {};
+    for (int k = 0; k < BUCKETS; k++)
+        start[k + 1] = start[k] + count[k];
+    int next[BUCKETS];
+    for (int k = 0; k < BUCKETS; k++)
+        next[k] = start[k];
+    for (int s = 0; s < stiff; s++)
+        order[next[bucket[s]]++] = s;
+
+    long steps = 0, iterations = 0;
+    for (int k = 0; k < BUCKETS; k++)
+    {
+        for (int s = start[k]; s < start[k + 1]; s += W)
+        {
+            int lanes[W];
+            for (int l = 0; l < W; l++)
+                lanes[l] = order[s + l < start[k + 1] ? s + l : start[k + 1] - 1];
+            I lane;
+            memcpy(&lane, lanes, sizeof(lane));
+            Cell<V> cell;
+            cell.mA = Simd::Gather(mA.data(), lane);
+            cell.mB = Simd::Gather(mB.data(), lane);
+            cell.lnC = Simd::Gather(lnC.data(), lane);
+            cell.k_g = Simd::Gather(k_g.data(), lane);
+            const V step = Simd::Gather(dt.data(), lane);
+            long vectorIterations = 0;
+            const V rate = Integrate(c, cell, step, 1 << k, vectorIterations) / step;
+
+            Real result[W];
+            Simd::Store(result, rate);
+            const int cells = W < start[k + 1] - s ? W : start[k + 1] - s;
+            for (int l = 0; l < cells; l++)
+                outputs[0][index[lane[l]]] = result[l];
+            steps += (long)cells << k;
+            iterations += vectorIterations * cells;
+        }
+    }
+
+    statistics.cells += end - begin;
+    statistics.stiff += stiff;
+    statistics.substeps += steps;
+    statistics.newtonIterations += iterations;
+}
+
+}; // namespace KineticsBatch
+
+#endif // KINETICS_BATCH_H
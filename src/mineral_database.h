@@ -0,0 +1,444 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef MINERAL_DATABASE_H
+#define MINERAL_DATABASE_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include <cstdlib>
+#include <cctype>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "hoff_equilibrium.h"
+#include "pitzer_activity_model.h"
+#include "saturation_batch.h"
+
+// Minerals of a PHREEQC-like parameter file, compiled once into per-mineral
+// coefficient arrays for the batch kernels.
+//
+//  PHASES
+//  Barite
+//      BaSO4 = Ba+2 + SO4-2
+//      log_k     -9.97
+//      delta_h    6.35 kcal
+//      -analytic  136.035 0 -7680.41 -48.595
+//  PITZER
+//  -B0
+//      Ba+2   SO4-2   0.0
+//
+// Each phase dissolves into one cation and one anion (H2O is ignored). K is
+// from -analytic (log10 K = A1 + A2 T + A3 / T + A4 log10(T)) if given,
+// else from log_k and delta_h (kJ/mol unless kcal, cal or J follows) as in
+// HoffEquilibrium. PITZER takes -B0, -B1, -B2, -C0 and -ALPHAS of each
+// cation/anion pair, -THETA of like-charged pairs and -PSI of triplets
+// (constant values, temperature terms are ignored); other keywords and
+// options are skipped.
+class MineralDatabase
+{
+public:
+    static const int MAX_MINERALS = 32;
+
+    // Per mineral, in file order
+    std::vector<std::string> name;
+    std::vector<std::string> cation; // STAR-CCM+ species, e.g. Ba_2+
+    std::vector<std::string> anion;
+    std::vector<Real> nu_A;
+    std::vector<Real> nu_B;
+    std::vector<Real> Z_A;
+    std::vector<Real> Z_B;
+    std::vector<Real> beta_0;
+    std::vector<Real> beta_1;
+    std::vector<Real> beta_2;
+    std::vector<Real> C_Phi;
+    std::vector<Real> alpha_1;
+    std::vector<Real> alpha_2;
+    std::vector<int> cationIon; // index into ion
+    std::vector<int> anionIon;
+    std::vector<EquilibriumBatch::Coefficients> equilibrium;
+
+    // Charged species of the phases and the PITZER block, in order of first
+    // use
+    std::vector<std::string> ion;       // STAR-CCM+ name, e.g. Ba_2+
+    std::vector<std::string> phreeqcIon; // as in the file, e.g. Ba+2
+    std::vector<int> charge;
+
+    // PITZER parameters, value2 is the second alpha of ALPHAS
+    struct PitzerParameter
+    {
+        std::string parameter;
+        int ion[3];
+        Real value;
+        Real value2;
+    };
+    std::vector<PitzerParameter> pitzerParameters;
+
+    // Compiled by Compile()
+    std::vector<SaturationBatch::Coefficients> saturation;
+    std::vector<SaturationBatch::Kernel> saturationIndex;
+
+    // "file:line: message" of the first error of Load()
+    std::string error;
+
+    const int Size() const
+    {
+        return (int)name.size();
+    }
+
+    // Parses the file, false with error set if it is invalid
+    bool Load(const char *path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return Fail(path, 0, "cannot open file");
+
+        enum Block
+        {
+            NONE,
+            PHASES,
+            PITZER
+        } block = NONE;
+        std::string parameter;
+        std::vector<bool> analytic;
+        std::vector<Real> log_k, delta_h, A1, A2, A3, A4;
+
+        std::string line;
+        for (int number = 1; std::getline(file, line); number++)
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream tokens(line);
+            std::string keyword;
+            if (!(tokens >> keyword))
+                continue;
+
+            // Keywords start in the first column, phase names too
+            const bool firstColumn = line[0] != ' ' && line[0] != '\t';
+            if (firstColumn && keyword.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ_") == std::string::npos)
+            {
+                block = keyword == "PHASES" ? PHASES : keyword == "PITZER" ? PITZER : NONE;
+                parameter.clear();
+                continue;
+            }
+
+            if (block == PHASES)
+            {
+                const std::string option = Lower(keyword[0] == '-' ? keyword.substr(1) : keyword);
+                if (line.find('=') != std::string::npos)
+                {
+                    if (name.size() == 0 || !cation.back().empty())
+                        return Fail(path, number, "reaction without phase name");
+                    std::string message;
+                    if (!ParseReaction(line.substr(0, line.find('=')), line.substr(line.find('=') + 1), message))
+                        return Fail(path, number, message);
+                }
+                else if (option == "log_k" || option == "logk")
+                {
+                    if (name.size() == 0 || !(tokens >> log_k.back()))
+                        return Fail(path, number, "expected log_k value");
+                }
+                else if (option == "delta_h")
+                {
+                    std::string unit;
+                    if (name.size() == 0 || !(tokens >> delta_h.back()))
+                        return Fail(path, number, "expected delta_h value");
+                    tokens >> unit;
+                    unit = Lower(unit);
+                    const Real scale = unit == "kcal" ? 4186.80 : unit == "cal" ? 4.18680 : unit == "j" ? 1 : 1000;
+                    if (!unit.empty() && unit != "kcal" && unit != "cal" && unit != "j" && unit != "kj")
+                        return Fail(path, number, "unknown delta_h unit " + unit);
+                    delta_h.back() *= scale;
+                }
+                else if (option == "analytic" || option == "analytical_expression" || option == "a_e")
+                {
+                    Real A[6] = {0, 0, 0, 0, 0, 0};
+                    int count = 0;
+                    while (count < 6 && tokens >> A[count])
+                        count++;
+                    if (name.size() == 0 || count == 0)
+                        return Fail(path, number, "expected analytic coefficients");
+                    if (A[4] != 0 || A[5] != 0)
+                        return Fail(path, number, "analytic terms A5/T^2 and A6 T^2 are not supported");
+                    analytic.back() = true;
+                    A1.back() = A[0];
+                    A2.back() = A[1];
+                    A3.back() = A[2];
+                    A4.back() = A[3];
+                }
+                else if (firstColumn && keyword[0] != '-')
+                {
+                    if (name.size() == MAX_MINERALS)
+                        return Fail(path, number, "too many phases");
+                    if (name.size() > 0 && cation.back().empty())
+                        return Fail(path, number, "phase " + name.back() + " has no reaction");
+                    name.push_back(keyword);
+                    cation.push_back("");
+                    anion.push_back("");
+                    nu_A.push_back(0);
+                    nu_B.push_back(0);
+                    Z_A.push_back(0);
+                    Z_B.push_back(0);
+                    cationIon.push_back(-1);
+                    anionIon.push_back(-1);
+                    analytic.push_back(false);
+                    log_k.push_back(0);
+                    delta_h.push_back(0);
+                    A1.push_back(0);
+                    A2.push_back(0);
+                    A3.push_back(0);
+                    A4.push_back(0);
+                }
+            }
+            else if (block == PITZER)
+            {
+                if (keyword[0] == '-')
+                {
+                    parameter = Upper(keyword.substr(1));
+                    continue;
+                }
+                const int count = parameter == "PSI" ? 3 : 2;
+                if (parameter != "B0" && parameter != "B1" && parameter != "B2" && parameter != "C0" && parameter != "ALPHAS" && parameter != "THETA" && parameter != "PSI")
+                    continue;
+
+                PitzerParameter p;
+                p.parameter = parameter;
+                p.value2 = 0;
+                std::string species = keyword;
+                for (int k = 0; k < count; k++)
+                {
+                    if (k > 0 && !(tokens >> species))
+                        return Fail(path, number, "expected species and a value");
+                    p.ion[k] = Ion(species);
+                    if (p.ion[k] < 0)
+                        return Fail(path, number, species + " is not charged");
+                }
+                if (!(tokens >> p.value))
+                    return Fail(path, number, "expected species and a value");
+                tokens >> p.value2;
+                pitzerParameters.push_back(p);
+            }
+        }
+        if (name.size() > 0 && cation.back().empty())
+            return Fail(path, 0, "phase " + name.back() + " has no reaction");
+
+        for (int i = 0; i < Size(); i++)
+        {
+            const int A = cationIon[i];
+            const int B = anionIon[i];
+            const bool twoTwo = Z_A[i] == 2 && Z_B[i] == -2;
+            beta_0.push_back(Parameter("B0", A, B, 0));
+            beta_1.push_back(Parameter("B1", A, B, 0));
+            beta_2.push_back(Parameter("B2", A, B, 0));
+            C_Phi.push_back(Parameter("C0", A, B, 0));
+            alpha_1.push_back(Parameter("ALPHAS", A, B, twoTwo ? 1.4 : 2));
+            const PitzerParameter *alphas = Find("ALPHAS", A, B, -1);
+            alpha_2.push_back(alphas != NULL ? alphas->value2 : 12);
+
+            if (analytic[i])
+            {
+                EquilibriumBatch::Coefficients c;
+                c.a_0 = M_LN10 * A1[i];
+                c.a_1 = M_LN10 * A2[i];
+                c.a_2 = M_LN10 * A3[i];
+                c.a_3 = A4[i];
+                equilibrium.push_back(c);
+            }
+            else
+            {
+                equilibrium.push_back(HoffEquilibrium(log_k[i], delta_h[i], ChemistryFunctions::T0()).BatchCoefficients());
+            }
+        }
+        return true;
+    }
+
+    // Folds the batch coefficients and picks the kernels
+    void Compile()
+    {
+        saturation.clear();
+        saturationIndex.clear();
+        for (int i = 0; i < Size(); i++)
+        {
+            PitzerActivityModel activity(nu_A[i], nu_B[i], Z_A[i], Z_B[i], beta_0[i], beta_1[i], beta_2[i], C_Phi[i], alpha_1[i], alpha_2[i]);
+            SaturationBatch::Coefficients c;
+            c.equilibrium = equilibrium[i];
+            c.activity = activity.BatchCoefficients();
+            c.nu = nu_A[i] + nu_B[i];
+            saturation.push_back(c);
+            saturationIndex.push_back(SaturationBatch::SaturationIndexKernel(nu_A[i], nu_B[i]));
+        }
+    }
+
+    // Last PITZER parameter of the ions in any order (ion c < 0 for pairs),
+    // NULL if not given
+    const PitzerParameter *Find(const std::string &parameter, int a, int b, int c) const
+    {
+        for (size_t k = pitzerParameters.size(); k-- > 0;)
+        {
+            const PitzerParameter &p = pitzerParameters[k];
+            if (p.parameter != parameter)
+                continue;
+            const int n = c < 0 ? 2 : 3;
+            int wanted[3] = {a, b, c};
+            int given[3] = {p.ion[0], p.ion[1], c < 0 ? -1 : p.ion[2]};
+            std::sort(wanted, wanted + n);
+            std::sort(given, given + n);
+            if (std::equal(wanted, wanted + n, given))
+                return &p;
+        }
+        return NULL;
+    }
+
+    // Species name with charge in STAR-CCM+ form, "Ba+2" -> "Ba_2+"; false if
+    // the species is not charged
+    static bool Species(const std::string &species, std::string &name, int &z)
+    {
+        const size_t sign = species.find_first_of("+-", 1);
+        if (sign == std::string::npos)
+            return false;
+        const std::string suffix = species.substr(sign + 1);
+        const int magnitude = suffix.empty() ? 1 : suffix.find_first_not_of(species[sign]) == std::string::npos ? (int)suffix.size() + 1 : atoi(suffix.c_str());
+        z = species[sign] == '+' ? magnitude : -magnitude;
+        char charge[16];
+        snprintf(charge, sizeof(charge), "_%d%c", magnitude, species[sign]);
+        name = species.substr(0, sign) + charge;
+        return true;
+    }
+
+private:
+    Real Parameter(const std::string &parameter, int a, int b, Real fallback) const
+    {
+        const PitzerParameter *p = Find(parameter, a, b, -1);
+        return p != NULL ? p->value : fallback;
+    }
+
+    // Index of a charged species in ion, added if new; -1 if not charged
+    int Ion(const std::string &species)
+    {
+        for (size_t k = 0; k < phreeqcIon.size(); k++)
+        {
+            if (phreeqcIon[k] == species)
+                return (int)k;
+        }
+        std::string name;
+        int z;
+        if (!Species(species, name, z))
+            return -1;
+        ion.push_back(name);
+        phreeqcIon.push_back(species);
+        charge.push_back(z);
+        return (int)ion.size() - 1;
+    }
+
+    bool Fail(const char *path, int number, const std::string &message)
+    {
+        char location[32];
+        snprintf(location, sizeof(location), ":%d: ", number);
+        error = std::string(path) + location + message;
+        return false;
+    }
+
+    // Right hand side of a dissolution reaction, e.g. "Ca+2 + SO4-2 + 2 H2O"
+    bool ParseReaction(const std::string &reactants, const std::string &products, std::string &message)
+    {
+        // The dissolution of the phase itself: one formula unit, uncharged
+        std::istringstream formula(reactants);
+        std::string phase, extra;
+        if (!(formula >> phase) || formula >> extra || isdigit(phase[0]) || phase[0] == '.' || phase.find_first_of("+-") != std::string::npos)
+        {
+            message = "the only reactant must be the phase " + name.back();
+            return false;
+        }
+
+        std::istringstream tokens(products);
+        std::string token;
+        Real coefficient = 1;
+        bool haveCoefficient = false;
+        while (tokens >> token)
+        {
+            if (token == "+")
+                continue;
+
+            size_t start = 0;
+            while (start < token.size() && (isdigit(token[start]) || token[start] == '.'))
+                start++;
+            if (start > 0)
+            {
+                coefficient = atof(token.substr(0, start).c_str());
+                haveCoefficient = true;
+            }
+            if (start == token.size())
+                continue;
+
+            const std::string species = token.substr(start);
+            if (coefficient != floor(coefficient) || coefficient <= 0)
+            {
+                message = "stoichiometry of " + species + " is not a positive integer";
+                return false;
+            }
+
+            const int k = Ion(species);
+            if (k >= 0)
+            {
+                const bool isCation = charge[k] > 0;
+                if (!(isCation ? cation : anion).back().empty())
+                {
+                    message = "only salts of one cation and one anion are supported";
+                    return false;
+                }
+                (isCation ? cation : anion).back() = ion[k];
+                (isCation ? cationIon : anionIon).back() = k;
+                (isCation ? nu_A : nu_B).back() = coefficient;
+                (isCation ? Z_A : Z_B).back() = charge[k];
+            }
+            coefficient = 1;
+            haveCoefficient = false;
+        }
+        if (cation.back().empty() || anion.back().empty() || haveCoefficient)
+        {
+            message = "expected a cation and an anion";
+            return false;
+        }
+        return true;
+    }
+
+    static std::string Upper(std::string s)
+    {
+        for (size_t i = 0; i < s.size(); i++)
+            s[i] = toupper(s[i]);
+        return s;
+    }
+
+    static std::string Lower(std::string s)
+    {
+        for (size_t i = 0; i < s.size(); i++)
+            s[i] = tolower(s[i]);
+        return s;
+    }
+};
+
+#endif // MINERAL_DATABASE_H
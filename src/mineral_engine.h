@@ -0,0 +1,268 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef MINERAL_ENGINE_H
+#define MINERAL_ENGINE_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "simd.h"
+#include "simd_math.h"
+#include "pitzer_batch.h"
+#include "mineral_database.h"
+
+// Saturation indices of all minerals of a database sharing one brine. The
+// ionic state (m_tot, I, sqrt(I), the Debye-Huckel term, 1/T, ln T and the
+// species molalities) is computed once per cell, the Pitzer virial terms
+// once per distinct alpha, gamma and the ion activity product once per
+// distinct ion pair (e.g. anhydrite and gypsum), so each mineral adds only
+// the few multiply-adds of its ln K.
+//
+// The inputs of a pass are T, the species mass fractions in the order of
+// species, and the spectator mass fractions yEtc_1-, yEtc_2-.
+class MineralEngine
+{
+public:
+    static const int MAX_SPECIES = 8;
+
+    // Species of the brine in order of first use, STAR-CCM+ names
+    std::vector<std::string> species;
+
+    // Distinct alphas of the Pitzer virial terms
+    std::vector<Real> alpha;
+
+    // Coefficient block of the distinct ion pairs
+    std::vector<int> speciesA;
+    std::vector<int> speciesB;
+    std::vector<int> nu_A;
+    std::vector<int> nu_B;
+    std::vector<Real> nu;
+    std::vector<Real> Z_AB;
+    std::vector<Real> B_factor;
+    std::vector<Real> C_term; // C_factor C_gamma
+    std::vector<Real> beta_0;
+    std::vector<Real> beta_1;
+    std::vector<Real> beta_2;
+    std::vector<int> alpha_1; // index into alpha, -1 if beta_1 = 0
+    std::vector<int> alpha_2; // index into alpha, -1 if beta_2 = 0
+    std::vector<bool> virial; // any of beta_0, beta_1, beta_2, C_gamma non-zero
+
+    // Coefficient block of the minerals, ln K = a_0 + a_1 T + a_2 / T + a_3 ln T
+    std::vector<int> pair;
+    std::vector<Real> a_0;
+    std::vector<Real> a_1;
+    std::vector<Real> a_2;
+    std::vector<Real> a_3;
+    bool logT = false; // any a_3 non-zero
+
+    PitzerBatch::Coefficients brine; // SMALL, I_min, M_w, A_0, l_B, b
+
+    const int Minerals() const
+    {
+        return (int)pair.size();
+    }
+
+    const int Pairs() const
+    {
+        return (int)speciesA.size();
+    }
+
+    const int Inputs() const
+    {
+        return (int)species.size() + 3;
+    }
+
+    // Coefficients of the compiled database, false if its minerals use more
+    // than MAX_SPECIES species
+    bool Build(const MineralDatabase &database)
+    {
+        for (int i = 0; i < database.Size(); i++)
+        {
+            const SaturationBatch::Coefficients &c = database.saturation[i];
+            const PitzerBatch::Coefficients &p = c.activity;
+            const int A = Index(species, database.cation[i]);
+            const int B = Index(species, database.anion[i]);
+            const int alpha1 = p.beta_1 != 0 ? Index(alpha, p.alpha_1) : -1;
+            const int alpha2 = p.beta_2 != 0 ? Index(alpha, p.alpha_2) : -1;
+
+            int k = 0;
+            while (k < Pairs() && !(speciesA[k] == A && speciesB[k] == B && nu_A[k] == database.nu_A[i] && nu_B[k] == database.nu_B[i] && Z_AB[k] == p.Z_AB &&
+                                   beta_0[k] == p.beta_0 && beta_1[k] == p.beta_1 && beta_2[k] == p.beta_2 && C_term[k] == p.C_factor * p.C_gamma &&
+                                   alpha_1[k] == alpha1 && alpha_2[k] == alpha2))
+                k++;
+            if (k == Pairs())
+            {
+                speciesA.push_back(A);
+                speciesB.push_back(B);
+                nu_A.push_back((int)database.nu_A[i]);
+                nu_B.push_back((int)database.nu_B[i]);
+                nu.push_back(c.nu);
+                Z_AB.push_back(p.Z_AB);
+                B_factor.push_back(p.B_factor);
+                C_term.push_back(p.C_factor * p.C_gamma);
+                beta_0.push_back(p.beta_0);
+                beta_1.push_back(p.beta_1);
+                beta_2.push_back(p.beta_2);
+                alpha_1.push_back(alpha1);
+                alpha_2.push_back(alpha2);
+                virial.push_back(p.beta_0 != 0 || p.beta_1 != 0 || p.beta_2 != 0 || C_term.back() != 0);
+            }
+
+            pair.push_back(k);
+            a_0.push_back(c.equilibrium.a_0);
+            a_1.push_back(c.equilibrium.a_1);
+            a_2.push_back(c.equilibrium.a_2);
+            a_3.push_back(c.equilibrium.a_3);
+            logT |= c.equilibrium.a_3 != 0;
+            brine = p;
+        }
+        return species.size() <= MAX_SPECIES;
+    }
+
+    // Saturation indices of all minerals for the cells [begin, end)
+    void SaturationIndex(const Real *const *inputs, Real *const *outputs, int begin, int end) const
+    {
+        typedef Simd::Pack<Real>::V V;
+        const int W = Simd::Pack<Real>::WIDTH;
+        const int n = Inputs();
+        V in[MAX_SPECIES + 3];
+        V SI[MineralDatabase::MAX_MINERALS];
+
+        int i = begin;
+        for (; i + W <= end; i += W)
+        {
+            for (int k = 0; k < n; k++)
+                in[k] = Simd::Load(inputs[k] + i);
+            SaturationIndex(in, SI);
+            for (int j = 0; j < Minerals(); j++)
+                Simd::Store(outputs[j] + i, SI[j]);
+        }
+        if (i < end)
+        {
+            // Padded with copies of the last cell as in Simd::Map
+            Real lanes[W];
+            for (int k = 0; k < n; k++)
+            {
+                for (int l = 0; l < W; l++)
+                    lanes[l] = inputs[k][i + l < end ? i + l : end - 1];
+                in[k] = Simd::Load(lanes);
+            }
+            SaturationIndex(in, SI);
+            for (int j = 0; j < Minerals(); j++)
+            {
+                Simd::Store(lanes, SI[j]);
+                for (int l = 0; i + l < end; l++)
+                    outputs[j][i + l] = lanes[l];
+            }
+        }
+    }
+
+private:
+    template <typename T>
+    static int Index(std::vector<T> &values, const T &value)
+    {
+        for (size_t k = 0; k < values.size(); k++)
+        {
+            if (values[k] == value)
+                return (int)k;
+        }
+        values.push_back(value);
+        return (int)values.size() - 1;
+    }
+
+    // x^nu for a small integer nu
+    template <typename V>
+    static V Power(V x, int nu)
+    {
+        V r = x;
+        for (int k = 1; k < nu; k++)
+            r *= x;
+        return r;
+    }
+
+    template <typename V>
+    void SaturationIndex(const V *in, V *SI) const
+    {
+        const int S = (int)species.size();
+        const V T = in[0];
+        const V yEtc1 = in[S + 1];
+        const V yEtc2 = in[S + 2];
+        const V SMALL = Simd::Broadcast<V>(brine.SMALL);
+
+        // Shared by all minerals
+        const V mTot = 1 / (brine.M_w / (1 - (yEtc1 + yEtc2)) + SMALL);
+        const V I = Simd::Max(0.5 * (yEtc1 * mTot + 4 * (yEtc2 * mTot)), Simd::Broadcast<V>(brine.I_min));
+        const V sqrtI = Simd::Sqrt(I);
+        const V A = PitzerBatch::DebyeHuckelParam(brine, T);
+        const V bSqrtI = brine.b * sqrtI;
+        const V f_gamma = -A / 3 * (sqrtI / (1 + bSqrtI) + 2 / brine.b * Simd::Log(1 + bSqrtI));
+        const auto dilute = I < brine.SMALL;
+        const V invT = 1 / T;
+        const V lnT = logT ? Simd::Log(T) : V{};
+        V m[MAX_SPECIES];
+        for (int k = 0; k < S; k++)
+            m[k] = Simd::Max(in[k + 1] * mTot, SMALL);
+
+        // 2 / (alpha^2 I) (1 - (1 + alpha sqrt(I) - alpha^2 I / 2) exp(-alpha sqrt(I)))
+        V g[MineralDatabase::MAX_MINERALS];
+        for (size_t k = 0; k < alpha.size(); k++)
+            g[k] = PitzerBatch::BetaTerm((Real)1, alpha[k], I, sqrtI);
+
+        // nu ln(gamma) + ln(IAP / gamma^nu) of the ion pairs
+        V lnIAP[MineralDatabase::MAX_MINERALS];
+        for (int k = 0; k < Pairs(); k++)
+        {
+            const V product = Power(m[speciesA[k]], nu_A[k]) * Power(m[speciesB[k]], nu_B[k]) + SMALL;
+            V ln_gamma = Z_AB[k] * f_gamma;
+            if (virial[k])
+            {
+                const V meanMolality = nu[k] == 2 ? Simd::Sqrt(product) : Simd::Exp(Simd::Log(product) / nu[k]);
+                V B_gamma = Simd::Broadcast<V>(2 * beta_0[k]);
+                if (alpha_1[k] >= 0)
+                    B_gamma += beta_1[k] * g[alpha_1[k]];
+                if (alpha_2[k] >= 0)
+                    B_gamma += beta_2[k] * g[alpha_2[k]];
+                ln_gamma += meanMolality * B_factor[k] * B_gamma + meanMolality * meanMolality * C_term[k];
+            }
+            ln_gamma = dilute ? V{} : ln_gamma;
+            lnIAP[k] = nu[k] * ln_gamma + Simd::Log(product);
+        }
+
+        for (int j = 0; j < Minerals(); j++)
+        {
+            V lnK = a_0[j] + a_2[j] * invT;
+            if (a_1[j] != 0)
+                lnK += a_1[j] * T;
+            if (a_3[j] != 0)
+                lnK += a_3[j] * lnT;
+            SI[j] = (lnIAP[pair[j]] - lnK) * (Real)M_LOG10E;
+        }
+    }
+};
+
+#endif // MINERAL_ENGINE_H
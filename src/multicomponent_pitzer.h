@@ -0,0 +1,488 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef MULTICOMPONENT_PITZER_H
+#define MULTICOMPONENT_PITZER_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "simd.h"
+#include "simd_math.h"
+#include "pitzer_batch.h"
+#include "mineral_database.h"
+
+// Pitzer activity coefficients of all ions of a multicomponent brine
+// (Harvie, Moller and Weare 1984): binary beta/C_phi terms, theta and psi
+// mixing terms and the unsymmetric E-theta terms of unequal charges,
+// with J(x) from Pitzer's (1975) approximation. Neutral species are not
+// modelled.
+//
+// The parameters are compiled into CSR rows per ion (binary partners,
+// like-charged partners, triplets), so ln(gamma) of all ions of a cell is
+// a loop over contiguous arrays. The virial functions are evaluated once
+// per distinct alpha and the E-theta terms once per distinct pair of
+// charges; everything is vectorized over cells.
+class MulticomponentPitzer
+{
+public:
+    static const int MAX_IONS = 14;
+    static const int MAX_PAIRS = MAX_IONS * MAX_IONS / 4;
+    static const int MAX_LIKE = MAX_IONS * (MAX_IONS - 1) / 2;
+    static const int MAX_ALPHAS = 8;
+    static const int MAX_MIXING = 8;
+
+    std::vector<std::string> ion;
+    std::vector<Real> z;
+
+    // Distinct alphas of the virial terms
+    std::vector<Real> alpha;
+
+    // Cation-anion pairs with binary parameters
+    std::vector<int> pairCation;
+    std::vector<int> pairAnion;
+    std::vector<Real> beta_0;
+    std::vector<Real> beta_1;
+    std::vector<Real> beta_2;
+    std::vector<Real> C;      // C_phi / (2 sqrt(|z_c z_a|))
+    std::vector<int> alpha_1; // index into alpha, -1 if beta_1 = 0
+    std::vector<int> alpha_2; // index into alpha, -1 if beta_2 = 0
+
+    // Like-charged pairs with theta or unequal charges
+    std::vector<int> likeI;
+    std::vector<int> likeJ;
+    std::vector<Real> theta;
+    std::vector<int> mixing; // index into mixingZ_i/j, -1 for equal charges
+
+    // Distinct |z_i| < |z_j| of the E-theta terms and their J(x) terms,
+    // indices into chargeProduct
+    std::vector<Real> mixingZ_i;
+    std::vector<Real> mixingZ_j;
+    std::vector<int> mixingJ_ij;
+    std::vector<int> mixingJ_ii;
+    std::vector<int> mixingJ_jj;
+    std::vector<Real> chargeProduct;
+
+    // Rows of ln(gamma) per ion: [row[i], row[i + 1]) of the partner arrays
+    std::vector<int> binaryRow;
+    std::vector<int> binaryIon;
+    std::vector<int> binaryPair;
+    std::vector<int> likeRow;
+    std::vector<int> likeIon;
+    std::vector<int> likePair;
+    std::vector<int> tripletRow;
+    std::vector<int> tripletJ;
+    std::vector<int> tripletK;
+    std::vector<Real> tripletPsi;
+
+    PitzerBatch::Coefficients water; // SMALL, I_min, M_w, A_0, l_B, b
+
+    bool compiled; // by Compile(), within the limits above
+
+    MulticomponentPitzer() : compiled(false)
+    {
+    }
+
+    const int Ions() const
+    {
+        return (int)ion.size();
+    }
+
+    int AddIon(const std::string &name, Real charge)
+    {
+        ion.push_back(name);
+        z.push_back(charge);
+        return Ions() - 1;
+    }
+
+    void Binary(int c, int a, Real beta0, Real beta1, Real beta2, Real C_phi, Real alpha1, Real alpha2)
+    {
+        pairCation.push_back(c);
+        pairAnion.push_back(a);
+        beta_0.push_back(beta0);
+        beta_1.push_back(beta1);
+        beta_2.push_back(beta2);
+        C.push_back(C_phi / (2 * sqrt(fabs(z[c] * z[a]))));
+        alpha_1.push_back(beta1 != 0 ? Index(alpha, alpha1) : -1);
+        alpha_2.push_back(beta2 != 0 ? Index(alpha, alpha2) : -1);
+    }
+
+    void Theta(int i, int j, Real value)
+    {
+        thetaI.push_back(i);
+        thetaJ.push_back(j);
+        thetaValue.push_back(value);
+    }
+
+    // psi of the like-charged ions i, j and the opposite ion k
+    void Psi(int i, int j, int k, Real value)
+    {
+        psiI.push_back(i);
+        psiJ.push_back(j);
+        psiK.push_back(k);
+        psiValue.push_back(value);
+    }
+
+    // Ions and parameters of the PITZER block of a database plus the spectators
+    // Etc_1- and Etc_2-, compiled; false if the limits above are exceeded
+    bool Build(const MineralDatabase &database, const PitzerBatch::Coefficients &brine)
+    {
+        water = brine;
+        for (size_t k = 0; k < database.ion.size(); k++)
+            AddIon(database.ion[k], database.charge[k]);
+        if (std::find(ion.begin(), ion.end(), "Etc_1-") == ion.end())
+            AddIon("Etc_1-", -1);
+        if (std::find(ion.begin(), ion.end(), "Etc_2-") == ion.end())
+            AddIon("Etc_2-", -2);
+
+        const int databaseIons = (int)database.ion.size();
+        for (int c = 0; c < databaseIons; c++)
+        {
+            for (int a = 0; a < databaseIons; a++)
+            {
+                if (z[c] <= 0 || z[a] >= 0)
+                    continue;
+                const MineralDatabase::PitzerParameter *b0 = database.Find("B0", c, a, -1);
+                const MineralDatabase::PitzerParameter *b1 = database.Find("B1", c, a, -1);
+                const MineralDatabase::PitzerParameter *b2 = database.Find("B2", c, a, -1);
+                const MineralDatabase::PitzerParameter *c0 = database.Find("C0", c, a, -1);
+                const MineralDatabase::PitzerParameter *alphas = database.Find("ALPHAS", c, a, -1);
+                if (b0 == NULL && b1 == NULL && b2 == NULL && c0 == NULL)
+                    continue;
+                const bool twoTwo = z[c] == 2 && z[a] == -2;
+                Binary(c, a, b0 != NULL ? b0->value : 0, b1 != NULL ? b1->value : 0, b2 != NULL ? b2->value : 0, c0 != NULL ? c0->value : 0,
+                       alphas != NULL ? alphas->value : twoTwo ? 1.4 : 2, alphas != NULL ? alphas->value2 : 12);
+            }
+        }
+
+        for (size_t k = 0; k < database.pitzerParameters.size(); k++)
+        {
+            const MineralDatabase::PitzerParameter &p = database.pitzerParameters[k];
+            if (p.parameter == "THETA" && z[p.ion[0]] * z[p.ion[1]] > 0)
+                Theta(p.ion[0], p.ion[1], p.value);
+            if (p.parameter != "PSI")
+                continue;
+            // Like-charged ions first, in any order in the file
+            const int *i = p.ion;
+            if (z[i[0]] * z[i[1]] > 0 && z[i[0]] * z[i[2]] < 0)
+                Psi(i[0], i[1], i[2], p.value);
+            else if (z[i[0]] * z[i[2]] > 0 && z[i[0]] * z[i[1]] < 0)
+                Psi(i[0], i[2], i[1], p.value);
+            else if (z[i[1]] * z[i[2]] > 0 && z[i[0]] * z[i[1]] < 0)
+                Psi(i[1], i[2], i[0], p.value);
+        }
+        return Compile();
+    }
+
+    // Builds the like-charged pairs and the rows from the parameters given,
+    // false if the limits above are exceeded
+    bool Compile()
+    {
+        likeI.clear();
+        likeJ.clear();
+        theta.clear();
+        mixing.clear();
+        for (int i = 0; i < Ions(); i++)
+        {
+            for (int j = i + 1; j < Ions(); j++)
+            {
+                if (z[i] * z[j] <= 0)
+                    continue;
+                Real value = 0;
+                for (size_t k = 0; k < thetaValue.size(); k++)
+                {
+                    if ((thetaI[k] == i && thetaJ[k] == j) || (thetaI[k] == j && thetaJ[k] == i))
+                        value = thetaValue[k];
+                }
+                if (value == 0 && z[i] == z[j])
+                    continue;
+                likeI.push_back(i);
+                likeJ.push_back(j);
+                theta.push_back(value);
+                mixing.push_back(z[i] == z[j] ? -1 : Mixing(fmin(fabs(z[i]), fabs(z[j])), fmax(fabs(z[i]), fabs(z[j]))));
+            }
+        }
+
+        binaryRow.assign(1, 0);
+        binaryIon.clear();
+        binaryPair.clear();
+        likeRow.assign(1, 0);
+        likeIon.clear();
+        likePair.clear();
+        tripletRow.assign(1, 0);
+        tripletJ.clear();
+        tripletK.clear();
+        tripletPsi.clear();
+        for (int i = 0; i < Ions(); i++)
+        {
+            for (size_t p = 0; p < pairCation.size(); p++)
+            {
+                if (pairCation[p] == i || pairAnion[p] == i)
+                {
+                    binaryIon.push_back(pairCation[p] == i ? pairAnion[p] : pairCation[p]);
+                    binaryPair.push_back(p);
+                }
+            }
+            binaryRow.push_back(binaryIon.size());
+
+            for (size_t q = 0; q < likeI.size(); q++)
+            {
+                if (likeI[q] == i || likeJ[q] == i)
+                {
+                    likeIon.push_back(likeI[q] == i ? likeJ[q] : likeI[q]);
+                    likePair.push_back(q);
+                }
+            }
+            likeRow.push_back(likeIon.size());
+
+            // psi_ijk enters ln(gamma) of i and j with m_j m_k or m_i m_k,
+            // and of k with m_i m_j
+            for (size_t t = 0; t < psiValue.size(); t++)
+            {
+                const int a = psiI[t], b = psiJ[t], c = psiK[t];
+                if (a == i || b == i)
+                {
+                    tripletJ.push_back(a == i ? b : a);
+                    tripletK.push_back(c);
+                    tripletPsi.push_back(psiValue[t]);
+                }
+                else if (c == i)
+                {
+                    tripletJ.push_back(a);
+                    tripletK.push_back(b);
+                    tripletPsi.push_back(psiValue[t]);
+                }
+            }
+            tripletRow.push_back(tripletJ.size());
+        }
+        compiled = Ions() <= MAX_IONS && (int)pairCation.size() <= MAX_PAIRS && (int)alpha.size() <= MAX_ALPHAS && (int)mixingZ_i.size() <= MAX_MIXING &&
+                   (int)chargeProduct.size() <= MAX_MIXING * 3 && (int)theta.size() <= MAX_LIKE;
+        return compiled;
+    }
+
+    // ln(gamma) of all ions for one vector of cells, from T and the mole
+    // fractions y of the ions
+    template <typename V>
+    void LogActivityCoefficients(V T, const V *y, V *lnGamma) const
+    {
+        // The work arrays below are sized by the limits of Compile()
+        assert(compiled);
+        const int n = Ions();
+        const V SMALL = Simd::Broadcast<V>(water.SMALL);
+
+        // Molalities, I and Z = sum m |z|
+        V yTot = V{};
+        for (int i = 0; i < n; i++)
+            yTot += y[i];
+        const V mTot = 1 / (water.M_w / (1 - yTot) + SMALL);
+        V m[MAX_IONS];
+        V I = V{};
+        V Z = V{};
+        for (int i = 0; i < n; i++)
+        {
+            m[i] = y[i] * mTot;
+            I += (Real)(0.5 * z[i] * z[i]) * m[i];
+            Z += fabs(z[i]) * m[i];
+        }
+        I = Simd::Max(I, Simd::Broadcast<V>(water.I_min));
+        const V sqrtI = Simd::Sqrt(I);
+        const V invI = 1 / I;
+        const V A_phi = PitzerBatch::DebyeHuckelParam(water, T) * (Real)(1.0 / 3);
+
+        // g(x) = 2 (1 - (1 + x) e^-x) / x^2 and g'(x) = -2 (1 - (1 + x + x^2 / 2) e^-x) / x^2
+        V g[MAX_ALPHAS];
+        V gPrime[MAX_ALPHAS];
+        for (size_t k = 0; k < alpha.size(); k++)
+        {
+            const V x = alpha[k] * sqrtI;
+            const V e = Simd::Exp(-x);
+            const V inv_x2 = 1 / (x * x);
+            g[k] = 2 * (1 - (1 + x) * e) * inv_x2;
+            gPrime[k] = -2 * (1 - (1 + x + 0.5 * x * x) * e) * inv_x2;
+        }
+
+        // Binary terms: BZ = 2 B + Z C per pair, F and sum m_c m_a C_ca
+        const V bSqrtI = water.b * sqrtI;
+        V F = -A_phi * (sqrtI / (1 + bSqrtI) + 2 / water.b * Simd::Log(1 + bSqrtI));
+        V CT = V{};
+        V BZ[MAX_PAIRS];
+        for (size_t p = 0; p < pairCation.size(); p++)
+        {
+            V B = Simd::Broadcast<V>(beta_0[p]);
+            V BPrime = V{};
+            if (alpha_1[p] >= 0)
+            {
+                B += beta_1[p] * g[alpha_1[p]];
+                BPrime += beta_1[p] * gPrime[alpha_1[p]];
+            }
+            if (alpha_2[p] >= 0)
+            {
+                B += beta_2[p] * g[alpha_2[p]];
+                BPrime += beta_2[p] * gPrime[alpha_2[p]];
+            }
+            const V mm = m[pairCation[p]] * m[pairAnion[p]];
+            F += mm * BPrime * invI;
+            CT += mm * C[p];
+            BZ[p] = 2 * B + Z * C[p];
+        }
+
+        // J(x_ij) per distinct z_i z_j, x_ij = 6 z_i z_j A_phi sqrt(I), then
+        // E-theta and E-theta' per distinct pair of charges
+        V J_zz[MAX_MIXING * 3];
+        V xJ_zz[MAX_MIXING * 3];
+        const V x_1 = 6 * A_phi * sqrtI;
+        const V lnX_1 = Simd::Log(x_1);
+        for (size_t k = 0; k < chargeProduct.size(); k++)
+            J(chargeProduct[k], x_1, lnX_1, J_zz[k], xJ_zz[k]);
+
+        V Etheta[MAX_MIXING];
+        V EthetaPrime[MAX_MIXING];
+        for (size_t q = 0; q < mixingZ_i.size(); q++)
+        {
+            const int ij = mixingJ_ij[q], ii = mixingJ_ii[q], jj = mixingJ_jj[q];
+            const Real zz = mixingZ_i[q] * mixingZ_j[q];
+            Etheta[q] = (Real)(zz * 0.25) * invI * (J_zz[ij] - 0.5 * J_zz[ii] - 0.5 * J_zz[jj]);
+            EthetaPrime[q] = -Etheta[q] * invI + (Real)(zz * 0.125) * invI * invI * (xJ_zz[ij] - 0.5 * xJ_zz[ii] - 0.5 * xJ_zz[jj]);
+        }
+
+        // Like-charged terms: Phi per pair, Phi' into F
+        V Phi[MAX_LIKE];
+        for (size_t q = 0; q < likeI.size(); q++)
+        {
+            Phi[q] = Simd::Broadcast<V>(theta[q]);
+            if (mixing[q] >= 0)
+            {
+                Phi[q] += Etheta[mixing[q]];
+                F += m[likeI[q]] * m[likeJ[q]] * EthetaPrime[mixing[q]];
+            }
+        }
+
+        const auto dilute = I < water.SMALL;
+        for (int i = 0; i < n; i++)
+        {
+            V ln_gamma = (z[i] * z[i]) * F + fabs(z[i]) * CT;
+            for (int k = binaryRow[i]; k < binaryRow[i + 1]; k++)
+                ln_gamma += m[binaryIon[k]] * BZ[binaryPair[k]];
+            for (int k = likeRow[i]; k < likeRow[i + 1]; k++)
+                ln_gamma += 2 * m[likeIon[k]] * Phi[likePair[k]];
+            for (int k = tripletRow[i]; k < tripletRow[i + 1]; k++)
+                ln_gamma += m[tripletJ[k]] * m[tripletK[k]] * tripletPsi[k];
+            lnGamma[i] = dilute ? V{} : ln_gamma;
+        }
+    }
+
+    // Activity coefficients of all ions for the cells [begin, end); inputs
+    // are T and the mole fractions of the ions, one output per ion
+    void ActivityCoefficients(const Real *const *inputs, Real *const *outputs, int begin, int end) const
+    {
+        typedef Simd::Pack<Real>::V V;
+        const int W = Simd::Pack<Real>::WIDTH;
+        const int n = Ions();
+        V in[MAX_IONS + 1] = {};
+        V lnGamma[MAX_IONS];
+
+        int i = begin;
+        for (; i + W <= end; i += W)
+        {
+            for (int k = 0; k <= n; k++)
+                in[k] = Simd::Load(inputs[k] + i);
+            LogActivityCoefficients(in[0], in + 1, lnGamma);
+            for (int j = 0; j < n; j++)
+                Simd::Store(outputs[j] + i, Simd::Exp(lnGamma[j]));
+        }
+        if (i < end)
+        {
+            // Padded with copies of the last cell as in Simd::Map
+            Real lanes[W];
+            for (int k = 0; k <= n; k++)
+            {
+                for (int l = 0; l < W; l++)
+                    lanes[l] = inputs[k][i + l < end ? i + l : end - 1];
+                in[k] = Simd::Load(lanes);
+            }
+            LogActivityCoefficients(in[0], in + 1, lnGamma);
+            for (int j = 0; j < n; j++)
+            {
+                Simd::Store(lanes, Simd::Exp(lnGamma[j]));
+                for (int l = 0; i + l < end; l++)
+                    outputs[j][i + l] = lanes[l];
+            }
+        }
+    }
+
+private:
+    std::vector<int> thetaI;
+    std::vector<int> thetaJ;
+    std::vector<Real> thetaValue;
+    std::vector<int> psiI;
+    std::vector<int> psiJ;
+    std::vector<int> psiK;
+    std::vector<Real> psiValue;
+
+    static int Index(std::vector<Real> &values, Real value)
+    {
+        for (size_t k = 0; k < values.size(); k++)
+        {
+            if (values[k] == value)
+                return (int)k;
+        }
+        values.push_back(value);
+        return (int)values.size() - 1;
+    }
+
+    int Mixing(Real z_i, Real z_j)
+    {
+        for (size_t k = 0; k < mixingZ_i.size(); k++)
+        {
+            if (mixingZ_i[k] == z_i && mixingZ_j[k] == z_j)
+                return (int)k;
+        }
+        mixingZ_i.push_back(z_i);
+        mixingZ_j.push_back(z_j);
+        mixingJ_ij.push_back(Index(chargeProduct, z_i * z_j));
+        mixingJ_ii.push_back(Index(chargeProduct, z_i * z_i));
+        mixingJ_jj.push_back(Index(chargeProduct, z_j * z_j));
+        return (int)mixingZ_i.size() - 1;
+    }
+
+    // J(x) = x / (4 + C_1 x^-C_2 exp(-C_3 x^C_4)) and x J'(x) of x = zz x_1
+    template <typename V>
+    static void J(Real zz, V x_1, V lnX_1, V &J, V &xJPrime)
+    {
+        const Real C_1 = 4.581, C_2 = 0.7237, C_3 = 0.0120, C_4 = 0.528;
+        const V lnX = lnX_1 + (Real)log(zz);
+        const V u = C_3 * Simd::Exp(C_4 * lnX);
+        const V E = C_1 * Simd::Exp(-C_2 * lnX - u);
+        const V D = 4 + E;
+        J = zz * x_1 / D;
+        xJPrime = J * (1 + E * (C_2 + C_4 * u) / D);
+    }
+};
+
+#endif // MULTICOMPONENT_PITZER_H
@@ -0,0 +1,109 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+
+#include "uclib.h"
+#include <string.h>
+#include <vector>
+
+// Results of a group of field functions computed together in one pass over
+// the cells from the same inputs. The function whose call starts a pass
+// writes its own result; the others are kept and handed out when those
+// functions are called next with the same input arrays, cell count and
+// input values. The solver updates its arrays in place between iterations,
+// so the values of a pass are kept and compared, not only the pointers.
+class OutputCache
+{
+public:
+    struct Statistics
+    {
+        long passes; // calls evaluating all outputs
+        long cached; // calls served from a previous pass
+        long changed; // calls whose inputs changed in place since the pass
+    } statistics = {0, 0, 0};
+
+    void Configure(int inputs, int outputs)
+    {
+        this->inputs = inputs;
+        this->outputs.resize(outputs);
+        pending.assign(outputs, false);
+        buffers.resize(outputs);
+        values.resize(inputs);
+    }
+
+    // Output j left from the pass with the same inputs and size, copied to
+    // result; false if a new pass is needed
+    bool Take(int j, Real *result, int size, const Real *const *input)
+    {
+        if (!(pending[j] && size == keySize && memcmp(input, key.data(), inputs * sizeof(Real *)) == 0))
+            return false;
+        for (int k = 0; k < inputs; k++)
+        {
+            if (memcmp(input[k], values[k].data(), size * sizeof(Real)) != 0)
+            {
+                pending.assign(pending.size(), false);
+                statistics.changed++;
+                return false;
+            }
+        }
+        memcpy(result, buffers[j].data(), size * sizeof(Real));
+        pending[j] = false;
+        statistics.cached++;
+        return true;
+    }
+
+    // Output arrays of a new pass requested by output j: result for j and
+    // buffers, marked pending, for the others
+    Real *const *Pass(int j, Real *result, int size, const Real *const *input)
+    {
+        key.assign(input, input + inputs);
+        keySize = size;
+        for (int k = 0; k < inputs; k++)
+        {
+            values[k].assign(input[k], input[k] + size);
+        }
+        for (size_t k = 0; k < outputs.size(); k++)
+        {
+            pending[k] = (int)k != j;
+            if ((int)k != j && (int)buffers[k].size() < size)
+                buffers[k].resize(size);
+            outputs[k] = (int)k == j ? result : buffers[k].data();
+        }
+        statistics.passes++;
+        return outputs.data();
+    }
+
+private:
+    int inputs = 0;
+    std::vector<const Real *> key;
+    int keySize = -1;
+    std::vector<std::vector<Real> > values; // inputs of the pass
+    std::vector<bool> pending;
+    std::vector<std::vector<Real> > buffers;
+    std::vector<Real *> outputs;
+};
+
+#endif // OUTPUT_CACHE_H
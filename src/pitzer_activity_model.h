@@ -28,20 +28,30 @@ SOFTWARE.
 #include "chemistry.h"
 #include "uclib.h"
 #include "math.h"
+#include "fast_math.h"
 #include <cstdlib>
 #include "activity_model.h"
 #include "simple_reaction.h"
+#include "pitzer_batch.h"
 
 class PitzerActivityModel : public ActivityModel
 {
 public:
-    const Real &SMALL = 1e-16;
-    const Real &N_A = ChemistryFunctions::N_A();
-    const Real &rho_w = ChemistryFunctions::densityWater();
-    const Real &e = ChemistryFunctions::electronicCharge();
-    const Real &eps_0 = ChemistryFunctions::permittivityVacuum();
-    const Real &eps_r = ChemistryFunctions::permittivityWater();
-    const Real &k_b = ChemistryFunctions::k_b();
+    // Stoichiometry and charges of the batch kernel, read at run time
+    typedef PitzerBatch::RuntimeSalt Salt;
+
+    const Real SMALL = 1e-16;
+    const Real N_A = ChemistryFunctions::N_A();
+    const Real rho_w = ChemistryFunctions::densityWater();
+    const Real e = ChemistryFunctions::electronicCharge();
+    const Real eps_0 = ChemistryFunctions::permittivityVacuum();
+    const Real eps_r = ChemistryFunctions::permittivityWater();
+    const Real k_b = ChemistryFunctions::k_b();
+
+    // Pitzer model parameters (fixed)
+    const Real alpha_1;
+    const Real alpha_2;
+    const Real b;
 
     // Pitzer model parameters (input)
     const Real &beta_0;
@@ -62,14 +72,20 @@ public:
                         const Real &beta_0,
                         const Real &beta_1,
                         const Real &beta_2,
-                        const Real &C_Phi) : beta_0(beta_0),
-                                             beta_1(beta_1),
-                                             beta_2(beta_2),
-                                             C_Phi(C_Phi),
-                                             nu_A(nu_A),
-                                             nu_B(nu_B),
-                                             Z_A(Z_A),
-                                             Z_B(Z_B)
+                        const Real &C_Phi,
+                        Real alpha_1 = 1.4,
+                        Real alpha_2 = 12,
+                        Real b = 1.2) : alpha_1(alpha_1),
+                                        alpha_2(alpha_2),
+                                        b(b),
+                                        beta_0(beta_0),
+                                        beta_1(beta_1),
+                                        beta_2(beta_2),
+                                        C_Phi(C_Phi),
+                                        nu_A(nu_A),
+                                        nu_B(nu_B),
+                                        Z_A(Z_A),
+                                        Z_B(Z_B)
     {
     }
 
@@ -79,33 +95,93 @@ public:
         return pitzerActivityCoefficient(T, IonicStrength(yEtc1, yEtc2), MeanMolality(yA, yB, yEtc1, yEtc2));
     }
 
+    // Activity Coeffiecients (gamma) of n cells
+    void ActivityCoefficient(const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n)
+    {
+        PitzerBatch::ActivityCoefficient(BatchCoefficients(), T, yA, yB, yEtc1, yEtc2, gamma, n);
+    }
+
+    // Activity Coeffiecients (gamma) of n cells of a double build in float lanes
+    virtual void ActivityCoefficientMixed(const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *gamma, int n)
+    {
+        PitzerBatch::ActivityCoefficientMixed(PitzerBatch::FloatCoefficients(BatchCoefficients()), T, yA, yB, yEtc1, yEtc2, gamma, n);
+    }
+
+    // Derivatives of gamma with respect to T, yA, yB, yEtc1 and yEtc2 (the
+    // slots PitzerBatch::D_T...) for the cells [begin, end) of the inputs in
+    // the same order
+    virtual void ActivityCoefficientDerivatives(const Real *const *inputs, Real *const *derivatives, int begin, int end)
+    {
+        PitzerBatch::ActivityCoefficientDerivatives(BatchCoefficients(), inputs, derivatives, begin, end);
+    }
+
     // Activity coefficient from Pitzer's eq.
     const Real pitzerActivityCoefficient(Real T, Real I, Real meanMolality)
     {
-        const Real alpha_1 = 1.4;
-        const Real alpha_2 = 12;
-        const Real b = 1.2;
-
         if (I < SMALL)
             return 1;
 
         const Real A = DebyeHuckelParam(T); //kg/mol
-        const Real B_gamma = 2 * beta_0 + 2 * beta_1 / ((alpha_1 * alpha_1) * I) * (1 - (1 + alpha_1 * sqrt(I) - 0.5 * (alpha_1 * alpha_1) * I) * exp(-alpha_1 * sqrt(I))) + 2 * beta_2 / ((alpha_2 * alpha_2) * I) * (1 - (1 + alpha_2 * sqrt(I) - 0.5 * (alpha_2 * alpha_2) * I) * exp(-alpha_2 * sqrt(I)));
+        const Real B_gamma = 2 * beta_0 + 2 * beta_1 / ((alpha_1 * alpha_1) * I) * (1 - (1 + alpha_1 * sqrt(I) - 0.5 * (alpha_1 * alpha_1) * I) * Math::Exp(-alpha_1 * sqrt(I))) + 2 * beta_2 / ((alpha_2 * alpha_2) * I) * (1 - (1 + alpha_2 * sqrt(I) - 0.5 * (alpha_2 * alpha_2) * I) * Math::Exp(-alpha_2 * sqrt(I)));
+
+        const Real f_gamma = -A / 3 * (sqrt(I) / (1 + b * sqrt(I)) + 2 / b * Math::Log(1 + b * sqrt(I)));
 
-        const Real f_gamma = -A / 3 * (sqrt(I) / (1 + b * sqrt(I)) + 2 / b * log(1 + b * sqrt(I)));
+        const Real C_gamma = 1.5 * C_Phi;
 
-        const Real C_gamma = 3 / 2 * C_Phi;
+        const Real ln_gamma = fabs(Z_A * Z_B) * f_gamma + meanMolality * BFactor() * B_gamma + Math::IntPow<2>(meanMolality) * CFactor() * C_gamma;
 
-        const Real ln_gamma = fabs(Z_A * Z_B) * f_gamma + meanMolality * (2 * nu_A * nu_B / (nu_A + nu_B)) * B_gamma + pow(meanMolality, 2) * (2 * pow(nu_A * nu_B, 1.5) / (nu_A + nu_B)) * C_gamma;
+        return Math::Exp(ln_gamma);
+    }
+
+    // Factors of the B and C terms in the mean molality. Pitzer's eq. takes
+    // the molality m of the salt, 2 nu_A nu_B / nu m B + 2 (nu_A nu_B)^1.5 /
+    // nu m^2 C, and m = m_mean / nu_mean with the mean stoichiometric
+    // coefficient nu_mean = (nu_A^nu_A nu_B^nu_B)^(1 / nu), 1 of 1:1 salts.
+    const Real BFactor() const
+    {
+        return 2 * nu_A * nu_B / (nu_A + nu_B) / MeanStoichiometry();
+    }
 
-        return exp(ln_gamma);
+    const Real CFactor() const
+    {
+        return 2 * Math::HalfPow<3>(nu_A * nu_B) / (nu_A + nu_B) / Math::IntPow<2>(MeanStoichiometry());
+    }
+
+    const Real MeanStoichiometry() const
+    {
+        return pow(pow(nu_A, nu_A) * pow(nu_B, nu_B), 1 / (nu_A + nu_B));
     }
 
     ///A
     const Real DebyeHuckelParam(Real T)
     {
-        const Real &rho_w = 997;
-        return sqrt(2 * M_PI * 6.022140857e23 * rho_w) * pow(2.131077129519e-7 / T, 1.5); //kg/mol
+        const Real q = ChemistryFunctions::BjerrumConstant() / (ChemistryFunctions::permittivityWater(T) * T);
+        return sqrt(2 * M_PI * N_A * ChemistryFunctions::densityWater(T)) * q * sqrt(q); //kg/mol
+    }
+
+    // Model constants for the batch kernel
+    const PitzerBatch::Coefficients BatchCoefficients()
+    {
+        PitzerBatch::Coefficients c;
+        c.SMALL = SMALL;
+        c.I_min = ChemistryFunctions::SmallIonicStrength();
+        c.M_w = ChemistryFunctions::MolarMassOfWater();
+        c.A_0 = sqrt(2 * M_PI * N_A);
+        c.l_B = ChemistryFunctions::BjerrumConstant();
+        c.alpha_1 = alpha_1;
+        c.alpha_2 = alpha_2;
+        c.b = b;
+        c.beta_0 = beta_0;
+        c.beta_1 = beta_1;
+        c.beta_2 = beta_2;
+        c.C_gamma = 1.5 * C_Phi;
+        c.nu_A = nu_A;
+        c.nu_B = nu_B;
+        c.inv_nu = 1.0 / (nu_A + nu_B);
+        c.Z_AB = fabs(Z_A * Z_B);
+        c.B_factor = BFactor();
+        c.C_factor = CFactor();
+        return c;
     }
 
     // Compute Ionic Strength
@@ -120,7 +196,7 @@ public:
     // Total Concentration
     const Real TotalMolality(Real &yEtc1, Real &yEtc2)
     {
-        return pow(ChemistryFunctions::MolarMassOfWater() / (1 - (yEtc1 + yEtc2)) + SMALL, -1);
+        return Math::IntPow<-1>(ChemistryFunctions::MolarMassOfWater() / (1 - (yEtc1 + yEtc2)) + SMALL);
     }
 
     // Returns Mean molality
@@ -133,7 +209,7 @@ public:
     // Mean Concentration
     const Real MeanMolality(Real mA, Real mB)
     {
-        return pow(pow(fmax(mA, SMALL), nu_A) * pow(fmax(mB, SMALL), nu_B) + SMALL, 1.0 / (nu_A + nu_B));
+        return Math::Pow(Math::Pow(fmax(mA, SMALL), nu_A) * Math::Pow(fmax(mB, SMALL), nu_B) + SMALL, 1.0 / (nu_A + nu_B));
     }
 };
 
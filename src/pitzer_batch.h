@@ -0,0 +1,493 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PITZER_BATCH_H
+#define PITZER_BATCH_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include "simd.h"
+#include "simd_math.h"
+#include <type_traits>
+
+namespace PitzerBatch
+{
+
+// Constants of PitzerActivityModel folded once per batch, in the lane type T
+// of the kernels. The constants of the water properties stay in Real and are
+// rounded to the lanes where they are used.
+template <typename T>
+struct BasicCoefficients
+{
+    T SMALL;
+    T I_min;
+    T M_w;
+    Real A_0;   // sqrt(2 pi N_A)
+    Real l_B;   // e^2 / (4 pi eps_0 k_b)
+    T alpha_1;
+    T alpha_2;
+    T b;
+    T beta_0;
+    T beta_1;
+    T beta_2;
+    T C_gamma;
+    T nu_A;
+    T nu_B;
+    T inv_nu;   // 1 / (nu_A + nu_B)
+    T Z_AB;     // |Z_A Z_B|
+    T B_factor; // 2 nu_A nu_B / (nu_A + nu_B) / nu_mean, see PitzerActivityModel::BFactor
+    T C_factor; // 2 (nu_A nu_B)^1.5 / (nu_A + nu_B) / nu_mean^2
+};
+
+typedef BasicCoefficients<Real> Coefficients;
+
+// Coefficients of the float lanes of a mixed precision kernel
+inline BasicCoefficients<float> FloatCoefficients(const Coefficients &c)
+{
+    BasicCoefficients<float> f;
+    f.SMALL = c.SMALL;
+    f.I_min = c.I_min;
+    f.M_w = c.M_w;
+    f.A_0 = c.A_0;
+    f.l_B = c.l_B;
+    f.alpha_1 = c.alpha_1;
+    f.alpha_2 = c.alpha_2;
+    f.b = c.b;
+    f.beta_0 = c.beta_0;
+    f.beta_1 = c.beta_1;
+    f.beta_2 = c.beta_2;
+    f.C_gamma = c.C_gamma;
+    f.nu_A = c.nu_A;
+    f.nu_B = c.nu_B;
+    f.inv_nu = c.inv_nu;
+    f.Z_AB = c.Z_AB;
+    f.B_factor = c.B_factor;
+    f.C_factor = c.C_factor;
+    return f;
+}
+
+// True for float lanes in a double build, whose cancellation-prone terms are
+// promoted to double or summed as series
+template <typename V>
+constexpr bool Promoted()
+{
+    return !std::is_same<Simd::Element<V>, Real>::value;
+}
+
+// Water properties of a vector of cells, evaluated once per vector and shared
+// by the activity terms of every salt or ion of a pass
+template <typename V>
+struct Water
+{
+    V rho_w;
+    V eps_r;
+    V A; // DebyeHuckelParam
+};
+
+// rho_w(T), eps_r(T) and A = A_0 sqrt(rho_w (l_B / (eps_r T))^3): two
+// polynomials, a division and one square root
+template <typename V, typename C>
+inline Water<V> WaterProperties(const C &c, V T)
+{
+    typedef Simd::Element<V> S;
+    Water<V> w;
+    w.rho_w = ChemistryFunctions::densityWater(T);
+    w.eps_r = ChemistryFunctions::permittivityWater(T);
+    const V q = (S)c.l_B / (w.eps_r * T);
+    w.A = (S)c.A_0 * Simd::Sqrt(w.rho_w * (q * q * q));
+    return w;
+}
+
+// DebyeHuckelParam. The correlations hold no cancellation, so float lanes
+// evaluate them in float, within a few float ulp of A.
+template <typename V, typename C>
+inline V DebyeHuckelParam(const C &c, V T)
+{
+    return WaterProperties(c, T).A;
+}
+
+// 2 beta / (alpha^2 I) (1 - (1 + alpha sqrt(I) - alpha^2 I / 2) exp(-alpha sqrt(I)))
+template <typename V>
+inline V BetaTerm(Simd::Element<V> beta, Simd::Element<V> alpha, V I, V sqrtI)
+{
+    const V alphaSqrtI = sqrtI * alpha;
+    if constexpr (Promoted<V>())
+    {
+        // The bracket is x^2 (1 - 5 x / 6 + ...), x = alpha sqrt(I), and
+        // cancels to nothing in float at small I. Below x = 0.5 its series
+        // over x^2 is summed instead, to 2e-10 with the terms up to x^9.
+        const V x = alphaSqrtI;
+        const V x2 = x * x;
+        const V direct = (1 - (1 + x - 0.5f * x2) * Simd::Exp(-x)) / x2;
+        V series = Simd::Broadcast<V>(-13.0f / 7983360);
+        series = series * x + 1.0f / 67200;
+        series = series * x - 11.0f / 90720;
+        series = series * x + 1.0f / 1152;
+        series = series * x - 3.0f / 560;
+        series = series * x + 1.0f / 36;
+        series = series * x - 7.0f / 60;
+        series = series * x + 3.0f / 8;
+        series = series * x - 5.0f / 6;
+        series = series * x + 1.0f;
+        return (2 * beta) * (x < 0.5f ? series : direct);
+    }
+    else
+    {
+        const V alpha2I = I * (alpha * alpha);
+        return (2 * beta) / alpha2I * (1 - (1 + alphaSqrtI - 0.5 * alpha2I) * Simd::Exp(-alphaSqrtI));
+    }
+}
+
+// Per-cell quantities shared by the activity coefficient and the ion
+// activity product
+template <typename V>
+struct IonicState
+{
+    V mTot;
+    V I;
+    V sqrtI;
+    V lnProduct;    // ln(max(m_A, SMALL)^nu_A max(m_B, SMALL)^nu_B + SMALL)
+    V meanMolality; // (max(m_A, SMALL)^nu_A max(m_B, SMALL)^nu_B + SMALL)^(1 / nu)
+};
+
+// Stoichiometry, charges and alphas of the salt read from Coefficients at
+// run time
+struct RuntimeSalt
+{
+    template <typename V, typename C>
+    static void Molalities(const C &c, V mA, V mB, IonicState<V> &s)
+    {
+        const V lnProduct = c.nu_A * Simd::Log(mA) + c.nu_B * Simd::Log(mB);
+        s.lnProduct = Simd::Log(Simd::Exp(lnProduct) + c.SMALL);
+        s.meanMolality = Simd::Exp(s.lnProduct * c.inv_nu);
+    }
+
+    template <typename C>
+    static Real Z_AB(const C &c) { return c.Z_AB; }
+    template <typename C>
+    static Real B_factor(const C &c) { return c.B_factor; }
+    template <typename C>
+    static Real C_factor(const C &c) { return c.C_factor; }
+    template <typename C>
+    static Real alpha_1(const C &c) { return c.alpha_1; }
+    template <typename C>
+    static Real alpha_2(const C &c) { return c.alpha_2; }
+    template <typename C>
+    static Real b(const C &c) { return c.b; }
+};
+
+// x^N by multiplication
+template <int N, typename V>
+inline V IntPow(V x)
+{
+    if constexpr (N == 0)
+        return x * 0 + 1;
+    else if constexpr (N == 1)
+        return x;
+    else if constexpr (N % 2 == 0)
+        return IntPow<N / 2>(x * x);
+    else
+        return x * IntPow<N - 1>(x);
+}
+
+// x^(1 / N)
+template <int N, typename V>
+inline V Root(V x)
+{
+    if constexpr (N == 1)
+        return x;
+    else if constexpr (N == 2)
+        return Simd::Sqrt(x);
+    else
+        return Simd::Exp(Simd::Log(x) * (Real)(1.0 / N));
+}
+
+constexpr Real ConstSqrt(Real x, Real r = 1, int i = 0)
+{
+    return i == 64 ? r : ConstSqrt(x, 0.5 * (r + x / r), i + 1);
+}
+
+constexpr Real ConstIntPow(Real x, int n)
+{
+    return n == 0 ? 1 : x * ConstIntPow(x, n - 1);
+}
+
+// x^(1 / n) of x >= 1, from above after the first step
+constexpr Real ConstRoot(Real x, int n, Real r = 1, int i = 0)
+{
+    return i == 64 ? r : ConstRoot(x, n, r - (ConstIntPow(r, n) - x) / (n * ConstIntPow(r, n - 1)), i + 1);
+}
+
+// Pitzer alphas and b of 2-2 electrolytes
+struct Alphas22
+{
+    static constexpr Real alpha_1 = 1.4;
+    static constexpr Real alpha_2 = 12;
+    static constexpr Real b = 1.2;
+};
+
+// Integer stoichiometry known at compile time, so the powers of the
+// molalities are multiplies; charges and alphas read from Coefficients
+template <int NU_A, int NU_B>
+struct StoichiometricSalt : RuntimeSalt
+{
+    static constexpr int NU = NU_A + NU_B;
+    static constexpr Real NU_MEAN = ConstRoot(ConstIntPow(NU_A, NU_A) * ConstIntPow(NU_B, NU_B), NU);
+    static constexpr Real B_FACTOR = 2.0 * NU_A * NU_B / NU / NU_MEAN;
+    static constexpr Real C_FACTOR = 2.0 * NU_A * NU_B * ConstSqrt(NU_A * NU_B) / NU / (NU_MEAN * NU_MEAN);
+
+    template <typename V, typename C>
+    static void Molalities(const C &c, V mA, V mB, IonicState<V> &s)
+    {
+        const V product = IntPow<NU_A>(mA) * IntPow<NU_B>(mB) + c.SMALL;
+        s.lnProduct = Simd::Log(product);
+        s.meanMolality = Root<NU>(product);
+    }
+
+    template <typename C>
+    static Real B_factor(const C &) { return B_FACTOR; }
+    template <typename C>
+    static Real C_factor(const C &) { return C_FACTOR; }
+};
+
+// Integer stoichiometry, charges and alphas all known at compile time
+template <int NU_A, int NU_B, int CHARGE_A, int CHARGE_B, typename Alphas = Alphas22>
+struct StaticSalt : StoichiometricSalt<NU_A, NU_B>
+{
+    static constexpr Real Z_AB_VALUE = CHARGE_A * CHARGE_B < 0 ? -CHARGE_A * CHARGE_B : CHARGE_A * CHARGE_B;
+
+    template <typename C>
+    static Real Z_AB(const C &) { return Z_AB_VALUE; }
+    template <typename C>
+    static Real alpha_1(const C &) { return Alphas::alpha_1; }
+    template <typename C>
+    static Real alpha_2(const C &) { return Alphas::alpha_2; }
+    template <typename C>
+    static Real b(const C &) { return Alphas::b; }
+};
+
+template <typename Salt = RuntimeSalt, typename V>
+inline IonicState<V> State(const BasicCoefficients<Simd::Element<V> > &c, V yA, V yB, V yEtc1, V yEtc2)
+{
+    const V SMALL = Simd::Broadcast<V>(c.SMALL);
+    IonicState<V> s;
+
+    // TotalMolality and IonicStrength with the spectator charges {1, 2}
+    s.mTot = 1 / (c.M_w / (1 - (yEtc1 + yEtc2)) + SMALL);
+    s.I = Simd::Max(0.5 * (yEtc1 * s.mTot + 4 * (yEtc2 * s.mTot)), Simd::Broadcast<V>(c.I_min));
+    s.sqrtI = Simd::Sqrt(s.I);
+
+    Salt::Molalities(c, Simd::Max(yA * s.mTot, SMALL), Simd::Max(yB * s.mTot, SMALL), s);
+    return s;
+}
+
+// ln(gamma) from Pitzer's eq., 0 where I < SMALL
+template <typename Salt = RuntimeSalt, typename V>
+inline V LogActivityCoefficient(const BasicCoefficients<Simd::Element<V> > &c, V T, const IonicState<V> &s)
+{
+    typedef Simd::Element<V> S;
+    const V A = DebyeHuckelParam(c, T);
+
+    V B_gamma = Simd::Broadcast<V>(2 * c.beta_0);
+    if (c.beta_1 != 0)
+        B_gamma += BetaTerm(c.beta_1, Salt::alpha_1(c), s.I, s.sqrtI);
+    if (c.beta_2 != 0)
+        B_gamma += BetaTerm(c.beta_2, Salt::alpha_2(c), s.I, s.sqrtI);
+
+    const S b = Salt::b(c);
+    const V bSqrtI = b * s.sqrtI;
+    const V f_gamma = -A / 3 * (s.sqrtI / (1 + bSqrtI) + 2 / b * Simd::Log(1 + bSqrtI));
+
+    const V ln_gamma = (S)Salt::Z_AB(c) * f_gamma + s.meanMolality * (S)Salt::B_factor(c) * B_gamma + s.meanMolality * s.meanMolality * (S)Salt::C_factor(c) * c.C_gamma;
+    return s.I < c.SMALL ? V{} : ln_gamma;
+}
+
+// PitzerActivityModel::ActivityCoefficient for one vector of cells
+template <typename Salt = RuntimeSalt, typename V>
+inline V ActivityCoefficient(const BasicCoefficients<Simd::Element<V> > &c, V T, V yA, V yB, V yEtc1, V yEtc2)
+{
+    const IonicState<V> s = State<Salt>(c, yA, yB, yEtc1, yEtc2);
+    const V ln_gamma = LogActivityCoefficient<Salt>(c, T, s);
+    return s.I < c.SMALL ? Simd::Broadcast<V>(1) : Simd::Exp(ln_gamma);
+}
+
+// Activity coefficients of n cells
+template <typename Salt = RuntimeSalt>
+inline void ActivityCoefficient(const Coefficients &c, const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T, V yA, V yB, V yEtc1, V yEtc2)
+              { return ActivityCoefficient<Salt>(c, T, yA, yB, yEtc1, yEtc2); },
+              gamma, n, T, yA, yB, yEtc1, yEtc2);
+}
+
+// Activity coefficients of n cells of a double build in float lanes, see
+// Promoted()
+template <typename Salt = RuntimeSalt>
+inline void ActivityCoefficientMixed(const BasicCoefficients<float> &c, const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *gamma, int n)
+{
+    typedef Simd::VecF V;
+    Simd::MapMixed([&c](V T, V yA, V yB, V yEtc1, V yEtc2)
+                   { return ActivityCoefficient<Salt>(c, T, yA, yB, yEtc1, yEtc2); },
+                   gamma, n, T, yA, yB, yEtc1, yEtc2);
+}
+
+// d ln(A) / dT = rho_w' / (2 rho_w) - 3 / 2 (eps_r' / eps_r + 1 / T)
+template <typename V>
+inline V LogDebyeHuckelParamDerivative(V T)
+{
+    const V dlnRho = ChemistryFunctions::densityWaterDerivative(T) / ChemistryFunctions::densityWater(T);
+    const V dlnEps = ChemistryFunctions::permittivityWaterDerivative(T) / ChemistryFunctions::permittivityWater(T);
+    return 0.5 * dlnRho - 1.5 * (dlnEps + 1 / T);
+}
+
+// BetaTerm and its derivative with respect to I,
+// (beta exp(-x) (2 - x / 2) - BetaTerm) / I with x = alpha sqrt(I)
+template <typename V>
+inline V BetaTerm(Real beta, Real alpha, V I, V sqrtI, V &dI)
+{
+    const V x = sqrtI * alpha;
+    const V expX = Simd::Exp(-x);
+    const V g = (2 * beta) / (x * x) * (1 - (1 + x - 0.5 * (x * x)) * expX);
+    dI = (beta * expX * (2 - 0.5 * x) - g) / I;
+    return g;
+}
+
+// Slots of the derivatives of gamma
+enum
+{
+    D_T,
+    D_YA,
+    D_YB,
+    D_YETC1,
+    D_YETC2,
+    DERIVATIVES
+};
+
+// Derivatives of gamma of one vector of cells with respect to T and the mass
+// fractions, by the chain rule through A(T), I and the mean molality. Cells
+// where a clamp (I_min, SMALL) is active get zero from the clamped input.
+template <typename Salt = RuntimeSalt, typename V>
+inline void ActivityCoefficientDerivatives(const Coefficients &c, V T, V yA, V yB, V yEtc1, V yEtc2, V *d)
+{
+    const V SMALL = Simd::Broadcast<V>(c.SMALL);
+    const IonicState<V> s = State<Salt>(c, yA, yB, yEtc1, yEtc2);
+
+    // ln(gamma) as in LogActivityCoefficient, with its partials
+    const V A = DebyeHuckelParam(c, T);
+    V B_gamma = Simd::Broadcast<V>(2 * c.beta_0);
+    V dB_gamma = V{};
+    V dI;
+    if (c.beta_1 != 0)
+    {
+        B_gamma += BetaTerm(c.beta_1, Salt::alpha_1(c), s.I, s.sqrtI, dI);
+        dB_gamma += dI;
+    }
+    if (c.beta_2 != 0)
+    {
+        B_gamma += BetaTerm(c.beta_2, Salt::alpha_2(c), s.I, s.sqrtI, dI);
+        dB_gamma += dI;
+    }
+
+    const Real b = Salt::b(c);
+    const V bSqrtI = b * s.sqrtI;
+    const V f_gamma = -A / 3 * (s.sqrtI / (1 + bSqrtI) + 2 / b * Simd::Log(1 + bSqrtI));
+    const V df_gamma = -A / 3 * (1 / ((1 + bSqrtI) * (1 + bSqrtI)) + 2 / (1 + bSqrtI)) / (2 * s.sqrtI);
+
+    const V M = s.meanMolality;
+    const V ln_gamma = Salt::Z_AB(c) * f_gamma + M * Salt::B_factor(c) * B_gamma + M * M * Salt::C_factor(c) * c.C_gamma;
+    const V gamma = Simd::Exp(ln_gamma);
+    const V dLnGamma_dT = Salt::Z_AB(c) * f_gamma * LogDebyeHuckelParamDerivative(T);
+    const V dLnGamma_dI = Salt::Z_AB(c) * df_gamma + M * Salt::B_factor(c) * dB_gamma;
+    const V dLnGamma_dM = Salt::B_factor(c) * B_gamma + 2 * M * Salt::C_factor(c) * c.C_gamma;
+
+    // mTot and I through the spectators
+    const V oneMinusY = 1 - (yEtc1 + yEtc2);
+    const V dmTot = -(s.mTot * s.mTot) * c.M_w / (oneMinusY * oneMinusY);
+    const V z = yEtc1 + 4 * yEtc2;
+    const auto freeI = 0.5 * (z * s.mTot) > c.I_min;
+    const V dI_1 = freeI ? 0.5 * (s.mTot + z * dmTot) : V{};
+    const V dI_2 = freeI ? 0.5 * (4 * s.mTot + z * dmTot) : V{};
+
+    // M = (m_A^nu_A m_B^nu_B + SMALL)^(1 / nu), d ln(M) = (1 - SMALL / P) / nu d ln(m_A^nu_A m_B^nu_B)
+    const V mA = yA * s.mTot;
+    const V mB = yB * s.mTot;
+    const V dlnM = M * (1 - c.SMALL / Simd::Exp(s.lnProduct)) * c.inv_nu;
+    const V dlnA = mA > SMALL ? Simd::Broadcast<V>(c.nu_A) : V{};
+    const V dlnB = mB > SMALL ? Simd::Broadcast<V>(c.nu_B) : V{};
+    const V dM_A = dlnM * dlnA * s.mTot / Simd::Max(mA, SMALL);
+    const V dM_B = dlnM * dlnB * s.mTot / Simd::Max(mB, SMALL);
+    const V dM_Etc = dlnM * (dlnA + dlnB) * dmTot / s.mTot;
+
+    const auto dilute = s.I < c.SMALL;
+    d[D_T] = dilute ? V{} : gamma * dLnGamma_dT;
+    d[D_YA] = dilute ? V{} : gamma * dLnGamma_dM * dM_A;
+    d[D_YB] = dilute ? V{} : gamma * dLnGamma_dM * dM_B;
+    d[D_YETC1] = dilute ? V{} : gamma * (dLnGamma_dI * dI_1 + dLnGamma_dM * dM_Etc);
+    d[D_YETC2] = dilute ? V{} : gamma * (dLnGamma_dI * dI_2 + dLnGamma_dM * dM_Etc);
+}
+
+// Derivatives of gamma for the cells [begin, end) of the inputs T, yA, yB,
+// yEtc1, yEtc2, one output array per slot
+template <typename Salt = RuntimeSalt>
+inline void ActivityCoefficientDerivatives(const Coefficients &c, const Real *const *inputs, Real *const *outputs, int begin, int end)
+{
+    typedef Simd::Pack<Real>::V V;
+    const int W = Simd::Pack<Real>::WIDTH;
+    V in[5];
+    V d[DERIVATIVES];
+
+    int i = begin;
+    for (; i + W <= end; i += W)
+    {
+        for (int k = 0; k < 5; k++)
+            in[k] = Simd::Load(inputs[k] + i);
+        ActivityCoefficientDerivatives<Salt>(c, in[0], in[1], in[2], in[3], in[4], d);
+        for (int j = 0; j < DERIVATIVES; j++)
+            Simd::Store(outputs[j] + i, d[j]);
+    }
+    if (i < end)
+    {
+        // Padded with copies of the last cell as in Simd::Map
+        Real lanes[W];
+        for (int k = 0; k < 5; k++)
+        {
+            for (int l = 0; l < W; l++)
+                lanes[l] = inputs[k][i + l < end ? i + l : end - 1];
+            in[k] = Simd::Load(lanes);
+        }
+        ActivityCoefficientDerivatives<Salt>(c, in[0], in[1], in[2], in[3], in[4], d);
+        for (int j = 0; j < DERIVATIVES; j++)
+        {
+            Simd::Store(lanes, d[j]);
+            for (int l = 0; l < W && i + l < end; l++)
+                outputs[j][i + l] = lanes[l];
+        }
+    }
+}
+
+}; // namespace PitzerBatch
+
+#endif // PITZER_BATCH_H
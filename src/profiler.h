@@ -0,0 +1,235 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Instrumentation of the registered field functions, compiled in with
+// -DSCALE_PROFILE. Every function is registered through a wrapper that counts
+// its calls and cells, times each call with the TSC into a log2 histogram and
+// tracks the range of every input. The counters are kept per calling thread,
+// without atomics, and written per rank when the library is unloaded.
+#if SCALE_PROFILE
+
+#include "uclib.h"
+#include "runtime_config.h"
+#include "math.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Profiler
+{
+public:
+    static const int MAX_FUNCTIONS = 96;
+    static const int MAX_ARGUMENTS = 16;
+    static const int BUCKETS = 48; // log2 of cycles per call
+
+    struct Function
+    {
+        void *function;
+        std::string name;
+        std::vector<std::string> arguments;
+    };
+
+    struct Record
+    {
+        long calls;
+        long cells;
+        unsigned long long cycles;
+        long histogram[BUCKETS];
+        Real min[MAX_ARGUMENTS];
+        Real max[MAX_ARGUMENTS];
+    };
+
+    // Counters of one calling thread
+    struct Thread
+    {
+        std::vector<Record> records;
+    };
+
+    std::vector<Function> functions;
+
+    // Every stride-th cell enters the input ranges
+    int stride = 64;
+
+    static Profiler &Instance()
+    {
+        // Never destroyed, as the summary is written by a destructor
+        static Profiler *profiler = new Profiler;
+        return *profiler;
+    }
+
+    // Wrapper of function taking the given arguments, or function itself if
+    // there are too many functions or arguments
+    void *Wrap(void *function, const std::string &name, const std::vector<std::string> &arguments)
+    {
+        if (functions.size() >= MAX_FUNCTIONS || arguments.size() > MAX_ARGUMENTS)
+        {
+            printf("Not profiling %s: more than %d functions or %d arguments\n", name.c_str(), MAX_FUNCTIONS, MAX_ARGUMENTS);
+            return function;
+        }
+        static void *wrappers[MAX_ARGUMENTS + 1][MAX_FUNCTIONS] = {};
+        if (wrappers[0][0] == NULL)
+            Fill(wrappers, std::make_index_sequence<MAX_ARGUMENTS + 1>());
+        functions.push_back(Function{function, name, arguments});
+        return wrappers[arguments.size()][functions.size() - 1];
+    }
+
+    // Counts one call of function id, kept out of the wrappers so that they
+    // stay small
+    __attribute__((noinline)) void Add(int id, int size, unsigned long long cycles, const Real *const *inputs)
+    {
+        Record &r = Local().records[id];
+        r.calls++;
+        r.cells += size;
+        r.cycles += cycles;
+        int bucket = 0;
+        while ((cycles >>= 1) != 0 && bucket < BUCKETS - 1)
+            bucket++;
+        r.histogram[bucket]++;
+
+        const int n = (int)functions[id].arguments.size();
+        for (int k = 0; k < n; k++)
+        {
+            Real lo = r.min[k], hi = r.max[k];
+            for (int i = 0; i < size; i += stride)
+            {
+                const Real x = inputs[k][i];
+                lo = x < lo ? x : lo;
+                hi = x > hi ? x : hi;
+            }
+            r.min[k] = lo;
+            r.max[k] = hi;
+        }
+    }
+
+    // Summary of all threads to directory/scale_profile.<rank or pid>.txt;
+    // false if it could not be written
+    bool Write(const char *directory, std::string &path)
+    {
+        path = std::string(directory) + "/scale_profile." + RuntimeConfig::RankName() + ".txt";
+        FILE *file = fopen(path.c_str(), "w");
+        if (file == NULL)
+            return false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        fprintf(file, "# rank %d, pid %d, %zu threads, times in TSC cycles, input ranges of every %d-th cell\n", RuntimeConfig::Rank(), getpid(), threads.size(), stride);
+        for (size_t id = 0; id < functions.size(); id++)
+        {
+            for (size_t t = 0; t < threads.size(); t++)
+            {
+                const Record &r = threads[t]->records[id];
+                if (r.calls == 0)
+                    continue;
+                fprintf(file, "%s\n", functions[id].name.c_str());
+                fprintf(file, "    thread %zu: %ld calls, %ld cells (%.1f per call), %llu cycles (%.2f per cell)\n",
+                        t, r.calls, r.cells, (double)r.cells / r.calls, r.cycles, (double)r.cycles / fmax(r.cells, 1));
+                fprintf(file, "    cycles per call:");
+                for (int b = 0; b < BUCKETS; b++)
+                {
+                    if (r.histogram[b] != 0)
+                        fprintf(file, " [2^%d, 2^%d) %ld", b, b + 1, r.histogram[b]);
+                }
+                fprintf(file, "\n");
+                for (size_t k = 0; k < functions[id].arguments.size(); k++)
+                    fprintf(file, "    %s: [%g, %g]\n", functions[id].arguments[k].c_str(), (double)r.min[k], (double)r.max[k]);
+            }
+        }
+        fclose(file);
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<Thread *> threads;
+
+    Thread &Local()
+    {
+        thread_local Thread *local = NULL;
+        if (local == NULL)
+        {
+            local = new Thread;
+            local->records.resize(MAX_FUNCTIONS);
+            for (Record &r : local->records)
+            {
+                r = {};
+                for (int k = 0; k < MAX_ARGUMENTS; k++)
+                {
+                    r.min[k] = INFINITY;
+                    r.max[k] = -INFINITY;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.push_back(local);
+        }
+        return *local;
+    }
+
+    template <size_t K>
+    using Pointer = Real *;
+
+    template <int Id, size_t... K>
+    static void Profiled(Real *result, int size, Pointer<K>... arguments)
+    {
+        Profiler &profiler = Instance();
+        const unsigned long long start = __rdtsc();
+        ((void (*)(Real *, int, Pointer<K>...))profiler.functions[Id].function)(result, size, arguments...);
+        const unsigned long long cycles = __rdtsc() - start;
+        const Real *inputs[] = {arguments..., NULL};
+        profiler.Add(Id, size, cycles, inputs);
+    }
+
+    // Wrappers of all ids taking Count arguments
+    template <size_t Count, typename = std::make_index_sequence<Count> >
+    struct Arity;
+
+    template <size_t Count, size_t... K>
+    struct Arity<Count, std::index_sequence<K...> >
+    {
+        template <size_t... Id>
+        static void Fill(void **wrappers, std::index_sequence<Id...>)
+        {
+            void *all[] = {(void *)Profiled<Id, K...>...};
+            std::copy(all, all + sizeof...(Id), wrappers);
+        }
+    };
+
+    template <size_t... Count>
+    static void Fill(void *(*wrappers)[MAX_FUNCTIONS], std::index_sequence<Count...>)
+    {
+        int filled[] = {(Arity<Count>::Fill(wrappers[Count], std::make_index_sequence<MAX_FUNCTIONS>()), 0)...};
+        (void)filled;
+    }
+};
+
+#endif // SCALE_PROFILE
+
+#endif // PROFILER_H
@@ -0,0 +1,84 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include "uclib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+// Opt-in features of the library are configured through environment
+// variables read when STAR-CCM+ loads it (uclib()).
+namespace RuntimeConfig
+{
+
+// Set and not "0"
+inline const bool Flag(const char *name)
+{
+    const char *value = getenv(name);
+    return value != NULL && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+inline const double Number(const char *name, double fallback)
+{
+    const char *value = getenv(name);
+    if (value == NULL || value[0] == '\0')
+        return fallback;
+    return atof(value);
+}
+
+inline const char *String(const char *name, const char *fallback)
+{
+    const char *value = getenv(name);
+    if (value == NULL || value[0] == '\0')
+        return fallback;
+    return value;
+}
+
+// Rank of the MPI launchers STAR-CCM+ uses, -1 if none is set
+inline int Rank()
+{
+    const char *names[] = {"PMI_RANK", "OMPI_COMM_WORLD_RANK", "PMIX_RANK", "MPI_RANKID", "SLURM_PROCID"};
+    for (const char *name : names)
+    {
+        const char *value = getenv(name);
+        if (value != NULL && value[0] != '\0')
+            return atoi(value);
+    }
+    return -1;
+}
+
+// The rank, or pid<pid> outside MPI, to name the files of one process
+inline std::string RankName()
+{
+    const int rank = Rank();
+    return rank >= 0 ? std::to_string(rank) : "pid" + std::to_string(getpid());
+}
+
+}; // namespace RuntimeConfig
+
+#endif // RUNTIME_CONFIG_H
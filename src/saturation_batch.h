@@ -0,0 +1,143 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SATURATION_BATCH_H
+#define SATURATION_BATCH_H
+
+#include "uclib.h"
+#include "math.h"
+#include "simd.h"
+#include "simd_math.h"
+#include "equilibrium_batch.h"
+#include "pitzer_batch.h"
+
+namespace SaturationBatch
+{
+
+// Coefficients in the lane type T of the kernels; ln K is always evaluated in
+// Real
+template <typename T>
+struct BasicCoefficients
+{
+    EquilibriumBatch::Coefficients equilibrium;
+    PitzerBatch::BasicCoefficients<T> activity;
+    T nu; // nu_A + nu_B
+};
+
+typedef BasicCoefficients<Real> Coefficients;
+
+// Coefficients of the float lanes of a mixed precision kernel
+inline BasicCoefficients<float> FloatCoefficients(const Coefficients &c)
+{
+    BasicCoefficients<float> f;
+    f.equilibrium = c.equilibrium;
+    f.activity = PitzerBatch::FloatCoefficients(c.activity);
+    f.nu = c.nu;
+    return f;
+}
+
+// ln(IAP / K_sp) with IAP = (gamma m_mean)^nu, for one vector of cells. The
+// ionic state (m_tot, I, sqrt(I), molality product) is computed once and
+// shared by gamma and the IAP.
+template <typename Salt = PitzerBatch::RuntimeSalt, typename V>
+inline V LogSaturationRatio(const BasicCoefficients<Simd::Element<V> > &c, V T, V yA, V yB, V yEtc1, V yEtc2)
+{
+    const PitzerBatch::IonicState<V> s = PitzerBatch::State<Salt>(c.activity, yA, yB, yEtc1, yEtc2);
+    const V ln_gamma = PitzerBatch::LogActivityCoefficient<Salt>(c.activity, T, s);
+    if constexpr (PitzerBatch::Promoted<V>())
+    {
+        // ln K (~ -20) and ln IAP cancel to ln S ~ 1, so both are taken in
+        // double and only ln S is rounded to float
+        Simd::VecD lo, hi;
+        Simd::Split(Simd::Promote(T), lo, hi);
+        const Simd::WideD lnK = Simd::Join(EquilibriumBatch::LogEquilibrium(c.equilibrium, lo), EquilibriumBatch::LogEquilibrium(c.equilibrium, hi));
+        return Simd::Demote(Simd::Promote(c.nu * ln_gamma) + Simd::Promote(s.lnProduct) - lnK);
+    }
+    else
+    {
+        const V lnK = EquilibriumBatch::LogEquilibrium(c.equilibrium, T);
+        return c.nu * ln_gamma + s.lnProduct - lnK;
+    }
+}
+
+// Saturation index log10(IAP / K_sp) of n cells
+template <typename Salt = PitzerBatch::RuntimeSalt>
+inline void SaturationIndex(const Coefficients &c, const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *SI, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T, V yA, V yB, V yEtc1, V yEtc2)
+              { return LogSaturationRatio<Salt>(c, T, yA, yB, yEtc1, yEtc2) * (Real)M_LOG10E; },
+              SI, n, T, yA, yB, yEtc1, yEtc2);
+}
+
+// Supersaturation ratio IAP / K_sp of n cells
+template <typename Salt = PitzerBatch::RuntimeSalt>
+inline void SaturationRatio(const Coefficients &c, const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *S, int n)
+{
+    typedef Simd::Pack<Real>::V V;
+    Simd::Map([&c](V T, V yA, V yB, V yEtc1, V yEtc2)
+              { return Simd::Exp(LogSaturationRatio<Salt>(c, T, yA, yB, yEtc1, yEtc2)); },
+              S, n, T, yA, yB, yEtc1, yEtc2);
+}
+
+// SaturationIndex of n cells of a double build in float lanes, see
+// PitzerBatch::Promoted()
+template <typename Salt = PitzerBatch::RuntimeSalt>
+inline void SaturationIndexMixed(const BasicCoefficients<float> &c, const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *SI, int n)
+{
+    typedef Simd::VecF V;
+    Simd::MapMixed([&c](V T, V yA, V yB, V yEtc1, V yEtc2)
+                   { return LogSaturationRatio<Salt>(c, T, yA, yB, yEtc1, yEtc2) * (float)M_LOG10E; },
+                   SI, n, T, yA, yB, yEtc1, yEtc2);
+}
+
+// SaturationRatio of n cells of a double build in float lanes
+template <typename Salt = PitzerBatch::RuntimeSalt>
+inline void SaturationRatioMixed(const BasicCoefficients<float> &c, const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *S, int n)
+{
+    typedef Simd::VecF V;
+    Simd::MapMixed([&c](V T, V yA, V yB, V yEtc1, V yEtc2)
+                   { return Simd::Exp(LogSaturationRatio<Salt>(c, T, yA, yB, yEtc1, yEtc2)); },
+                   S, n, T, yA, yB, yEtc1, yEtc2);
+}
+
+// SaturationIndex or SaturationRatio of n cells for one set of coefficients
+typedef void (*Kernel)(const Coefficients &c, const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *out, int n);
+
+// SaturationIndex specialized for the common integer stoichiometries,
+// chosen once when the coefficients are known
+inline Kernel SaturationIndexKernel(Real nu_A, Real nu_B)
+{
+    if (nu_A == 1 && nu_B == 1)
+        return SaturationIndex<PitzerBatch::StoichiometricSalt<1, 1> >;
+    if (nu_A == 1 && nu_B == 2)
+        return SaturationIndex<PitzerBatch::StoichiometricSalt<1, 2> >;
+    if (nu_A == 2 && nu_B == 1)
+        return SaturationIndex<PitzerBatch::StoichiometricSalt<2, 1> >;
+    return SaturationIndex<PitzerBatch::RuntimeSalt>;
+}
+
+}; // namespace SaturationBatch
+
+#endif // SATURATION_BATCH_H
@@ -0,0 +1,82 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SATURATION_MODEL_H
+#define SATURATION_MODEL_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include <cstdlib>
+#include "pitzer_activity_model.h"
+#include "saturation_batch.h"
+
+// Saturation of a mineral from its equilibrium formulation and the Pitzer
+// activity model of its ions, evaluated in one pass over the cells
+template <typename Equilibrium, typename Activity = PitzerActivityModel>
+class SaturationModel
+{
+public:
+    Equilibrium &equilibrium;
+    Activity &activity;
+
+    SaturationModel(Equilibrium &equilibrium, Activity &activity) : equilibrium(equilibrium), activity(activity)
+    {
+    }
+
+    // Saturation index log10(IAP / K_sp) of n cells
+    void SaturationIndex(const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *SI, int n)
+    {
+        SaturationBatch::SaturationIndex<typename Activity::Salt>(BatchCoefficients(), T, yA, yB, yEtc1, yEtc2, SI, n);
+    }
+
+    // Supersaturation ratio IAP / K_sp of n cells
+    void SaturationRatio(const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *S, int n)
+    {
+        SaturationBatch::SaturationRatio<typename Activity::Salt>(BatchCoefficients(), T, yA, yB, yEtc1, yEtc2, S, n);
+    }
+
+    // SaturationIndex of a double build in float lanes
+    void SaturationIndexMixed(const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *SI, int n)
+    {
+        SaturationBatch::SaturationIndexMixed<typename Activity::Salt>(SaturationBatch::FloatCoefficients(BatchCoefficients()), T, yA, yB, yEtc1, yEtc2, SI, n);
+    }
+
+    // SaturationRatio of a double build in float lanes
+    void SaturationRatioMixed(const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *S, int n)
+    {
+        SaturationBatch::SaturationRatioMixed<typename Activity::Salt>(SaturationBatch::FloatCoefficients(BatchCoefficients()), T, yA, yB, yEtc1, yEtc2, S, n);
+    }
+
+    const SaturationBatch::Coefficients BatchCoefficients()
+    {
+        SaturationBatch::Coefficients c;
+        c.equilibrium = equilibrium.BatchCoefficients();
+        c.activity = activity.BatchCoefficients();
+        c.nu = activity.nu_A + activity.nu_B;
+        return c;
+    }
+};
+
+#endif // SATURATION_MODEL_H
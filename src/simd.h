@@ -0,0 +1,394 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "uclib.h"
+#include "math.h"
+
+#define SIMD_SCALAR 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+#define SIMD_AVX512 3
+
+// Instruction set the batch kernels are written for, from the compiler target
+// unless set explicitly before inclusion
+#ifndef SIMD_LEVEL
+#if defined(__AVX512F__)
+#define SIMD_LEVEL SIMD_AVX512
+#elif defined(__AVX2__) && defined(__FMA__)
+#define SIMD_LEVEL SIMD_AVX2
+#elif defined(__SSE2__)
+#define SIMD_LEVEL SIMD_SSE2
+#else
+#define SIMD_LEVEL SIMD_SCALAR
+#endif
+#endif
+
+#if SIMD_LEVEL == SIMD_AVX512
+#define SIMD_BYTES 64
+#elif SIMD_LEVEL == SIMD_AVX2
+#define SIMD_BYTES 32
+#else
+#define SIMD_BYTES 16
+#endif
+
+#if SIMD_LEVEL != SIMD_SCALAR
+#include <immintrin.h>
+#endif
+#include <utility>
+#include <type_traits>
+
+namespace Simd
+{
+
+// Lane types of one vector register: V holds the values, M the comparison
+// masks (all bits set in true lanes) and the bit patterns of V, U the same
+// bits for logical shifts and I one 32 bit index per lane
+template <typename T>
+struct Pack;
+
+template <>
+struct Pack<double>
+{
+    typedef double V __attribute__((vector_size(SIMD_BYTES)));
+    typedef __typeof__(V{} < V{}) M;
+    typedef unsigned long U __attribute__((vector_size(SIMD_BYTES)));
+    typedef int I __attribute__((vector_size(SIMD_BYTES / 2)));
+    static const int WIDTH = SIMD_BYTES / sizeof(double);
+};
+
+template <>
+struct Pack<float>
+{
+    typedef float V __attribute__((vector_size(SIMD_BYTES)));
+    typedef __typeof__(V{} < V{}) M;
+    typedef unsigned int U __attribute__((vector_size(SIMD_BYTES)));
+    typedef int I __attribute__((vector_size(SIMD_BYTES)));
+    static const int WIDTH = SIMD_BYTES / sizeof(float);
+};
+
+// Doubles of as many lanes as VecF, for the terms of float kernels promoted
+// to double. Wider than a register, so GCC notes the ABI of passing it by
+// value, which does not matter for these inline functions.
+#pragma GCC diagnostic ignored "-Wpsabi"
+typedef double WideD __attribute__((vector_size(2 * SIMD_BYTES)));
+
+typedef Pack<double>::V VecD;
+typedef Pack<double>::M MaskD;
+typedef Pack<double>::U UMaskD;
+typedef Pack<double>::I IndexD;
+typedef Pack<float>::V VecF;
+typedef Pack<float>::M MaskF;
+typedef Pack<float>::U UMaskF;
+typedef Pack<float>::I IndexF;
+
+inline VecD Load(const double *p)
+{
+    VecD v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline VecF Load(const float *p)
+{
+    VecF v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void Store(double *p, VecD v)
+{
+    __builtin_memcpy(p, &v, sizeof(v));
+}
+
+inline void Store(float *p, VecF v)
+{
+    __builtin_memcpy(p, &v, sizeof(v));
+}
+
+// Lane type of a vector
+template <typename V>
+using Element = typename std::decay<decltype(std::declval<V>()[0])>::type;
+
+template <typename V, typename T>
+inline V Broadcast(T x)
+{
+    typedef __typeof__(V{}[0]) Element;
+    return V{} + (Element)x;
+}
+
+inline WideD LoadWide(const double *p)
+{
+    WideD v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void Store(double *p, const WideD &v)
+{
+    __builtin_memcpy(p, &v, sizeof(v));
+}
+
+inline WideD Promote(VecF x)
+{
+    return __builtin_convertvector(x, WideD);
+}
+
+inline VecF Demote(const WideD &x)
+{
+    return __builtin_convertvector(x, VecF);
+}
+
+// Low and high halves of a WideD as native vectors, and back
+inline void Split(const WideD &x, VecD &lo, VecD &hi)
+{
+    __builtin_memcpy(&lo, &x, sizeof(lo));
+    __builtin_memcpy(&hi, (const char *)&x + sizeof(lo), sizeof(hi));
+}
+
+inline WideD Join(VecD lo, VecD hi)
+{
+    WideD x;
+    __builtin_memcpy(&x, &lo, sizeof(lo));
+    __builtin_memcpy((char *)&x + sizeof(lo), &hi, sizeof(hi));
+    return x;
+}
+
+inline VecD Min(VecD a, VecD b)
+{
+    return a < b ? a : b;
+}
+
+inline VecF Min(VecF a, VecF b)
+{
+    return a < b ? a : b;
+}
+
+inline VecD Max(VecD a, VecD b)
+{
+    return a > b ? a : b;
+}
+
+inline VecF Max(VecF a, VecF b)
+{
+    return a > b ? a : b;
+}
+
+// x limited to [lo, hi]; unlike Min(Max(x, lo), hi) a NaN stays NaN
+inline VecD Clamp(VecD x, double lo, double hi)
+{
+    return x < lo ? Broadcast<VecD>(lo) : x > hi ? Broadcast<VecD>(hi) : x;
+}
+
+inline VecF Clamp(VecF x, float lo, float hi)
+{
+    return x < lo ? Broadcast<VecF>(lo) : x > hi ? Broadcast<VecF>(hi) : x;
+}
+
+inline VecD Sqrt(VecD x)
+{
+#if SIMD_LEVEL == SIMD_AVX512
+    return _mm512_sqrt_pd(x);
+#elif SIMD_LEVEL == SIMD_AVX2
+    return _mm256_sqrt_pd(x);
+#elif SIMD_LEVEL == SIMD_SSE2
+    return _mm_sqrt_pd(x);
+#else
+    for (int i = 0; i < Pack<double>::WIDTH; i++)
+    {
+        x[i] = sqrt(x[i]);
+    }
+    return x;
+#endif
+}
+
+inline VecF Sqrt(VecF x)
+{
+#if SIMD_LEVEL == SIMD_AVX512
+    return _mm512_sqrt_ps(x);
+#elif SIMD_LEVEL == SIMD_AVX2
+    return _mm256_sqrt_ps(x);
+#elif SIMD_LEVEL == SIMD_SSE2
+    return _mm_sqrt_ps(x);
+#else
+    for (int i = 0; i < Pack<float>::WIDTH; i++)
+    {
+        x[i] = sqrtf(x[i]);
+    }
+    return x;
+#endif
+}
+
+// True if all lanes of the mask are set
+inline bool All(MaskD m)
+{
+#if SIMD_LEVEL == SIMD_AVX512
+    return _mm512_cmpneq_epi64_mask((__m512i)m, _mm512_setzero_si512()) == 0xFF;
+#elif SIMD_LEVEL == SIMD_AVX2
+    return _mm256_movemask_pd((__m256d)m) == 0xF;
+#elif SIMD_LEVEL == SIMD_SSE2
+    return _mm_movemask_pd((__m128d)m) == 0x3;
+#else
+    for (int i = 0; i < Pack<double>::WIDTH; i++)
+    {
+        if (!m[i])
+            return false;
+    }
+    return true;
+#endif
+}
+
+inline bool All(MaskF m)
+{
+#if SIMD_LEVEL == SIMD_AVX512
+    return _mm512_cmpneq_epi32_mask((__m512i)m, _mm512_setzero_si512()) == 0xFFFF;
+#elif SIMD_LEVEL == SIMD_AVX2
+    return _mm256_movemask_ps((__m256)m) == 0xFF;
+#elif SIMD_LEVEL == SIMD_SSE2
+    return _mm_movemask_ps((__m128)m) == 0xF;
+#else
+    for (int i = 0; i < Pack<float>::WIDTH; i++)
+    {
+        if (!m[i])
+            return false;
+    }
+    return true;
+#endif
+}
+
+// p[index] per lane
+inline VecD Gather(const double *p, IndexD index)
+{
+#if SIMD_LEVEL == SIMD_AVX512
+    return _mm512_i32gather_pd((__m256i)index, p, sizeof(double));
+#elif SIMD_LEVEL == SIMD_AVX2
+    return _mm256_i32gather_pd(p, (__m128i)index, sizeof(double));
+#else
+    VecD v;
+    for (int i = 0; i < Pack<double>::WIDTH; i++)
+    {
+        v[i] = p[index[i]];
+    }
+    return v;
+#endif
+}
+
+inline VecF Gather(const float *p, IndexF index)
+{
+#if SIMD_LEVEL == SIMD_AVX512
+    return _mm512_i32gather_ps((__m512i)index, p, sizeof(float));
+#elif SIMD_LEVEL == SIMD_AVX2
+    return _mm256_i32gather_ps(p, (__m256i)index, sizeof(float));
+#else
+    VecF v;
+    for (int i = 0; i < Pack<float>::WIDTH; i++)
+    {
+        v[i] = p[index[i]];
+    }
+    return v;
+#endif
+}
+
+template <typename T, typename F, size_t... K>
+inline void MapRemainder(F &f, T *out, int i, int n, const T *const *in, std::index_sequence<K...>)
+{
+    const int W = Pack<T>::WIDTH;
+    T lanes[sizeof...(K) + 1][W];
+    for (size_t k = 0; k < sizeof...(K); k++)
+    {
+        for (int j = 0; j < W; j++)
+        {
+            lanes[k][j] = in[k][i + j < n ? i + j : n - 1];
+        }
+    }
+    Store(lanes[sizeof...(K)], f(Load(lanes[K])...));
+    for (int j = 0; j < W && i + j < n; j++)
+    {
+        out[i + j] = lanes[sizeof...(K)][j];
+    }
+}
+
+template <typename F, typename Lanes, size_t... K>
+inline void MapMixedRemainder(F &f, double *out, int i, int n, Lanes &lanes, std::index_sequence<K...>)
+{
+    double result[Pack<float>::WIDTH];
+    Store(result, Promote(f(Demote(LoadWide(lanes[K]))...)));
+    for (int j = 0; j < Pack<float>::WIDTH && i + j < n; j++)
+    {
+        out[i + j] = result[j];
+    }
+}
+
+// out[i] = f(in[i]...) for n cells, one vector of cells per call of f. The
+// remainder that does not fill a vector is padded with copies of the last
+// cell and goes through the same lanes, so every cell is computed
+// identically wherever it sits in the arrays.
+template <typename T, typename F, typename... In>
+inline void Map(F f, T *out, int n, const In *... in)
+{
+    const int W = Pack<T>::WIDTH;
+    int i = 0;
+    for (; i + W <= n; i += W)
+    {
+        Store(out + i, f(Load(in + i)...));
+    }
+    if (i < n)
+    {
+        const T *inputs[] = {in...};
+        MapRemainder(f, out, i, n, inputs, std::index_sequence_for<In...>());
+    }
+}
+
+// Map over double arrays with f taking and returning VecF: the cells are
+// converted to float lanes, twice as many per call as VecD, and the results
+// back to double. The remainder is padded as in Map.
+template <typename F, typename... In>
+inline void MapMixed(F f, double *out, int n, const In *... in)
+{
+    const int W = Pack<float>::WIDTH;
+    int i = 0;
+    for (; i + W <= n; i += W)
+    {
+        Store(out + i, Promote(f(Demote(LoadWide(in + i))...)));
+    }
+    if (i < n)
+    {
+        double lanes[sizeof...(In) + 1][W];
+        const double *inputs[] = {in...};
+        for (size_t k = 0; k < sizeof...(In); k++)
+        {
+            for (int j = 0; j < W; j++)
+            {
+                lanes[k][j] = inputs[k][i + j < n ? i + j : n - 1];
+            }
+        }
+        MapMixedRemainder(f, out, i, n, lanes, std::index_sequence_for<In...>());
+    }
+}
+
+}; // namespace Simd
+
+#endif // SIMD_H
@@ -0,0 +1,312 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include "simd.h"
+#include "fast_math.h"
+
+// Vector exp, exp10, log and log10 for the batch kernels. Each takes all
+// lanes through the same instruction sequence, so a cell gets the same result
+// wherever it sits in a batch. Builds with -DSCALE_FAST_MATH=0 evaluate them
+// lane by lane with libm, as the scalar paths of fast_math.h.
+//
+// The double polynomials need FMA to beat libm: in the SSE2 build the Pitzer
+// Activity Coefficient takes 43 ns per cell with them against 34 ns with libm,
+// so double lanes use libm there unless SCALE_FAST_MATH_DOUBLE is set. The
+// float polynomials are faster on every level (12 against 18 ns with SSE2).
+#ifndef SCALE_FAST_MATH_DOUBLE
+#if SCALE_FAST_MATH && SIMD_LEVEL >= SIMD_AVX2
+#define SCALE_FAST_MATH_DOUBLE 1
+#else
+#define SCALE_FAST_MATH_DOUBLE 0
+#endif
+#endif
+
+namespace Simd
+{
+
+// f of every lane of x, for the libm versions
+template <typename V, typename F>
+inline V Lanewise(V x, F f)
+{
+    V y;
+    for (int l = 0; l < (int)(sizeof(V) / sizeof(x[0])); l++)
+        y[l] = f(x[l]);
+    return y;
+}
+
+#if SCALE_FAST_MATH_DOUBLE
+// e^r 2^n for |r| <= ln2 / 2, with n the integer left in the low bits of t
+// by adding shift
+inline VecD ScaleExp(VecD r, VecD t, VecD shift)
+{
+    VecD p = Broadcast<VecD>(1.0 / 6227020800.0);
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    const MaskD k = (MaskD)t - (MaskD)shift;
+    return p * (VecD)((k + 1023) << 52);
+}
+
+// exp(x), arguments are clamped to the normal range of double and NaN is
+// passed through
+inline VecD Exp(VecD x)
+{
+    const VecD shift = Broadcast<VecD>(6755399441055744.0); // 1.5 * 2^52
+    x = Clamp(x, -708.0, 709.0);
+
+    // x = n ln2 + r with |r| <= ln2 / 2
+    const VecD t = x * 1.4426950408889634 + shift;
+    const VecD n = t - shift;
+    const VecD r = (x - n * 6.93147180369123816490e-01) - n * 1.90821492927058770002e-10;
+    return ScaleExp(r, t, shift);
+}
+
+// 10^x, arguments are clamped to the normal range of double and NaN is
+// passed through. The reduction
+// is done in log10 units with a split log10(2), so only the remainder is
+// multiplied by ln10 and x itself is not rounded by it.
+inline VecD Exp10(VecD x)
+{
+    const VecD shift = Broadcast<VecD>(6755399441055744.0);
+    x = Clamp(x, -307.0, 308.0);
+
+    // x = n log10(2) + r / ln10 with |r| <= ln2 / 2
+    const VecD t = x * 3.321928094887362 + shift;
+    const VecD n = t - shift;
+    const VecD r10 = (x - n * 3.0102999566395283e-01) - n * 2.8363394551044964e-14;
+    return ScaleExp(r10 * 2.302585092994046, t, shift);
+}
+
+// log(m) of x = 2^e m with sqrt(1/2) <= m < sqrt(2), e in ed, for positive,
+// normal x. With f = m - 1 and s = f / (2 + f), log(m) = 2 atanh(s) is
+// written as f - (f^2 / 2 - s (f^2 / 2 + R)) with R = 2 (z / 3 + z^2 / 5 + ...),
+// z = s^2 (as fdlibm), so f, exact, carries the result and only the small
+// corrections are rounded.
+inline VecD LogMantissa(VecD x, VecD &ed)
+{
+    const VecD shift = Broadcast<VecD>(6755399441055744.0);
+    const MaskD bits = (MaskD)x;
+
+    MaskD e = (MaskD)((UMaskD)bits >> 52) - 1023;
+    VecD m = (VecD)((bits & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL);
+    const MaskD big = m > 1.4142135623730951;
+    m = big ? m * 0.5 : m;
+    e = e - big;
+    ed = (VecD)(e + (MaskD)shift) - shift;
+
+    const VecD f = m - 1.0;
+    const VecD s = f / (f + 2.0);
+    const VecD z = s * s;
+    VecD p = Broadcast<VecD>(2.0 / 23.0);
+    p = p * z + 2.0 / 21.0;
+    p = p * z + 2.0 / 19.0;
+    p = p * z + 2.0 / 17.0;
+    p = p * z + 2.0 / 15.0;
+    p = p * z + 2.0 / 13.0;
+    p = p * z + 2.0 / 11.0;
+    p = p * z + 2.0 / 9.0;
+    p = p * z + 2.0 / 7.0;
+    p = p * z + 2.0 / 5.0;
+    p = p * z + 2.0 / 3.0;
+    const VecD R = z * p;
+    const VecD hfsq = 0.5 * f * f;
+    return f - (hfsq - s * (hfsq + R));
+}
+
+// Natural logarithm of positive, normal x; NaN is passed through
+inline VecD Log(VecD x)
+{
+    VecD ed;
+    const VecD logM = LogMantissa(x, ed);
+    const VecD y = ed * 6.93147180369123816490e-01 + (logM + ed * 1.90821492927058770002e-10);
+    return x == x ? y : x;
+}
+
+// log10(x) of positive, normal x, e log10(2) split as in Exp10; NaN is
+// passed through
+inline VecD Log10(VecD x)
+{
+    VecD ed;
+    const VecD logM = LogMantissa(x, ed);
+    const VecD y = ed * 3.0102999566395283e-01 + (logM * 0.43429448190325182 + ed * 2.8363394551044964e-14);
+    return x == x ? y : x;
+}
+#else
+inline VecD Exp(VecD x)
+{
+    return Lanewise(x, [](double x) { return exp(x); });
+}
+
+inline VecD Exp10(VecD x)
+{
+    return Lanewise(x, [](double x) { return pow(10.0, x); });
+}
+
+inline VecD Log(VecD x)
+{
+    return Lanewise(x, [](double x) { return log(x); });
+}
+
+inline VecD Log10(VecD x)
+{
+    return Lanewise(x, [](double x) { return log10(x); });
+}
+#endif
+
+#if SCALE_FAST_MATH
+inline VecF ScaleExp(VecF r, VecF t, VecF shift)
+{
+    VecF p = Broadcast<VecF>(1.0f / 5040.0f);
+    p = p * r + 1.0f / 720.0f;
+    p = p * r + 1.0f / 120.0f;
+    p = p * r + 1.0f / 24.0f;
+    p = p * r + 1.0f / 6.0f;
+    p = p * r + 0.5f;
+    p = p * r + 1.0f;
+    p = p * r + 1.0f;
+
+    const MaskF k = (MaskF)t - (MaskF)shift;
+    return p * (VecF)((k + 127) << 23);
+}
+
+// exp(x), arguments are clamped to the normal range of float and NaN is
+// passed through
+inline VecF Exp(VecF x)
+{
+    const VecF shift = Broadcast<VecF>(12582912.0f); // 1.5 * 2^23
+    x = Clamp(x, -87.0f, 88.0f);
+
+    const VecF t = x * 1.44269504f + shift;
+    const VecF n = t - shift;
+    const VecF r = (x - n * 6.93145752e-1f) - n * 1.42860677e-6f;
+    return ScaleExp(r, t, shift);
+}
+
+// 10^x, arguments are clamped to the normal range of float and NaN is
+// passed through
+inline VecF Exp10(VecF x)
+{
+    const VecF shift = Broadcast<VecF>(12582912.0f);
+    x = Clamp(x, -37.0f, 38.0f);
+
+    const VecF t = x * 3.32192809f + shift;
+    const VecF n = t - shift;
+    const VecF r10 = (x - n * 3.01025390625e-1f) - n * 4.60503898e-6f;
+    return ScaleExp(r10 * 2.30258509f, t, shift);
+}
+
+inline VecF LogMantissa(VecF x, VecF &ed)
+{
+    const VecF shift = Broadcast<VecF>(12582912.0f);
+    const MaskF bits = (MaskF)x;
+
+    MaskF e = (MaskF)((UMaskF)bits >> 23) - 127;
+    VecF m = (VecF)((bits & 0x007FFFFF) | 0x3F800000);
+    const MaskF big = m > 1.41421356f;
+    m = big ? m * 0.5f : m;
+    e = e - big;
+    ed = (VecF)(e + (MaskF)shift) - shift;
+
+    const VecF f = m - 1.0f;
+    const VecF s = f / (f + 2.0f);
+    const VecF z = s * s;
+    VecF p = Broadcast<VecF>(2.0f / 11.0f);
+    p = p * z + 2.0f / 9.0f;
+    p = p * z + 2.0f / 7.0f;
+    p = p * z + 2.0f / 5.0f;
+    p = p * z + 2.0f / 3.0f;
+    const VecF R = z * p;
+    const VecF hfsq = 0.5f * f * f;
+    return f - (hfsq - s * (hfsq + R));
+}
+
+inline VecF Log(VecF x)
+{
+    VecF ed;
+    const VecF logM = LogMantissa(x, ed);
+    const VecF y = ed * 6.93145752e-1f + (logM + ed * 1.42860677e-6f);
+    return x == x ? y : x;
+}
+
+inline VecF Log10(VecF x)
+{
+    VecF ed;
+    const VecF logM = LogMantissa(x, ed);
+    const VecF y = ed * 3.01025390625e-1f + (logM * 0.434294482f + ed * 4.60503898e-6f);
+    return x == x ? y : x;
+}
+#else
+inline VecF Exp(VecF x)
+{
+    return Lanewise(x, [](float x) { return expf(x); });
+}
+
+inline VecF Exp10(VecF x)
+{
+    return Lanewise(x, [](float x) { return powf(10.0f, x); });
+}
+
+inline VecF Log(VecF x)
+{
+    return Lanewise(x, [](float x) { return logf(x); });
+}
+
+inline VecF Log10(VecF x)
+{
+    return Lanewise(x, [](float x) { return log10f(x); });
+}
+#endif
+
+// Promoted float lanes, two native double vectors
+inline WideD Exp(const WideD &x)
+{
+    VecD lo, hi;
+    Split(x, lo, hi);
+    return Join(Exp(lo), Exp(hi));
+}
+
+inline WideD Log(const WideD &x)
+{
+    VecD lo, hi;
+    Split(x, lo, hi);
+    return Join(Log(lo), Log(hi));
+}
+
+}; // namespace Simd
+
+#endif // SIMD_MATH_H
@@ -28,6 +28,7 @@ SOFTWARE.
 #include "chemistry.h"
 #include "uclib.h"
 #include "math.h"
+#include "fast_math.h"
 #include <cstdlib>
 
 class SimpleReaction
@@ -64,7 +65,7 @@ public:
     // Total Concentration
     const Real TotalMolality(Real &yEtc1, Real &yEtc2)
     {
-        return pow(ChemistryFunctions::MolarMassOfWater() / (1 - (yEtc1 + yEtc2)) + SMALL, -1);
+        return Math::IntPow<-1>(ChemistryFunctions::MolarMassOfWater() / (1 - (yEtc1 + yEtc2)) + SMALL);
     }
 
     // Returns Mean molality
@@ -77,7 +78,7 @@ public:
     // Mean Concentration
     const Real MeanMolality(Real mA, Real mB)
     {
-        return pow(pow(fmax(mA, SMALL), nu_A) * pow(fmax(mB, SMALL), nu_B) + SMALL, 1.0 / nu());
+        return Math::Pow(Math::Pow(fmax(mA, SMALL), nu_A) * Math::Pow(fmax(mB, SMALL), nu_B) + SMALL, 1.0 / nu());
     }
 };
 
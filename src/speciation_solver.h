@@ -0,0 +1,309 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SPECIATION_SOLVER_H
+#define SPECIATION_SOLVER_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include "fast_math.h"
+#include <cstdlib>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "activity_model.h"
+#include "simple_reaction.h"
+#include "equilibrium_formulation.h"
+#include "hoff_equilibrium.h"
+
+// Aqueous complex of the components of a SpeciationSolver,
+// m = K prod (gamma_j m_j)^nu_j a_H^hydrogen / gamma
+struct AqueousComplex
+{
+    std::string name;
+    std::vector<int> nu; // per component
+    int hydrogen;        // H+ taken up, from the fixed pH of the cell
+    int charge;
+    HoffEquilibrium formation;
+};
+
+// Aqueous speciation of each cell by Newton's method on the mass balances of
+// the components, in the unknowns ln m_j of the free components. The first
+// two components are the cation and anion of reaction, whose activity model
+// gives gamma of every charged species, ln gamma_z = z^2 / |Z_A Z_B| ln
+// gamma_+-, lagged by one iteration.
+//
+// The converged free fractions ln(m_j / m_j,total) of every cell are kept in
+// an arena indexed by the position of the cell in the arrays and start the
+// next solve of that cell from its new totals, so a flow that barely changes
+// between iterations needs one or two Newton steps. The arena is reallocated, and every cell cold started from the
+// totals, when the number of cells changes.
+//
+// The inputs of a pass are T, the mass fractions of the two first components,
+// the spectator mass fractions yEtc_1-, yEtc_2-, the mass fractions of the
+// other components and the pH if any complex takes up H+. The outputs are
+// the saturation index of the mineral of reaction from the free ions, the
+// free molalities of the components and the molalities of the complexes.
+class SpeciationSolver
+{
+public:
+    static const int MAX_COMPONENTS = 4;
+    static const int MAX_COMPLEXES = 8;
+    static const int MAX_OUTPUTS = 1 + MAX_COMPONENTS + MAX_COMPLEXES;
+
+    struct Statistics
+    {
+        std::atomic<long> solves;          // cells solved
+        std::atomic<long> coldStarts;      // cells started from the totals
+        std::atomic<long> warmIterations;  // Newton steps of the warm started cells
+        std::atomic<long> coldIterations;  // Newton steps of the cold started cells
+        std::atomic<long> failures;        // cells not converged in maxIterations
+        std::atomic<long> reallocations;   // arena reallocated for a new size
+    } statistics = {};
+
+    SimpleReaction &reaction;
+    ActivityModel &activity;
+    EquilibriumFormulation &mineral;
+
+    // Components, the cation and anion of reaction first
+    std::vector<std::string> component;
+    std::vector<int> charge;
+
+    std::vector<AqueousComplex> complexes;
+
+    // Max relative residual of the mass balances
+    Real tolerance = 1e-8;
+    int maxIterations = 50;
+
+    SpeciationSolver(SimpleReaction &reaction, ActivityModel &activity, EquilibriumFormulation &mineral,
+                     const std::string &cation, const std::string &anion) : reaction(reaction), activity(activity), mineral(mineral),
+                                                                            component{cation, anion}, charge{(int)reaction.Z_A, (int)reaction.Z_B}
+    {
+    }
+
+    void AddComponent(const std::string &name, int z)
+    {
+        component.push_back(name);
+        charge.push_back(z);
+    }
+
+    // Complex of the components with the given stoichiometry, formation
+    // constant log_k at T0 and enthalpy delta_h in J/mol
+    void AddComplex(const std::string &name, const std::vector<int> &nu, int hydrogen, Real log_k, Real delta_h)
+    {
+        int z = hydrogen;
+        for (size_t j = 0; j < nu.size(); j++)
+            z += nu[j] * charge[j];
+        complexes.push_back(AqueousComplex{name, nu, hydrogen, z, HoffEquilibrium(log_k, delta_h, ChemistryFunctions::T0())});
+        complexes.back().nu.resize(MAX_COMPONENTS, 0);
+    }
+
+    const int Components() const
+    {
+        return (int)component.size();
+    }
+
+    const bool FixedPH() const
+    {
+        for (const AqueousComplex &complex : complexes)
+        {
+            if (complex.hydrogen != 0)
+                return true;
+        }
+        return false;
+    }
+
+    const int Inputs() const
+    {
+        return 3 + Components() + (FixedPH() ? 1 : 0);
+    }
+
+    const int Outputs() const
+    {
+        return 1 + Components() + (int)complexes.size();
+    }
+
+    // Arena for a call of size cells, reallocated when the size changes.
+    // Called before the cells of a call are split between threads.
+    void Prepare(int size)
+    {
+        if (size == cells)
+            return;
+        cells = size;
+        for (int j = 0; j < Components(); j++)
+            arena[j].assign(size, 0);
+        warm.assign(size, 0);
+        statistics.reallocations++;
+    }
+
+    // Speciation of the cells [begin, end) of the call prepared last
+    void Solve(const Real *const *inputs, Real *const *outputs, int begin, int end)
+    {
+        const int C = Components();
+        const int N = (int)complexes.size();
+        const bool fixedPH = FixedPH();
+        long coldStarts = 0, warmIterations = 0, coldIterations = 0, failures = 0;
+
+        for (int i = begin; i < end; i++)
+        {
+            Real T = inputs[0][i];
+            Real yEtc1 = inputs[3][i];
+            Real yEtc2 = inputs[4][i];
+            const Real mTot = reaction.TotalMolality(yEtc1, yEtc2);
+            const Real lnH = fixedPH ? -M_LN10 * inputs[3 + C][i] : 0;
+
+            double total[MAX_COMPONENTS], u[MAX_COMPONENTS];
+            for (int j = 0; j < C; j++)
+            {
+                total[j] = fmax(inputs[j < 2 ? 1 + j : 3 + j][i] * mTot, reaction.SMALL);
+                u[j] = Math::Log(total[j]) + (warm[i] ? arena[j][i] : 0);
+            }
+            double lnK[MAX_COMPLEXES];
+            for (int k = 0; k < N; k++)
+                lnK[k] = Math::Log(complexes[k].formation.Equilibrium(T)) + complexes[k].hydrogen * lnH;
+
+            const bool cold = !warm[i];
+            double m[MAX_COMPONENTS], mComplex[MAX_COMPLEXES], lnGamma2;
+            int iterations = 0;
+            bool converged = false;
+            for (;;)
+            {
+                for (int j = 0; j < C; j++)
+                    m[j] = Math::Exp(u[j]);
+                lnGamma2 = LogGammaPerCharge2(T, m[0] / mTot, m[1] / mTot, yEtc1, yEtc2);
+
+                double R[MAX_COMPONENTS];
+                for (int j = 0; j < C; j++)
+                    R[j] = m[j] - total[j];
+                for (int k = 0; k < N; k++)
+                {
+                    const AqueousComplex &complex = complexes[k];
+                    double lnM = lnK[k] - complex.charge * complex.charge * lnGamma2;
+                    for (int j = 0; j < C; j++)
+                        lnM += complex.nu[j] * (u[j] + charge[j] * charge[j] * lnGamma2);
+                    mComplex[k] = Math::Exp(lnM);
+                    for (int j = 0; j < C; j++)
+                        R[j] += complex.nu[j] * mComplex[k];
+                }
+
+                converged = true;
+                for (int j = 0; j < C; j++)
+                    converged &= fabs(R[j]) <= tolerance * total[j];
+                if (converged || iterations == maxIterations)
+                    break;
+
+                // J_jl = d R_j / d u_l = m_j delta_jl + sum_k nu_kj nu_kl m_k,
+                // symmetric positive definite
+                double J[MAX_COMPONENTS][MAX_COMPONENTS];
+                for (int j = 0; j < C; j++)
+                {
+                    for (int l = 0; l < C; l++)
+                    {
+                        J[j][l] = j == l ? m[j] : 0;
+                        for (int k = 0; k < N; k++)
+                            J[j][l] += complexes[k].nu[j] * complexes[k].nu[l] * mComplex[k];
+                    }
+                }
+                double du[MAX_COMPONENTS];
+                SolveSymmetric(J, R, du, C);
+                for (int j = 0; j < C; j++)
+                    u[j] -= fmax(fmin(du[j], MAX_STEP), -MAX_STEP);
+                iterations++;
+            }
+
+            for (int j = 0; j < C; j++)
+                arena[j][i] = u[j] - Math::Log(total[j]);
+            warm[i] = converged;
+            coldStarts += cold;
+            (cold ? coldIterations : warmIterations) += iterations;
+            failures += !converged;
+
+            // log10(gamma_A^nu_A m_A^nu_A gamma_B^nu_B m_B^nu_B / K)
+            const double lnIAP = reaction.nu_A * (u[0] + charge[0] * charge[0] * lnGamma2) + reaction.nu_B * (u[1] + charge[1] * charge[1] * lnGamma2);
+            outputs[0][i] = (lnIAP - Math::Log(mineral.Equilibrium(T))) * M_LOG10E;
+            for (int j = 0; j < C; j++)
+                outputs[1 + j][i] = m[j];
+            for (int k = 0; k < N; k++)
+                outputs[1 + C + k][i] = mComplex[k];
+        }
+
+        statistics.solves += end - begin;
+        statistics.coldStarts += coldStarts;
+        statistics.warmIterations += warmIterations;
+        statistics.coldIterations += coldIterations;
+        statistics.failures += failures;
+    }
+
+private:
+    // Largest change of ln m_j in one Newton step
+    static constexpr double MAX_STEP = 4;
+
+    int cells = -1;
+    std::vector<double> arena[MAX_COMPONENTS];
+    std::vector<unsigned char> warm;
+
+    // ln gamma of a species of charge 1 (ln gamma_z = z^2 of it), from the
+    // mean activity coefficient of reaction at the free molalities
+    const double LogGammaPerCharge2(Real T, Real yA, Real yB, Real yEtc1, Real yEtc2)
+    {
+        return Math::Log(activity.ActivityCoefficient(T, yA, yB, yEtc1, yEtc2)) / fabs(reaction.Z_A * reaction.Z_B);
+    }
+
+    // x = J^-1 b by Cholesky decomposition
+    static void SolveSymmetric(double J[MAX_COMPONENTS][MAX_COMPONENTS], const double *b, double *x, int n)
+    {
+        double L[MAX_COMPONENTS][MAX_COMPONENTS] = {};
+        for (int j = 0; j < n; j++)
+        {
+            double d = J[j][j];
+            for (int k = 0; k < j; k++)
+                d -= L[j][k] * L[j][k];
+            L[j][j] = sqrt(fmax(d, 1e-300));
+            for (int i = j + 1; i < n; i++)
+            {
+                double s = J[i][j];
+                for (int k = 0; k < j; k++)
+                    s -= L[i][k] * L[j][k];
+                L[i][j] = s / L[j][j];
+            }
+        }
+        for (int i = 0; i < n; i++)
+        {
+            double s = b[i];
+            for (int k = 0; k < i; k++)
+                s -= L[i][k] * x[k];
+            x[i] = s / L[i][i];
+        }
+        for (int i = n - 1; i >= 0; i--)
+        {
+            double s = x[i];
+            for (int k = i + 1; k < n; k++)
+                s -= L[k][i] * x[k];
+            x[i] = s / L[i][i];
+        }
+    }
+};
+
+#endif // SPECIATION_SOLVER_H
@@ -0,0 +1,111 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef STATIC_PITZER_ACTIVITY_MODEL_H
+#define STATIC_PITZER_ACTIVITY_MODEL_H
+
+#include "chemistry.h"
+#include "uclib.h"
+#include "math.h"
+#include "fast_math.h"
+#include <cstdlib>
+#include "pitzer_activity_model.h"
+#include "pitzer_batch.h"
+
+// PitzerActivityModel of a salt with integer stoichiometry, charges and
+// alphas fixed at compile time. The powers of the molalities become
+// multiplies and the constant factors fold, in the scalar and batch paths.
+template <int NU_A, int NU_B, int CHARGE_A, int CHARGE_B, typename Alphas = PitzerBatch::Alphas22>
+class StaticPitzerActivityModel final : public PitzerActivityModel
+{
+public:
+    typedef PitzerBatch::StaticSalt<NU_A, NU_B, CHARGE_A, CHARGE_B, Alphas> Salt;
+
+    static constexpr Real NU_A_VALUE = NU_A;
+    static constexpr Real NU_B_VALUE = NU_B;
+    static constexpr Real Z_A_VALUE = CHARGE_A;
+    static constexpr Real Z_B_VALUE = CHARGE_B;
+
+    StaticPitzerActivityModel(const Real &beta_0,
+                              const Real &beta_1,
+                              const Real &beta_2,
+                              const Real &C_Phi) : PitzerActivityModel(NU_A_VALUE, NU_B_VALUE, Z_A_VALUE, Z_B_VALUE,
+                                                                       beta_0, beta_1, beta_2, C_Phi,
+                                                                       Alphas::alpha_1, Alphas::alpha_2, Alphas::b)
+    {
+    }
+
+    // Activity Coeffiecient (gamma)
+    const Real ActivityCoefficient(Real T, Real yA, Real yB, Real yEtc1, Real yEtc2) override
+    {
+        const Real mTot = 1 / (ChemistryFunctions::MolarMassOfWater() / (1 - (yEtc1 + yEtc2)) + SMALL);
+        const Real I = fmax(0.5 * (yEtc1 * mTot + 4 * (yEtc2 * mTot)), ChemistryFunctions::SmallIonicStrength());
+        if (I < SMALL)
+            return 1;
+
+        const Real product = PitzerBatch::IntPow<NU_A>(fmax(yA * mTot, SMALL)) * PitzerBatch::IntPow<NU_B>(fmax(yB * mTot, SMALL)) + SMALL;
+        const Real meanMolality = Math::Root<Salt::NU>(product);
+
+        const Real sqrtI = sqrt(I);
+        const Real A = DebyeHuckelParam(T);
+        Real B_gamma = 2 * beta_0;
+        if (beta_1 != 0)
+            B_gamma += BetaTerm(beta_1, Alphas::alpha_1, I, sqrtI);
+        if (beta_2 != 0)
+            B_gamma += BetaTerm(beta_2, Alphas::alpha_2, I, sqrtI);
+
+        const Real f_gamma = -A / 3 * (sqrtI / (1 + Alphas::b * sqrtI) + 2 / Alphas::b * Math::Log(1 + Alphas::b * sqrtI));
+        const Real C_gamma = 1.5 * C_Phi;
+
+        const Real ln_gamma = Salt::Z_AB_VALUE * f_gamma + meanMolality * Salt::B_FACTOR * B_gamma + meanMolality * meanMolality * Salt::C_FACTOR * C_gamma;
+        return Math::Exp(ln_gamma);
+    }
+
+    // Activity Coeffiecients (gamma) of n cells
+    void ActivityCoefficient(const Real *T, const Real *yA, const Real *yB, const Real *yEtc1, const Real *yEtc2, Real *gamma, int n) override
+    {
+        PitzerBatch::ActivityCoefficient<Salt>(BatchCoefficients(), T, yA, yB, yEtc1, yEtc2, gamma, n);
+    }
+
+    // Activity Coeffiecients (gamma) of n cells of a double build in float lanes
+    void ActivityCoefficientMixed(const double *T, const double *yA, const double *yB, const double *yEtc1, const double *yEtc2, double *gamma, int n) override
+    {
+        PitzerBatch::ActivityCoefficientMixed<Salt>(PitzerBatch::FloatCoefficients(BatchCoefficients()), T, yA, yB, yEtc1, yEtc2, gamma, n);
+    }
+
+    // Derivatives of gamma, see PitzerActivityModel
+    void ActivityCoefficientDerivatives(const Real *const *inputs, Real *const *derivatives, int begin, int end) override
+    {
+        PitzerBatch::ActivityCoefficientDerivatives<Salt>(BatchCoefficients(), inputs, derivatives, begin, end);
+    }
+
+private:
+    // 2 beta / (alpha^2 I) (1 - (1 + alpha sqrt(I) - alpha^2 I / 2) exp(-alpha sqrt(I)))
+    static Real BetaTerm(Real beta, Real alpha, Real I, Real sqrtI)
+    {
+        return 2 * beta / ((alpha * alpha) * I) * (1 - (1 + alpha * sqrtI - 0.5 * (alpha * alpha) * I) * Math::Exp(-alpha * sqrtI));
+    }
+};
+
+#endif // STATIC_PITZER_ACTIVITY_MODEL_H
@@ -0,0 +1,197 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TEMPORAL_CACHE_H
+#define TEMPORAL_CACHE_H
+
+#include "uclib.h"
+#include "math.h"
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+// Results of a field function of D inputs kept per cell between calls. A cell
+// whose inputs are all within a relative tolerance of the inputs that produced
+// its stored result takes that result; the other cells are gathered into
+// contiguous arrays, computed in one batch and scattered back into the store.
+// The stored inputs only change when a cell is recomputed, so slow drift
+// cannot accumulate past the tolerance.
+//
+// The store of a call is found by its layout, the input array pointers and
+// the cell count. Solvers may call a field function for several partitions or
+// regions, so a few layouts are kept and the least recently used is replaced
+// by a new one, whose cells then all start cold.
+template <int D>
+class TemporalCache
+{
+public:
+    struct Statistics
+    {
+        std::atomic<long> calls;
+        std::atomic<long> cells;
+        std::atomic<long> reused;
+        std::atomic<long> layouts; // stores started cold for a new layout
+    } statistics = {};
+
+    struct Layout
+    {
+        const Real *key[D];
+        int size;
+        long used;                 // call count of the last use
+        std::vector<Real> inputs;  // input k of cell i at k * size + i
+        std::vector<Real> outputs;
+    };
+
+    Real tolerance = 1e-6;
+
+    void Configure(Real tolerance, int layouts)
+    {
+        this->tolerance = tolerance;
+        this->layouts.resize(layouts > 0 ? layouts : 1);
+        for (Layout &layout : this->layouts)
+        {
+            layout.size = -1;
+            layout.used = -1;
+        }
+    }
+
+    // Store of the layout of the input arrays, replacing the least recently
+    // used one when it is new. Called once per call, before the cells.
+    Layout &Find(const Real *const *input, int size)
+    {
+        const long call = statistics.calls++;
+        statistics.cells += size;
+        Layout *oldest = &layouts[0];
+        for (Layout &layout : layouts)
+        {
+            if (layout.size == size && memcmp(layout.key, input, sizeof(layout.key)) == 0)
+            {
+                layout.used = call;
+                return layout;
+            }
+            if (layout.used < oldest->used)
+                oldest = &layout;
+        }
+
+        // NaN inputs match nothing, so every cell is computed on first use
+        Layout &layout = *oldest;
+        memcpy(layout.key, input, sizeof(layout.key));
+        layout.size = size;
+        layout.used = call;
+        layout.inputs.assign((size_t)D * size, NAN);
+        layout.outputs.assign(size, 0);
+        statistics.layouts++;
+        return layout;
+    }
+
+    // result of the cells [begin, end), from the store where the inputs are
+    // unchanged and from evaluate(inputs, outputs, n) on the compacted others.
+    // Threads may evaluate disjoint ranges of the same layout concurrently.
+    template <typename F>
+    void Evaluate(Layout &layout, const Real *const *input, Real *result, int begin, int end, F evaluate)
+    {
+        thread_local std::vector<int> changed;
+        thread_local std::vector<Real> gathered;
+        changed.resize(end - begin);
+
+        // Every cell takes its stored result, overwritten below if it changed
+        const int size = layout.size;
+        int n = 0;
+        for (int i = begin; i < end; i++)
+        {
+            bool same = true;
+            for (int k = 0; k < D; k++)
+            {
+                const Real previous = layout.inputs[(size_t)k * size + i];
+                same &= fabs(input[k][i] - previous) <= tolerance * fabs(previous);
+            }
+            result[i] = layout.outputs[i];
+            changed[n] = i;
+            n += !same;
+        }
+        statistics.reused += end - begin - n;
+        if (n == 0)
+            return;
+
+        // All changed: compute in place, no gathering needed
+        if (n == end - begin)
+        {
+            const Real *offset[D];
+            for (int k = 0; k < D; k++)
+            {
+                offset[k] = input[k] + begin;
+            }
+            evaluate(offset, result + begin, n);
+            for (int k = 0; k < D; k++)
+            {
+                memcpy(&layout.inputs[(size_t)k * size + begin], input[k] + begin, n * sizeof(Real));
+            }
+            memcpy(&layout.outputs[begin], result + begin, n * sizeof(Real));
+            return;
+        }
+
+        gathered.resize((size_t)(D + 1) * n);
+        const Real *compacted[D];
+        for (int k = 0; k < D; k++)
+        {
+            Real *x = &gathered[(size_t)k * n];
+            for (int j = 0; j < n; j++)
+            {
+                x[j] = input[k][changed[j]];
+            }
+            compacted[k] = x;
+        }
+        Real *y = &gathered[(size_t)D * n];
+        evaluate(compacted, y, n);
+        for (int j = 0; j < n; j++)
+        {
+            const int i = changed[j];
+            result[i] = y[j];
+            layout.outputs[i] = y[j];
+        }
+        for (int k = 0; k < D; k++)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                layout.inputs[(size_t)k * size + changed[j]] = compacted[k][j];
+            }
+        }
+    }
+
+    // Bytes held by the stores
+    size_t Bytes() const
+    {
+        size_t bytes = 0;
+        for (const Layout &layout : layouts)
+        {
+            bytes += (layout.inputs.capacity() + layout.outputs.capacity()) * sizeof(Real);
+        }
+        return bytes;
+    }
+
+private:
+    std::vector<Layout> layouts;
+};
+
+#endif // TEMPORAL_CACHE_H
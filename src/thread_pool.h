@@ -0,0 +1,221 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "uclib.h"
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads that splits the cell range of a field
+// function call. The calling thread takes part, so threads = 1 is serial.
+// Cells are handed out in chunks that are a multiple of CHUNK_ALIGN cells from
+// a shared counter; since the batch kernels compute every cell identically
+// wherever it sits in the arrays, the results do not depend on the split.
+class ThreadPool
+{
+public:
+    static const int CHUNK_ALIGN = 64;
+
+    ThreadPool() : threads(1), minCells(0), generation(0), busy(0), stopping(false)
+    {
+    }
+
+    ~ThreadPool()
+    {
+        Stop();
+    }
+
+    // Starts threads - 1 workers. When pin is set, the calling thread and the
+    // workers are pinned one per CPU of the process's affinity mask, from its
+    // first-th CPU on, so that processes sharing a mask can take disjoint
+    // CPUs. Ranges below minCells stay serial.
+    void Start(int threads, int minCells, bool pin, int first)
+    {
+        Stop();
+        this->threads = threads > 1 ? threads : 1;
+        this->minCells = minCells;
+
+        cpu_set_t allowed;
+        std::vector<int> cpus;
+        if (pin && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            }
+        }
+
+        if (!cpus.empty())
+        {
+            Pin(pthread_self(), cpus[first % cpus.size()]);
+        }
+        for (int t = 1; t < this->threads; t++)
+        {
+            workers.push_back(std::thread(&ThreadPool::Work, this, t));
+            if (!cpus.empty())
+            {
+                Pin(workers.back().native_handle(), cpus[(first + t) % cpus.size()]);
+            }
+        }
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t t = 0; t < workers.size(); t++)
+        {
+            workers[t].join();
+        }
+        workers.clear();
+        stopping = false;
+        threads = 1;
+    }
+
+    const int Threads() const
+    {
+        return threads;
+    }
+
+    // Index of the calling thread: 0 for the thread that calls ParallelFor,
+    // 1 to Threads() - 1 for the workers
+    static int Index()
+    {
+        return index;
+    }
+
+    // f(begin, end) over [0, n), on the pool when n >= minCells
+    template <typename F>
+    void ParallelFor(int n, F f)
+    {
+        if (threads == 1 || n < minCells)
+        {
+            f(0, n);
+            return;
+        }
+
+        int chunk = (n / (4 * threads) + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+        Job job = {&Invoke<F>, &f, n, chunk > 0 ? chunk : CHUNK_ALIGN};
+        next = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = job;
+            busy = threads - 1;
+            generation++;
+        }
+        wake.notify_all();
+
+        Run(job);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]
+                  { return busy == 0; });
+    }
+
+private:
+    struct Job
+    {
+        void (*invoke)(void *, int, int);
+        void *f;
+        int n;
+        int chunk;
+    };
+
+    int threads;
+    int minCells;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    Job current;
+    long generation;
+    int busy;
+    bool stopping;
+    std::atomic<long> next; // wider than n, which every thread passes once by a chunk
+    static inline thread_local int index = 0;
+
+    static void Pin(pthread_t thread, int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(thread, sizeof(set), &set);
+    }
+
+    template <typename F>
+    static void Invoke(void *f, int begin, int end)
+    {
+        (*(F *)f)(begin, end);
+    }
+
+    void Run(const Job &job)
+    {
+        while (true)
+        {
+            const long begin = next.fetch_add(job.chunk);
+            if (begin >= job.n)
+                break;
+            job.invoke(job.f, (int)begin, begin + job.chunk < job.n ? (int)(begin + job.chunk) : job.n);
+        }
+    }
+
+    void Work(int t)
+    {
+        index = t;
+        long seen = 0;
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen]
+                          { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                job = current;
+            }
+
+            Run(job);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+};
+
+#endif // THREAD_POOL_H
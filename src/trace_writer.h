@@ -0,0 +1,238 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TRACE_WRITER_H
+#define TRACE_WRITER_H
+
+#include "uclib.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary trace of the inputs of field function calls, replayed by
+// tools/uclib_host.cpp --replay. The file starts with a TraceHeader, then
+// records follow, each a TraceRecord and its payload padded to 8 bytes, so
+// the arrays of a memory-mapped trace are aligned for their type:
+//   TRACE_FUNCTION  the NUL-terminated name of function id, with its
+//                   number of arguments
+//   TRACE_CALL      a call of function id on size cells: arguments arrays
+//                   of size Reals, one after the other
+struct TraceHeader
+{
+    char magic[8]; // "SCALETR"
+    uint32_t version;
+    uint32_t realSize; // sizeof(Real) of the library that wrote it
+};
+
+struct TraceRecord
+{
+    uint32_t type;
+    uint32_t function;
+    int32_t size;      // cells of a call, bytes of a name
+    uint32_t arguments;
+};
+
+enum
+{
+    TRACE_VERSION = 1,
+    TRACE_FUNCTION = 1,
+    TRACE_CALL = 2
+};
+
+// Appends records to a trace file without blocking the calling solver
+// thread on the disk: records are copied into chunks that a background
+// thread writes. Beyond maxBytes of unwritten chunks, calls are dropped
+// (and counted) rather than waited for. Close() before the process exits,
+// which joins the thread.
+class TraceWriter
+{
+public:
+    struct Statistics
+    {
+        std::atomic<long> calls{0};
+        std::atomic<long> dropped{0};
+        std::atomic<long> bytes{0};
+    };
+
+    static const size_t CHUNK = 8 << 20;
+
+    Statistics statistics;
+    std::string path;
+
+    // Starts the trace at path; false if the file cannot be created
+    bool Open(const std::string &path, size_t maxBytes)
+    {
+        file = fopen(path.c_str(), "wb");
+        if (file == NULL)
+            return false;
+        this->path = path;
+        this->maxBytes = maxBytes;
+        chunk = maxBytes / 4 < CHUNK ? maxBytes / 4 : CHUNK;
+        TraceHeader header = {};
+        strcpy(header.magic, "SCALETR");
+        header.version = TRACE_VERSION;
+        header.realSize = sizeof(Real);
+        current.reserve(chunk);
+        Append(&header, sizeof(header));
+        writer = std::thread([this]()
+                             { Write(); });
+        return true;
+    }
+
+    bool IsOpen() const
+    {
+        return file != NULL;
+    }
+
+    // Id of a function of the given number of arguments for Call
+    int Function(const char *name, int arguments)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const int id = functions++;
+        const TraceRecord record = {TRACE_FUNCTION, (uint32_t)id, (int32_t)strlen(name) + 1, (uint32_t)arguments};
+        Append(&record, sizeof(record));
+        Append(name, record.size);
+        Pad();
+        return id;
+    }
+
+    // Records a call of function on size cells with the given inputs
+    void Call(int function, int size, const Real *const *inputs, int arguments)
+    {
+        const size_t bytes = sizeof(TraceRecord) + Padded((size_t)arguments * size * sizeof(Real));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending + current.size() + bytes > maxBytes)
+        {
+            statistics.dropped++;
+            return;
+        }
+        const TraceRecord record = {TRACE_CALL, (uint32_t)function, size, (uint32_t)arguments};
+        Append(&record, sizeof(record));
+        for (int k = 0; k < arguments; k++)
+        {
+            Append(inputs[k], size * sizeof(Real));
+        }
+        Pad();
+        statistics.calls++;
+        if (current.size() >= chunk)
+            Flush();
+    }
+
+    // Writes what is left and closes the file
+    void Close()
+    {
+        if (file == NULL)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Flush();
+            stopping = true;
+        }
+        ready.notify_one();
+        writer.join();
+        fclose(file);
+        file = NULL;
+    }
+
+private:
+    FILE *file = NULL;
+    size_t maxBytes = 0;
+    size_t chunk = CHUNK; // bytes handed to the thread at once
+    int functions = 0;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<char> current;            // chunk being filled
+    std::deque<std::vector<char> > full;  // chunks to write, oldest first
+    std::vector<std::vector<char> > spare; // written chunks for reuse
+    size_t pending = 0;                   // bytes of the full chunks
+    bool stopping = false;
+
+    static size_t Padded(size_t bytes)
+    {
+        return (bytes + 7) & ~(size_t)7;
+    }
+
+    void Append(const void *data, size_t bytes)
+    {
+        const char *p = (const char *)data;
+        current.insert(current.end(), p, p + bytes);
+    }
+
+    void Pad()
+    {
+        current.resize(Padded(current.size()), 0);
+    }
+
+    // Hands the current chunk to the writer thread, with the lock held
+    void Flush()
+    {
+        if (current.empty())
+            return;
+        pending += current.size();
+        full.push_back(std::move(current));
+        if (spare.empty())
+        {
+            current = std::vector<char>();
+            current.reserve(chunk);
+        }
+        else
+        {
+            current = std::move(spare.back());
+            spare.pop_back();
+        }
+        ready.notify_one();
+    }
+
+    void Write()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            ready.wait(lock, [this]()
+                       { return stopping || !full.empty(); });
+            if (full.empty())
+                return;
+            std::vector<char> data = std::move(full.front());
+            full.pop_front();
+            lock.unlock();
+            fwrite(data.data(), 1, data.size(), file);
+            lock.lock();
+            statistics.bytes += data.size();
+            pending -= data.size();
+            data.clear();
+            if (data.capacity() <= CHUNK)
+                spare.push_back(std::move(data));
+        }
+    }
+};
+
+#endif // TRACE_WRITER_H
@@ -0,0 +1,377 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Accuracy of the FastMath functions (src/fast_math.h) against libm.
+//
+// The scalar functions and their vector counterparts of simd_math.h, which
+// the batch kernels call, are checked separately against their own bounds.
+// Float arguments are checked exhaustively over the domain of each function
+// against the double libm result; double arguments are sampled, uniformly
+// and over every binade of the domain, against the long double libm result.
+// Errors are in ulp of the correctly rounded result. The run fails if a
+// function exceeds the bound documented in fast_math.h.
+//
+// Build:
+//   g++ -O3 -pthread -Isrc tools/fast_math_accuracy.cpp -o fast_math_accuracy
+
+// The double polynomials are checked on every level, including SSE2, where
+// the library uses libm for them
+#define SCALE_FAST_MATH_DOUBLE SCALE_FAST_MATH
+#include "fast_math.h"
+#include "simd_math.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FastMathAccuracy
+{
+
+// Path through which a function is evaluated
+enum Path
+{
+    SCALAR,
+    VECTOR,
+    LIBM
+};
+
+struct Options
+{
+    long samples; // double samples per binade of the domain
+    unsigned stride; // every stride-th float is checked
+    unsigned seed;
+};
+
+struct Result
+{
+    double maxUlp = 0;
+    double argument = 0;
+    double exponent = 0; // y of Pow
+    long count = 0;
+
+    void Add(double ulp, double x, double y = 0)
+    {
+        count++;
+        if (ulp > maxUlp)
+        {
+            maxUlp = ulp;
+            argument = x;
+            exponent = y;
+        }
+    }
+
+    void Merge(const Result &other)
+    {
+        count += other.count;
+        if (other.maxUlp > maxUlp)
+        {
+            maxUlp = other.maxUlp;
+            argument = other.argument;
+            exponent = other.exponent;
+        }
+    }
+};
+
+// Error of value in ulp of the exact result, in the precision of T
+template <typename T>
+double Ulp(T value, long double exact)
+{
+    const int digits = sizeof(T) == sizeof(double) ? 52 : 23;
+    const long double ulp = ldexpl(1.0L, ilogbl(exact) - digits);
+    return (double)(fabsl((long double)value - exact) / ulp);
+}
+
+struct Function
+{
+    const char *name;
+    double lo, hi;                   // domain of double arguments
+    float loF, hiF;                  // domain of float arguments
+    double scalarBound, vectorBound; // documented max ulp
+    double (*scalarD)(double);
+    float (*scalarF)(float);
+    Simd::VecD (*vectorD)(Simd::VecD);
+    Simd::VecF (*vectorF)(Simd::VecF);
+    long double (*exact)(long double);
+    double (*libmD)(double);
+};
+
+long double ExactExp10(long double x)
+{
+    return powl(10.0L, x);
+}
+
+double LibmExp10(double x)
+{
+    return pow(10.0, x);
+}
+
+const std::vector<Function> &Functions()
+{
+    const double minD = 2.2250738585072014e-308, maxD = 1.7976931348623157e308;
+    const float minF = 1.17549435e-38f, maxF = 3.40282347e38f;
+    static const std::vector<Function> functions = {
+        {"Exp", -708, 709, -87, 88, 0.6, 1.5, FastMath::Exp, FastMath::Exp, Simd::Exp, Simd::Exp, expl, exp},
+        {"Exp10", -307, 308, -37, 38, 0.6, 2, FastMath::Exp10, FastMath::Exp10, Simd::Exp10, Simd::Exp10, ExactExp10, LibmExp10},
+        {"Log", minD, maxD, minF, maxF, 0.8, 1.5, FastMath::Log, FastMath::Log, Simd::Log, Simd::Log, logl, log},
+        {"Log10", minD, maxD, minF, maxF, 2, 2.5, FastMath::Log10, FastMath::Log10, Simd::Log10, Simd::Log10, log10l, log10},
+    };
+    return functions;
+}
+
+// Runs f(thread, threads) on all hardware threads and merges the results
+template <typename F>
+Result Parallel(F f)
+{
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Result> results(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             { results[t] = f(t, threads); });
+    }
+    Result result;
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].join();
+        result.Merge(results[t]);
+    }
+    return result;
+}
+
+// Every stride-th float of [lo, hi], a vector at a time through the vector
+// function or one at a time through the scalar one
+Result CheckFloat(const Function &function, Path path, const Options &options)
+{
+    return Parallel([&](int thread, int threads)
+                    {
+        Result result;
+        const int W = Simd::Pack<float>::WIDTH;
+        float x[W], y[W];
+        int lanes = 0;
+        auto flush = [&]()
+        {
+            if (path == VECTOR)
+            {
+                Simd::Store(y, function.vectorF(Simd::Load(x)));
+            }
+            else
+            {
+                for (int j = 0; j < lanes; j++)
+                    y[j] = function.scalarF(x[j]);
+            }
+            for (int j = 0; j < lanes; j++)
+            {
+                result.Add(Ulp(y[j], (long double)function.libmD(x[j])), x[j]);
+            }
+            lanes = 0;
+        };
+        // All bit patterns, each sign separately, split over the threads
+        for (unsigned sign = 0; sign < 2; sign++)
+        {
+            for (unsigned long bits = (unsigned long)thread * options.stride; bits < 0x7F800000UL; bits += (unsigned long)threads * options.stride)
+            {
+                const unsigned pattern = (unsigned)bits | (sign << 31);
+                float v;
+                memcpy(&v, &pattern, sizeof(v));
+                if (!(v >= function.loF && v <= function.hiF))
+                    continue;
+                x[lanes++] = v;
+                if (lanes == W)
+                    flush();
+            }
+        }
+        if (lanes > 0)
+        {
+            for (int j = lanes; j < W; j++)
+                x[j] = x[0];
+            flush();
+        }
+        return result; });
+}
+
+// Random doubles, samples per binade of |x| within [lo, hi] plus as many
+// uniform over [lo, hi], through the given path
+Result CheckDouble(const Function &function, Path path, const Options &options)
+{
+    std::vector<std::pair<double, double> > ranges;
+    const double top = fmax(fabs(function.lo), fabs(function.hi));
+    for (int e = -1022; e <= 1023 && ldexp(1.0, e) <= top; e++)
+    {
+        const double a = ldexp(1.0, e), b = ldexp(1.0, e + 1);
+        if (b > function.lo && a < function.hi && a >= function.lo)
+            ranges.push_back({a, fmin(b, function.hi)});
+        if (-a > function.lo && -b < function.hi && function.lo < 0)
+            ranges.push_back({fmax(-b, function.lo), -a});
+    }
+    ranges.push_back({function.lo, function.hi});
+
+    return Parallel([&](int thread, int threads)
+                    {
+        Result result;
+        const int W = Simd::Pack<double>::WIDTH;
+        std::mt19937_64 rng(options.seed + thread);
+        for (size_t r = thread; r < ranges.size(); r += threads)
+        {
+            std::uniform_real_distribution<double> u(ranges[r].first, ranges[r].second);
+            for (long i = 0; i < options.samples; i += W)
+            {
+                double x[W], y[W];
+                for (int j = 0; j < W; j++)
+                    x[j] = u(rng);
+                if (path == VECTOR)
+                    Simd::Store(y, function.vectorD(Simd::Load(x)));
+                for (int j = 0; j < W; j++)
+                {
+                    if (path == SCALAR)
+                        y[j] = function.scalarD(x[j]);
+                    else if (path == LIBM)
+                        y[j] = function.libmD(x[j]);
+                    result.Add(Ulp(y[j], function.exact(x[j])), x[j]);
+                }
+            }
+        }
+        return result; });
+}
+
+// Documented bound of Pow and Root: multiplication for integer and
+// half-integer y, exp(y ln x) with an error growing with |y ln x| otherwise
+double PowBound(double x, double y)
+{
+    if (fabs(2 * y) <= 16 && 2 * y == (int)(2 * y))
+        return 1 + fabs(2 * y);
+    return 2 + 3 * fabs(y * log(x));
+}
+
+// Pow and Root over molalities of 1e-20 to 1e3 and the exponents of the
+// models, as the ratio of the error to PowBound
+Result CheckPow(bool root, double &maxUlp)
+{
+    const double exponents[] = {-1, 0.5, 1.5, 2, 3, -2.5, 1.0 / 3, 0.25, 0.37, 0.2};
+    Result result;
+    maxUlp = 0;
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> u(-20 * M_LN10, 3 * M_LN10);
+    for (double y : exponents)
+    {
+        if (root && y != 1.0 / 3 && y != 0.2)
+            continue;
+        for (long i = 0; i < 1000000; i++)
+        {
+            const double x = exp(u(rng));
+            double value;
+            long double exact;
+            if (root && y == 0.2)
+            {
+                value = FastMath::Root<5>(x);
+                exact = powl(x, 1.0L / 5);
+            }
+            else if (root)
+            {
+                value = FastMath::Root<3>(x);
+                exact = powl(x, 1.0L / 3);
+            }
+            else
+            {
+                value = FastMath::Pow(x, y);
+                exact = powl(x, (long double)y);
+            }
+            const double ulp = Ulp(value, exact);
+            result.Add(ulp / PowBound(x, y), x, y);
+            maxUlp = fmax(maxUlp, ulp);
+        }
+    }
+    return result;
+}
+
+void Usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --samples N   double samples per binade of each domain (default 20000)\n"
+            "  --stride K    check every K-th float instead of all (default 1)\n"
+            "  --seed N      seed of the double samples (default 1)\n",
+            program);
+    exit(1);
+}
+
+}; // namespace FastMathAccuracy
+
+using namespace FastMathAccuracy;
+
+int main(int argc, char **argv)
+{
+    Options options;
+    options.samples = 20000;
+    options.stride = 1;
+    options.seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc)
+            options.samples = atol(argv[++i]);
+        else if (arg == "--stride" && i + 1 < argc)
+            options.stride = std::max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = (unsigned)atol(argv[++i]);
+        else
+            Usage(argv[0]);
+    }
+
+    bool pass = true;
+    printf("%-8s %-6s %-6s %14s %10s %10s %10s %24s\n", "function", "real", "path", "arguments", "max ulp", "bound", "libm ulp", "at");
+    for (const Function &function : Functions())
+    {
+        const Result libm = CheckDouble(function, LIBM, options);
+        for (Path path : {SCALAR, VECTOR})
+        {
+            const char *name = path == SCALAR ? "scalar" : "vector";
+            const double bound = path == SCALAR ? function.scalarBound : function.vectorBound;
+            const Result d = CheckDouble(function, path, options);
+            printf("%-8s %-6s %-6s %14ld %10.3f %10.1f %10.3f %24.17g\n", function.name, "double", name, d.count, d.maxUlp, bound, libm.maxUlp, d.argument);
+            const Result f = CheckFloat(function, path, options);
+            printf("%-8s %-6s %-6s %14ld %10.3f %10.1f %10s %24.9g\n", function.name, "float", name, f.count, f.maxUlp, bound, "", f.argument);
+            pass &= d.maxUlp <= bound && f.maxUlp <= bound;
+            fflush(stdout);
+        }
+    }
+
+    // Ratio of the error to PowBound
+    for (int root = 0; root < 2; root++)
+    {
+        double maxUlp;
+        const Result p = CheckPow(root, maxUlp);
+        printf("%-8s %-6s %-6s %14ld %10.3f %10s %10s %24.17g (y = %g, %.3f of the bound)\n",
+               root ? "Root<N>" : "Pow", "double", "scalar", p.count, maxUlp, "see text", "", p.argument, p.exponent, p.maxUlp);
+        pass &= p.maxUlp <= 1;
+    }
+
+    printf("%s\n", pass ? "All functions within their bounds" : "Bounds exceeded");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,869 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Accuracy and speed gate of the kernel variants of libuser.so builds.
+//
+// Every build given is loaded once per instruction set variant (SCALE_ISA)
+// and runtime option (float lanes, ISAT, adaptive activity, memoization,
+// deduplication), each in a forked process as the library reads its
+// configuration once when loaded. The Equilibrium Constant and the Pitzer
+// Activity Coefficient are evaluated over a dense grid of temperature, ionic
+// strength and barite molality and over the stored reference points, and
+// compared with the scalar HoffEquilibrium and PitzerActivityModel in
+// double. The run fails if a variant exceeds the relative error allowed to
+// its option, with --relative if an instruction set variant takes more time
+// per cell than the generic variant of its option in the same run by more
+// than that fraction, or, with --baseline, if it takes more time than the
+// baseline by more than --slowdown. The variants of an option run one after
+// the other, so that the relative check compares timings taken close
+// together on the same machine.
+//
+// Barite's virial parameters are zero, and the reference points are values
+// of the models above, so every build and instruction set variant is also
+// checked against measured mean activity coefficients of single salts
+// (tools/salt_reference.txt). They are taken through the database functions
+// of the library with the Pitzer parameters of tools/salt_reference.dat,
+// once from the saturation index of the salt (the binary Pitzer kernel of
+// the minerals) and once from the activity coefficients of its ions (the
+// multicomponent model).
+//
+// Build (the executable must export the uc* symbols to the library, and
+// only those: its reference models would replace the float build's own
+// inline functions of the same names):
+//   g++ -O3 -Wno-write-strings -rdynamic -fvisibility=hidden -DDOUBLE_PRECISION -Isrc tools/kernel_gate.cpp -o kernel_gate -ldl
+
+#include "uclib.h"
+#include "chemistry.h"
+#include "hoff_equilibrium.h"
+#include "pitzer_activity_model.h"
+#include "mineral_database.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace KernelGate
+{
+
+struct Registration
+{
+    void *function;
+    std::string name;
+    std::vector<int> sizes; // of the arguments
+    std::vector<std::string> arguments;
+};
+
+std::vector<Registration> &Registry()
+{
+    static std::vector<Registration> registry;
+    return registry;
+}
+
+}; // namespace KernelGate
+
+#define EXPORT __attribute__((visibility("default")))
+
+extern "C"
+{
+    EXPORT void ucfunc(void *function, char * /*type*/, char *name)
+    {
+        KernelGate::Registration registration = {function, name, {}, {}};
+        KernelGate::Registry().push_back(registration);
+    }
+
+    EXPORT void ucarg(void *function, char * /*location*/, char *name, int size)
+    {
+        for (KernelGate::Registration &registration : KernelGate::Registry())
+        {
+            if (registration.function == function)
+            {
+                registration.sizes.push_back(size);
+                registration.arguments.push_back(name);
+            }
+        }
+    }
+
+    EXPORT void ucfunction(void *function, char *type, char *name, int numArgs, ...)
+    {
+        ucfunc(function, type, name);
+        va_list args;
+        va_start(args, numArgs);
+        for (int i = 0; i < numArgs; i++)
+        {
+            char *argName = va_arg(args, char *);
+            int argSize = va_arg(args, int);
+            ucarg(function, (char *)"Cell", argName, argSize);
+        }
+        va_end(args);
+    }
+}
+
+namespace KernelGate
+{
+
+// Barite as in barite_reaction_library.cpp
+const Real log_k = -9.87;
+const Real delta_h = 6.35 * 4186.80;
+const Real nu = 1;
+const Real Z_A = 2;
+const Real Z_B = -2;
+const Real beta = 0;
+
+enum Function
+{
+    EQUILIBRIUM,
+    ACTIVITY,
+    FUNCTIONS
+};
+
+const char *const FUNCTION_NAMES[FUNCTIONS] = {"Equilibrium Constant", "Pitzer Activity Coefficient"};
+const char *const FUNCTION_TAGS[FUNCTIONS] = {"K", "gamma"};
+
+// Runtime option of the library and the relative error allowed to it, of
+// K and gamma. The float build is allowed FLOAT_ERROR at least.
+struct Option
+{
+    const char *name;
+    const char *variable;
+    double maxError[FUNCTIONS];
+};
+
+const Option OPTIONS[] = {
+    {"plain", NULL, {1e-12, 1e-12}},
+    {"mixed", "SCALE_MIXED_PRECISION", {1e-12, 1e-5}},  // float lanes, K in double
+    {"isat", "SCALE_ISAT", {1e-12, 1e-3}},              // SCALE_ISAT_TOL 1e-4 of ln(gamma)
+    {"adaptive", "SCALE_ADAPTIVE_ACTIVITY", {1e-12, 1.1e-3}}, // 1e-3 of ln(gamma)
+    {"memo", "SCALE_MEMO", {1e-12, 1e-12}},             // cells repeat unchanged
+    {"dedup", "SCALE_DEDUP", {1e-12, 1e-12}},
+};
+
+const char *const ISAS[] = {"generic", "avx2", "avx512"};
+
+const double FLOAT_ERROR = 2e-5;
+
+// Relative error allowed to the mean activity coefficients of the salts
+// against the measurements. The parameters of Harvie, Moller and Weare
+// reproduce them within 1.1%; the integer 3 / 2 of C_gamma once put NaCl
+// at 6 mol/kg 2.3% off.
+const double SALT_ERROR = 1.5e-2;
+
+enum SaltPath
+{
+    SATURATION_INDEX,
+    ION_ACTIVITIES,
+    SALT_PATHS
+};
+
+const char *const SALT_PATH_NAMES[SALT_PATHS] = {"SI", "ions"};
+const int MAX_SALTS = 32;
+
+// Every grid state takes REPEATS consecutive cells, so that deduplication
+// has runs to collapse
+const int REPEATS = 2;
+
+struct Options
+{
+    std::vector<std::string> libraries;
+    std::string points;
+    std::string salts;
+    std::string saltDatabase;
+    std::string baseline;
+    std::string writeBaseline;
+    std::string only;
+    double slowdown;
+    double relative; // negative if not checked
+    double minSeconds;
+};
+
+// Inputs T, yBa, ySO4, yEtc1, yEtc2 of the cells, their ionic strength
+// and K and gamma of the reference models; the grid cells come first, then
+// the points
+struct Cells
+{
+    std::vector<double> inputs[5];
+    std::vector<double> ionicStrength;
+    std::vector<double> reference[FUNCTIONS];
+    size_t grid = 0;
+
+    size_t Size() const
+    {
+        return inputs[0].size();
+    }
+
+    void Add(const double *x, const double *y)
+    {
+        for (int k = 0; k < 5; k++)
+            inputs[k].push_back(x[k]);
+        const double mTot = (1 - (x[3] + x[4])) / ChemistryFunctions::MolarMassOfWater();
+        ionicStrength.push_back(0.5 * (x[3] + 4 * x[4]) * mTot);
+        for (int f = 0; f < FUNCTIONS; f++)
+            reference[f].push_back(y[f]);
+    }
+};
+
+// Measured mean activity coefficients of single salts, with the phases
+// of the database that carry their Pitzer parameters
+struct Salts
+{
+    MineralDatabase database;
+    std::vector<int> phase;
+    std::vector<double> T;
+    std::vector<double> molality;
+    std::vector<double> gamma;
+
+    size_t Size() const
+    {
+        return phase.size();
+    }
+};
+
+// Outcome of one variant, passed from its process
+struct Result
+{
+    int real; // sizeof(Real) of the library, 0 if it did not run
+    double error[FUNCTIONS];      // max relative error over the grid
+    double pointError[FUNCTIONS]; // and over the points
+    double nsPerCell[FUNCTIONS];  // fastest call
+    long nonFinite;
+    double saltError[SALT_PATHS]; // max relative error of the salts
+    double saltGamma[SALT_PATHS][MAX_SALTS];
+};
+
+// Reference K and gamma of a cell
+void Reference(const double *x, double *y)
+{
+    static HoffEquilibrium equilibrium(log_k, delta_h, ChemistryFunctions::T0());
+    static PitzerActivityModel activity(nu, nu, Z_A, Z_B, beta, beta, beta, beta,
+                                        PitzerBatch::Alphas22::alpha_1, PitzerBatch::Alphas22::alpha_2, PitzerBatch::Alphas22::b);
+    y[EQUILIBRIUM] = equilibrium.Equilibrium(x[0]);
+    y[ACTIVITY] = activity.ActivityCoefficient(x[0], x[1], x[2], x[3], x[4]);
+}
+
+// Grid of 41 temperatures of 273-473 K, 36 ionic strengths of 1e-5-6
+// mol/kg and 13 barite molalities of 1e-8-1e-2 mol/kg. I comes from the
+// background ions, a 1:1 salt and a quarter as much 2:2 salt by mass
+// fraction, so I = y_1 m_tot with m_tot = (1 - 1.25 y_1) / M_w.
+void Grid(Cells &cells)
+{
+    const double M_w = ChemistryFunctions::MolarMassOfWater();
+    for (int t = 0; t < 41; t++)
+    {
+        const double T = 273.15 + 5 * t;
+        for (int i = 0; i < 36; i++)
+        {
+            const double I = 1e-5 * pow(6e5, i / 35.0);
+            const double y_1 = (1 - sqrt(1 - 5 * I * M_w)) / 2.5;
+            const double mTot = (1 - 1.25 * y_1) / M_w;
+            for (int m = 0; m < 13; m++)
+            {
+                const double molality = 1e-8 * pow(10, m / 2.0);
+                const double x[5] = {T, molality / mTot, molality / mTot, y_1, y_1 / 4};
+                double y[FUNCTIONS];
+                Reference(x, y);
+                for (int r = 0; r < REPEATS; r++)
+                    cells.Add(x, y);
+            }
+        }
+    }
+    cells.grid = cells.Size();
+}
+
+// Reference points: lines of T, yBa, ySO4, yEtc1, yEtc2, K and gamma, '#'
+// starts a comment. False if the file cannot be read.
+bool Points(const std::string &path, Cells &cells, double &referenceError)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::string line;
+    referenceError = 0;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        double x[5], y[FUNCTIONS], reference[FUNCTIONS];
+        for (int k = 0; k < 5; k++)
+            fields >> x[k];
+        for (int f = 0; f < FUNCTIONS; f++)
+            fields >> y[f];
+        if (!fields)
+        {
+            fprintf(stderr, "%s: cannot read '%s'\n", path.c_str(), line.c_str());
+            return false;
+        }
+        Reference(x, reference);
+        for (int f = 0; f < FUNCTIONS; f++)
+            referenceError = fmax(referenceError, fabs(reference[f] / y[f] - 1));
+        cells.Add(x, y);
+    }
+    return true;
+}
+
+// Writes the reference of a spread of the grid as points
+void WritePoints(const std::string &path, const Cells &cells)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        exit(1);
+    }
+    fprintf(file, "# T yBa ySO4 yEtc1 yEtc2 K gamma\n");
+    for (size_t i = 0; i < cells.grid; i += 97 * REPEATS)
+    {
+        for (int k = 0; k < 5; k++)
+            fprintf(file, "%.17g ", cells.inputs[k][i]);
+        fprintf(file, "%.17g %.17g\n", cells.reference[EQUILIBRIUM][i], cells.reference[ACTIVITY][i]);
+    }
+    fclose(file);
+}
+
+// Salt points: lines of phase, T, molality and measured mean activity
+// coefficient, '#' starts a comment. False if either file cannot be read.
+bool ReadSalts(const Options &options, Salts &salts)
+{
+    if (!salts.database.Load(options.saltDatabase.c_str()))
+    {
+        fprintf(stderr, "%s\n", salts.database.error.c_str());
+        return false;
+    }
+    std::ifstream file(options.salts);
+    if (!file)
+        return false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string name;
+        double T, molality, gamma;
+        fields >> name >> T >> molality >> gamma;
+        const int phase = (int)(std::find(salts.database.name.begin(), salts.database.name.end(), name) - salts.database.name.begin());
+        if (!fields || phase == salts.database.Size() || salts.Size() == MAX_SALTS)
+        {
+            fprintf(stderr, "%s: cannot read '%s'\n", options.salts.c_str(), line.c_str());
+            return false;
+        }
+        salts.phase.push_back(phase);
+        salts.T.push_back(T);
+        salts.molality.push_back(molality);
+        salts.gamma.push_back(gamma);
+    }
+    return true;
+}
+
+// Inputs of a salt point in the convention of the library, m_i = y_i (1 -
+// sum y) / M_w. The Pitzer kernel of the minerals takes I from the
+// spectators only, so there the ions of the salt are also yEtc1 and yEtc2.
+void SaltInputs(const Salts &salts, size_t k, double &yA, double &yB, double &yEtc1, double &yEtc2)
+{
+    const MineralDatabase &database = salts.database;
+    const int i = salts.phase[k];
+    const double M_w = ChemistryFunctions::MolarMassOfWater();
+    const double M = (database.nu_A[i] + database.nu_B[i]) * salts.molality[k];
+    const double sum = (1 - sqrt(1 - 4 * M_w * M)) / 2;
+    const double mTot = (1 - sum) / M_w;
+    yA = database.nu_A[i] * salts.molality[k] / mTot;
+    yB = database.nu_B[i] * salts.molality[k] / mTot;
+    yEtc1 = (database.Z_A[i] == 1 ? yA : 0) + (database.Z_B[i] == -1 ? yB : 0);
+    yEtc2 = (database.Z_A[i] == 2 ? yA : 0) + (database.Z_B[i] == -2 ? yB : 0);
+}
+
+// Cell array in the library's precision
+struct Array
+{
+    std::vector<char> data;
+    int size;
+
+    Array(size_t n, int size) : data(n * size), size(size)
+    {
+    }
+
+    void Set(size_t i, double value)
+    {
+        if (size == sizeof(double))
+            ((double *)data.data())[i] = value;
+        else
+            ((float *)data.data())[i] = (float)value;
+    }
+
+    double Get(size_t i) const
+    {
+        if (size == sizeof(double))
+            return ((const double *)data.data())[i];
+        return ((const float *)data.data())[i];
+    }
+};
+
+typedef void (*FieldFunction)(void *, int, void *, void *, void *, void *, void *);
+
+// Field functions of any argument count are called with MAX_ARGUMENTS,
+// as by STAR-CCM+
+const int MAX_ARGUMENTS = 16;
+typedef void (*WideFunction)(void *, int, void *, void *, void *, void *, void *, void *, void *, void *,
+                             void *, void *, void *, void *, void *, void *, void *, void *);
+
+const Registration *Find(const std::string &name)
+{
+    for (const Registration &registration : Registry())
+    {
+        if (registration.name == name)
+            return &registration;
+    }
+    return NULL;
+}
+
+// Value of a registered function at one cell of the named arguments, the
+// others zero; NAN if it is not registered
+double Evaluate(const std::string &name, const std::map<std::string, double> &values, int real)
+{
+    const Registration *registration = Find(name);
+    if (registration == NULL || registration->arguments.size() > (size_t)MAX_ARGUMENTS)
+        return NAN;
+    std::vector<Array> inputs(registration->arguments.size(), Array(1, real));
+    void *p[MAX_ARGUMENTS] = {NULL};
+    for (size_t j = 0; j < inputs.size(); j++)
+    {
+        const auto value = values.find(registration->arguments[j]);
+        inputs[j].Set(0, value != values.end() ? value->second : 0);
+        p[j] = inputs[j].data.data();
+    }
+    Array result(1, real);
+    WideFunction f = (WideFunction)registration->function;
+    f(result.data.data(), 1, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+    return result.Get(0);
+}
+
+// Mean activity coefficients of the salts from the saturation index of
+// their phase, ln(gamma) = (SI ln(10) + ln(K) - ln(m_A^nu_A m_B^nu_B)) / nu,
+// and from the activity coefficients of their ions
+void SaltErrors(const Salts &salts, Result &outcome)
+{
+    const MineralDatabase &database = salts.database;
+    for (size_t k = 0; k < salts.Size(); k++)
+    {
+        const int i = salts.phase[k];
+        const double T = salts.T[k];
+        const double nu = database.nu_A[i] + database.nu_B[i];
+        double yA, yB, yEtc1, yEtc2;
+        SaltInputs(salts, k, yA, yB, yEtc1, yEtc2);
+
+        const std::string A = "$y" + database.cation[i];
+        const std::string B = "$y" + database.anion[i];
+        const double SI = Evaluate("Saturation Index " + database.name[i],
+                                   {{"Temperature", T}, {A, yA}, {B, yB}, {"$yEtc_1-", yEtc1}, {"$yEtc_2-", yEtc2}}, outcome.real);
+        const EquilibriumBatch::Coefficients &c = database.equilibrium[i];
+        const double lnK = c.a_0 + c.a_1 * T + c.a_2 / T + c.a_3 * log(T);
+        const double lnProduct = database.nu_A[i] * log(database.nu_A[i] * salts.molality[k]) + database.nu_B[i] * log(database.nu_B[i] * salts.molality[k]);
+        outcome.saltGamma[SATURATION_INDEX][k] = exp((SI * M_LN10 + lnK - lnProduct) / nu);
+
+        const std::map<std::string, double> ions = {{"Temperature", T}, {A, yA}, {B, yB}};
+        const double gammaA = Evaluate("Activity Coefficient " + database.cation[i], ions, outcome.real);
+        const double gammaB = Evaluate("Activity Coefficient " + database.anion[i], ions, outcome.real);
+        outcome.saltGamma[ION_ACTIVITIES][k] = pow(pow(gammaA, database.nu_A[i]) * pow(gammaB, database.nu_B[i]), 1 / nu);
+
+        for (int path = 0; path < SALT_PATHS; path++)
+        {
+            const double error = fabs(outcome.saltGamma[path][k] / salts.gamma[k] - 1);
+            // NaN of a function that is not registered fails too
+            outcome.saltError[path] = error <= outcome.saltError[path] ? outcome.saltError[path] : error;
+        }
+    }
+}
+
+// Max relative errors of result against the reference, over the grid and
+// the points
+void Errors(const Cells &cells, int function, const Array &result, Result &outcome)
+{
+    for (size_t i = 0; i < cells.Size(); i++)
+    {
+        const double value = result.Get(i);
+        if (!isfinite(value))
+        {
+            outcome.nonFinite++;
+            continue;
+        }
+        double &error = i < cells.grid ? outcome.error[function] : outcome.pointError[function];
+        error = fmax(error, fabs(value / cells.reference[function][i] - 1));
+    }
+}
+
+// Loads the library in this process and evaluates both functions, then
+// the salts
+Result Run(const std::string &library, const Cells &cells, const Salts &salts, const Options &options)
+{
+    Result outcome = {};
+    void *handle = dlopen(library.c_str(), RTLD_NOW);
+    if (handle == NULL)
+    {
+        fprintf(stderr, "%s\n", dlerror());
+        return outcome;
+    }
+    void (*uclib)() = (void (*)())dlsym(handle, "uclib");
+    if (uclib == NULL)
+    {
+        fprintf(stderr, "%s does not export uclib()\n", library.c_str());
+        return outcome;
+    }
+    uclib();
+
+    const size_t n = cells.Size();
+    for (int function = 0; function < FUNCTIONS; function++)
+    {
+        const Registration *registration = NULL;
+        for (const Registration &r : Registry())
+        {
+            if (r.name == FUNCTION_NAMES[function])
+                registration = &r;
+        }
+        if (registration == NULL || registration->sizes.empty())
+        {
+            fprintf(stderr, "%s does not register %s\n", library.c_str(), FUNCTION_NAMES[function]);
+            outcome.real = 0;
+            return outcome;
+        }
+        outcome.real = registration->sizes[0];
+
+        std::vector<Array> inputs(5, Array(n, outcome.real));
+        for (int k = 0; k < 5; k++)
+        {
+            for (size_t i = 0; i < n; i++)
+                inputs[k].Set(i, cells.inputs[k][i]);
+        }
+        Array result(n, outcome.real);
+        FieldFunction f = (FieldFunction)registration->function;
+        auto call = [&]()
+        { f(result.data.data(), (int)n, inputs[0].data.data(), inputs[1].data.data(), inputs[2].data.data(), inputs[3].data.data(), inputs[4].data.data()); };
+
+        // The first call and the last, after tables and caches filled
+        call();
+        Errors(cells, function, result, outcome);
+        double fastest = INFINITY;
+        double seconds = 0;
+        for (int calls = 0; seconds < options.minSeconds || calls < 3; calls++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            call();
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            fastest = fmin(fastest, elapsed);
+            seconds += elapsed;
+        }
+        Errors(cells, function, result, outcome);
+        outcome.nsPerCell[function] = 1e9 * fastest / n;
+    }
+    SaltErrors(salts, outcome);
+    return outcome;
+}
+
+// Runs the library with an ISA and option in a child process, with the
+// salt database and the multicomponent Pitzer model of its ions
+Result Variant(const std::string &library, const char *isa, const Option &option, const Cells &cells, const Salts &salts, const Options &options)
+{
+    int channel[2];
+    if (pipe(channel) != 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    // Or the child would write what the parent has buffered once more
+    fflush(NULL);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(channel[0]);
+        setenv("SCALE_ISA", isa, 1);
+        setenv("SCALE_DATABASE", options.saltDatabase.c_str(), 1);
+        setenv("SCALE_DATABASE_PITZER", "1", 1);
+        if (option.variable != NULL)
+            setenv(option.variable, "1", 1);
+        // What the library prints when loaded and unloaded is not of interest
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        const Result outcome = Run(library, cells, salts, options);
+        if (write(channel[1], &outcome, sizeof(outcome)) != (ssize_t)sizeof(outcome))
+            _exit(1);
+        fflush(stdout);
+        exit(0);
+    }
+    close(channel[1]);
+    Result outcome = {};
+    if (read(channel[0], &outcome, sizeof(outcome)) != (ssize_t)sizeof(outcome))
+        outcome.real = 0;
+    close(channel[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        outcome.real = 0;
+    return outcome;
+}
+
+bool Supported(const char *isa)
+{
+    __builtin_cpu_init();
+    if (strcmp(isa, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (strcmp(isa, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    return true;
+}
+
+// Baseline lines: library variant function ns/cell, '#' starts a comment
+std::map<std::string, double> ReadBaseline(const std::string &path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Cannot read baseline %s\n", path.c_str());
+        exit(1);
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string library, variant, function;
+        double nsPerCell;
+        if (fields >> library >> variant >> function >> nsPerCell)
+            baseline[library + " " + variant + " " + function] = nsPerCell;
+    }
+    return baseline;
+}
+
+std::string Basename(const std::string &path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void Usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <libuser.so> [<libuser.so> ...]\n"
+            "  --points FILE          reference points (default tools/barite_reference.txt)\n"
+            "  --write-points FILE    write reference points of the grid and exit\n"
+            "  --salts FILE           measured salt activity coefficients (default tools/salt_reference.txt)\n"
+            "  --salt-database FILE   Pitzer parameters of the salts (default tools/salt_reference.dat)\n"
+            "  --baseline FILE        ns/cell of the variants to compare with\n"
+            "  --write-baseline FILE  write the ns/cell of this run as a baseline\n"
+            "  --slowdown F           fail beyond a fraction F slower than the baseline (default 0.2)\n"
+            "  --relative F           fail if an ISA variant is a fraction F slower than generic\n"
+            "  --variant TEXT         only run the variants whose name contains TEXT\n"
+            "  --min-time S           time per variant and function in seconds (default 0.2)\n",
+            program);
+    exit(1);
+}
+
+}; // namespace KernelGate
+
+using namespace KernelGate;
+
+int main(int argc, char **argv)
+{
+    Options options;
+    options.points = "tools/barite_reference.txt";
+    options.salts = "tools/salt_reference.txt";
+    options.saltDatabase = "tools/salt_reference.dat";
+    options.slowdown = 0.2;
+    options.relative = -1;
+    options.minSeconds = 0.2;
+    std::string writePoints;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--points" && i + 1 < argc)
+            options.points = argv[++i];
+        else if (arg == "--write-points" && i + 1 < argc)
+            writePoints = argv[++i];
+        else if (arg == "--salts" && i + 1 < argc)
+            options.salts = argv[++i];
+        else if (arg == "--salt-database" && i + 1 < argc)
+            options.saltDatabase = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc)
+            options.baseline = argv[++i];
+        else if (arg == "--write-baseline" && i + 1 < argc)
+            options.writeBaseline = argv[++i];
+        else if (arg == "--slowdown" && i + 1 < argc)
+            options.slowdown = atof(argv[++i]);
+        else if (arg == "--relative" && i + 1 < argc)
+            options.relative = atof(argv[++i]);
+        else if (arg == "--variant" && i + 1 < argc)
+            options.only = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.minSeconds = atof(argv[++i]);
+        else if (arg[0] != '-')
+            options.libraries.push_back(arg);
+        else
+            Usage(argv[0]);
+    }
+
+    Cells cells;
+    Grid(cells);
+    if (!writePoints.empty())
+    {
+        WritePoints(writePoints, cells);
+        return 0;
+    }
+    if (options.libraries.empty())
+        Usage(argv[0]);
+
+    // The points also pin the reference models themselves
+    bool pass = true;
+    double referenceError = 0;
+    if (!Points(options.points, cells, referenceError))
+    {
+        fprintf(stderr, "Cannot read reference points %s\n", options.points.c_str());
+        return 1;
+    }
+    printf("%zu grid cells, %zu reference points; reference models within %.2e of the points\n",
+           cells.grid / REPEATS, cells.Size() - cells.grid, referenceError);
+    pass &= referenceError <= 1e-13;
+    Salts salts;
+    if (!ReadSalts(options, salts))
+    {
+        fprintf(stderr, "Cannot read salts %s of %s\n", options.salts.c_str(), options.saltDatabase.c_str());
+        return 1;
+    }
+    printf("%zu measured salt activity coefficients\n", salts.Size());
+
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty())
+        baseline = ReadBaseline(options.baseline);
+    FILE *written = NULL;
+    if (!options.writeBaseline.empty())
+    {
+        written = fopen(options.writeBaseline.c_str(), "w");
+        if (written == NULL)
+        {
+            fprintf(stderr, "Cannot write %s\n", options.writeBaseline.c_str());
+            return 1;
+        }
+    }
+
+    printf("\n%-16s %-18s %-6s %-6s %10s %10s %10s %10s %10s %10s %s\n",
+           "library", "variant", "real", "f", "max error", "points", "allowed", "ns/cell", "/generic", "baseline", "");
+    std::vector<Result> first(options.libraries.size());
+    for (size_t l = 0; l < options.libraries.size(); l++)
+    {
+        const std::string &library = options.libraries[l];
+        const std::string name = Basename(library);
+        for (const Option &option : OPTIONS)
+        {
+            double generic[FUNCTIONS] = {};
+            for (const char *isa : ISAS)
+            {
+                const std::string variant = std::string(isa) + "/" + option.name;
+                if (variant.find(options.only) == std::string::npos)
+                    continue;
+                if (!Supported(isa))
+                {
+                    printf("%-16s %-18s not supported by this CPU\n", name.c_str(), variant.c_str());
+                    continue;
+                }
+                const Result outcome = Variant(library, isa, option, cells, salts, options);
+                if (outcome.real == 0)
+                {
+                    printf("%-16s %-18s FAILED to run\n", name.c_str(), variant.c_str());
+                    pass = false;
+                    continue;
+                }
+                for (int f = 0; f < FUNCTIONS; f++)
+                {
+                    const double allowed = outcome.real == sizeof(double) ? option.maxError[f] : fmax(option.maxError[f], FLOAT_ERROR);
+                    const std::string key = name + " " + variant + " " + FUNCTION_TAGS[f];
+                    const double ns = outcome.nsPerCell[f];
+                    const bool accurate = outcome.error[f] <= allowed && outcome.pointError[f] <= allowed && outcome.nonFinite == 0;
+                    bool fast = true;
+                    char relative[32] = "";
+                    if (strcmp(isa, "generic") == 0)
+                        generic[f] = ns;
+                    else if (generic[f] > 0)
+                    {
+                        if (options.relative >= 0)
+                            fast = ns <= generic[f] * (1 + options.relative);
+                        snprintf(relative, sizeof(relative), "%10.2f", ns / generic[f]);
+                    }
+                    char reference[32] = "";
+                    if (baseline.count(key))
+                    {
+                        fast &= ns <= baseline[key] * (1 + options.slowdown);
+                        snprintf(reference, sizeof(reference), "%10.3f", baseline[key]);
+                    }
+                    printf("%-16s %-18s %-6s %-6s %10.2e %10.2e %10.0e %10.3f %10s %10s %s\n",
+                           name.c_str(), variant.c_str(), outcome.real == sizeof(double) ? "double" : "float", FUNCTION_TAGS[f],
+                           outcome.error[f], outcome.pointError[f], allowed, ns, relative, reference,
+                           !accurate ? "INACCURATE" : !fast ? "SLOWER" : "");
+                    pass &= accurate && fast;
+                    if (written != NULL)
+                        fprintf(written, "%s %.3f\n", key.c_str(), ns);
+                }
+                for (int path = 0; path < SALT_PATHS; path++)
+                {
+                    const bool accurate = outcome.saltError[path] <= SALT_ERROR;
+                    printf("%-16s %-18s %-6s %-6s %10s %10.2e %10.1e %10s %10s %10s %s\n",
+                           name.c_str(), variant.c_str(), outcome.real == sizeof(double) ? "double" : "float", SALT_PATH_NAMES[path],
+                           "", outcome.saltError[path], SALT_ERROR, "", "", "", accurate ? "" : "INACCURATE");
+                    pass &= accurate;
+                }
+                if (first[l].real == 0)
+                    first[l] = outcome;
+                fflush(stdout);
+            }
+        }
+    }
+    if (written != NULL)
+        fclose(written);
+
+    // Mean activity coefficients of the first variant run of each library
+    printf("\n%-16s %-14s %8s %10s %10s %10s %10s\n", "library", "salt", "T", "molality", "measured", "SI", "ions");
+    for (size_t l = 0; l < options.libraries.size(); l++)
+    {
+        if (first[l].real == 0)
+            continue;
+        for (size_t k = 0; k < salts.Size(); k++)
+        {
+            printf("%-16s %-14s %8.2f %10.3f %10.3f %10.4f %10.4f\n", Basename(options.libraries[l]).c_str(),
+                   salts.database.name[salts.phase[k]].c_str(), salts.T[k], salts.molality[k], salts.gamma[k],
+                   first[l].saltGamma[SATURATION_INDEX][k], first[l].saltGamma[ION_ACTIVITIES][k]);
+        }
+    }
+
+    printf("%s\n", pass ? "All variants within their bounds" : "Bounds exceeded");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,715 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Fitting of the Pitzer parameters of a salt and of its equilibrium constant
+// against solubility data.
+//
+// Each data point is a saturated solution at temperature T with the
+// molalities m_A and m_B of the salt's ions and the ionic strength I. Its
+// residual is the library's ln saturation ratio,
+//   r = ln(m_A^nu_A m_B^nu_B) + nu ln(gamma) - ln K(T),
+// with gamma of PitzerActivityModel and K of HoffEquilibrium or
+// EmpiricalEquilibrium. For fixed alphas and b, ln(gamma) is linear in
+// beta_0, beta_1, beta_2 and C_Phi, and ln K in the parameters of its
+// formulation, so the models are evaluated once per point for a step of each
+// parameter around the initial values. This gives r = r_0 + J p with the
+// exact Jacobian J, and a parameter set costs one dot product per point from
+// then on.
+//
+// A sweep evaluates the weighted sum of squares of every set of a grid, the
+// sets in SIMD lanes and the points split across threads. Levenberg-Marquardt
+// then starts from the best set (or the initial values), accumulating
+// J^T W J and J^T W r over the points on the same threads.
+//
+// Build:
+//   g++ -O3 -march=native -pthread -DDOUBLE_PRECISION -Isrc tools/pitzer_fit.cpp -o pitzer_fit
+
+#include "pitzer_activity_model.h"
+#include "hoff_equilibrium.h"
+#include "empirical_equilibrium.h"
+#include "simd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PitzerFit
+{
+
+// A saturated solution; weight multiplies its squared residual
+struct Point
+{
+    double T;
+    double mA;
+    double mB;
+    double I;
+    double weight;
+};
+
+struct Parameter
+{
+    std::string name;
+    double value;
+    bool fixed;
+    double lo, hi; // range of the sweep
+    int count;     // grid points of the sweep, 0 if not swept
+};
+
+struct Options
+{
+    double nu_A = 1, nu_B = 1, Z_A = 2, Z_B = -2;
+    double alpha_1 = 1.4, alpha_2 = 12, b = 1.2;
+    bool empirical = false;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    long synthetic = 0;
+    double noise = 0.01;
+    unsigned seed = 1;
+    int iterations = 100;
+    std::string data;
+};
+
+// Linearized residuals r = r_0 + J p of all points, J by parameter
+struct Problem
+{
+    std::vector<double> r_0;
+    std::vector<std::vector<double> > J;
+    std::vector<double> weight;
+
+    size_t Points() const
+    {
+        return r_0.size();
+    }
+};
+
+// Parameters of the Pitzer model and the equilibrium formulation, with the
+// library's barite values as defaults
+std::vector<Parameter> DefaultParameters(const Options &options)
+{
+    std::vector<Parameter> parameters;
+    for (const char *name : {"beta_0", "beta_1", "beta_2", "C_Phi"})
+        parameters.push_back({name, 0, false, 0, 0, 0});
+    if (options.empirical)
+    {
+        const double values[4] = {-282.43, -8.972e-2, 5822, 113.08};
+        const char *names[4] = {"A", "B", "C", "D"};
+        for (int k = 0; k < 4; k++)
+            parameters.push_back({names[k], values[k], false, 0, 0, 0});
+    }
+    else
+    {
+        parameters.push_back({"log_k", -9.87, false, 0, 0, 0});
+        parameters.push_back({"delta_h", 6.35 * 4186.80, false, 0, 0, 0});
+    }
+    return parameters;
+}
+
+// Runs f(thread, begin, end) over [0, n) split evenly on the threads, so the
+// partial sums and thereby the results depend only on the thread count
+template <typename F>
+void Parallel(int threads, size_t n, F f)
+{
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(f, t, n * t / threads, n * (t + 1) / threads);
+    f(0, 0, n / threads);
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+// The library's models for one parameter vector p, in the order of
+// DefaultParameters
+class Models
+{
+public:
+    Models(const Options &options) : options(options),
+                                     nu_A(options.nu_A), nu_B(options.nu_B), Z_A(options.Z_A), Z_B(options.Z_B),
+                                     activity(nu_A, nu_B, Z_A, Z_B, beta[0], beta[1], beta[2], beta[3], options.alpha_1, options.alpha_2, options.b)
+    {
+    }
+
+    // ln(IAP / K) of a point
+    double LogSaturationRatio(const Point &point, const double *p)
+    {
+        for (int k = 0; k < 4; k++)
+            beta[k] = p[k];
+        const double M = activity.MeanMolality(point.mA, point.mB);
+        const double lnProduct = log(pow(fmax(point.mA, activity.SMALL), nu_A) * pow(fmax(point.mB, activity.SMALL), nu_B) + activity.SMALL);
+        const double lnGamma = log(activity.pitzerActivityCoefficient(point.T, point.I, M));
+        double lnK;
+        if (options.empirical)
+            lnK = log(EmpiricalEquilibrium(p[4], p[5], p[6], p[7]).Equilibrium(point.T));
+        else
+            lnK = log(HoffEquilibrium(p[4], p[5], ChemistryFunctions::T0()).Equilibrium(point.T));
+        return (nu_A + nu_B) * lnGamma + lnProduct - lnK;
+    }
+
+private:
+    const Options &options;
+    Real beta[4] = {};
+    Real nu_A, nu_B, Z_A, Z_B;
+    PitzerActivityModel activity;
+};
+
+// J from the models at the initial values p_0 and at steps of a tenth of
+// each (1 for zeros), exact as the residual is linear; then r_0 = r(p_0) -
+// J p_0. Steps of the size of the parameters keep K finite (the empirical
+// terms are powers of 10) and J free of the cancellation against ln K.
+Problem Linearize(const std::vector<Point> &points, const std::vector<double> &p_0, const Options &options)
+{
+    const int parameters = (int)p_0.size();
+    Problem problem;
+    problem.r_0.resize(points.size());
+    problem.J.assign(parameters, std::vector<double>(points.size()));
+    problem.weight.resize(points.size());
+    Parallel(options.threads, points.size(), [&](int, size_t begin, size_t end)
+             {
+                 Models models(options);
+                 std::vector<double> p = p_0;
+                 for (size_t i = begin; i < end; i++)
+                 {
+                     const double r = models.LogSaturationRatio(points[i], p.data());
+                     problem.r_0[i] = r;
+                     for (int k = 0; k < parameters; k++)
+                     {
+                         const double step = p_0[k] != 0 ? 0.1 * fabs(p_0[k]) : 1;
+                         p[k] = p_0[k] + step;
+                         problem.J[k][i] = (models.LogSaturationRatio(points[i], p.data()) - r) / step;
+                         problem.r_0[i] -= problem.J[k][i] * p_0[k];
+                         p[k] = p_0[k];
+                     }
+                     problem.weight[i] = points[i].weight;
+                 } });
+    return problem;
+}
+
+// Weighted sums of squares of the sets P[k][s], s in [0, sets), with sets a
+// multiple of UNROLL vectors. Each thread sums its points for all sets, two
+// vectors of sets per pass over the points.
+std::vector<double> SumsOfSquares(const Problem &problem, const std::vector<std::vector<double> > &P, size_t sets, int threads)
+{
+    typedef Simd::Pack<double>::V V;
+    const int W = Simd::Pack<double>::WIDTH;
+    const int UNROLL = 2;
+    const int K = (int)problem.J.size();
+    std::vector<std::vector<double> > partial(threads, std::vector<double>(sets));
+
+    Parallel(threads, problem.Points(), [&](int thread, size_t begin, size_t end)
+             {
+                 std::vector<V> p(K * UNROLL);
+                 for (size_t s = 0; s < sets; s += UNROLL * W)
+                 {
+                     for (int k = 0; k < K; k++)
+                         for (int u = 0; u < UNROLL; u++)
+                             p[k * UNROLL + u] = Simd::Load(&P[k][s + u * W]);
+                     V sse[UNROLL] = {};
+                     for (size_t i = begin; i < end; i++)
+                     {
+                         V r[UNROLL];
+                         for (int u = 0; u < UNROLL; u++)
+                             r[u] = Simd::Broadcast<V>(problem.r_0[i]);
+                         for (int k = 0; k < K; k++)
+                         {
+                             const double J = problem.J[k][i];
+                             for (int u = 0; u < UNROLL; u++)
+                                 r[u] += J * p[k * UNROLL + u];
+                         }
+                         for (int u = 0; u < UNROLL; u++)
+                             sse[u] += problem.weight[i] * (r[u] * r[u]);
+                     }
+                     for (int u = 0; u < UNROLL; u++)
+                         Simd::Store(&partial[thread][s + u * W], sse[u]);
+                 } });
+
+    std::vector<double> sums(sets, 0.0);
+    for (int t = 0; t < threads; t++)
+        for (size_t s = 0; s < sets; s++)
+            sums[s] += partial[t][s];
+    return sums;
+}
+
+// Normal equations A = J^T W J and g = J^T W r of the free parameters at p,
+// and the sum of squares
+double NormalEquations(const Problem &problem, const std::vector<double> &p, const std::vector<int> &free, std::vector<double> &A, std::vector<double> &g, int threads)
+{
+    const int F = (int)free.size();
+    const int K = (int)problem.J.size();
+    std::vector<std::vector<double> > partial(threads, std::vector<double>(F * F + F + 1));
+    Parallel(threads, problem.Points(), [&](int thread, size_t begin, size_t end)
+             {
+                 double *a = partial[thread].data();
+                 for (size_t i = begin; i < end; i++)
+                 {
+                     double r = problem.r_0[i];
+                     for (int k = 0; k < K; k++)
+                         r += problem.J[k][i] * p[k];
+                     const double w = problem.weight[i];
+                     for (int j = 0; j < F; j++)
+                     {
+                         const double wJ = w * problem.J[free[j]][i];
+                         for (int l = 0; l <= j; l++)
+                             a[j * F + l] += wJ * problem.J[free[l]][i];
+                         a[F * F + j] += wJ * r;
+                     }
+                     a[F * F + F] += w * r * r;
+                 } });
+
+    A.assign(F * F, 0.0);
+    g.assign(F, 0.0);
+    double sse = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        for (int j = 0; j < F; j++)
+        {
+            for (int l = 0; l <= j; l++)
+                A[j * F + l] += partial[t][j * F + l];
+            g[j] += partial[t][F * F + j];
+        }
+        sse += partial[t][F * F + F];
+    }
+    for (int j = 0; j < F; j++)
+        for (int l = 0; l < j; l++)
+            A[l * F + j] = A[j * F + l];
+    return sse;
+}
+
+// Solves A x = b in place by Gauss-Jordan elimination with partial pivoting;
+// false if A is singular. With B = identity columns it gives the inverse.
+bool Solve(std::vector<double> A, std::vector<double> &b, int n, int columns = 1)
+{
+    for (int c = 0; c < n; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++)
+            if (fabs(A[r * n + c]) > fabs(A[pivot * n + c]))
+                pivot = r;
+        if (A[pivot * n + c] == 0)
+            return false;
+        for (int j = 0; j < n; j++)
+            std::swap(A[c * n + j], A[pivot * n + j]);
+        for (int j = 0; j < columns; j++)
+            std::swap(b[c * columns + j], b[pivot * columns + j]);
+        for (int r = 0; r < n; r++)
+        {
+            if (r == c)
+                continue;
+            const double f = A[r * n + c] / A[c * n + c];
+            for (int j = c; j < n; j++)
+                A[r * n + j] -= f * A[c * n + j];
+            for (int j = 0; j < columns; j++)
+                b[r * columns + j] -= f * b[c * columns + j];
+        }
+    }
+    for (int r = 0; r < n; r++)
+        for (int j = 0; j < columns; j++)
+            b[r * columns + j] /= A[r * n + r];
+    return true;
+}
+
+// Sum of squares of one parameter vector
+double SumOfSquares(const Problem &problem, const std::vector<double> &p)
+{
+    double sse = 0;
+    for (size_t i = 0; i < problem.Points(); i++)
+    {
+        double r = problem.r_0[i];
+        for (size_t k = 0; k < p.size(); k++)
+            r += problem.J[k][i] * p[k];
+        sse += problem.weight[i] * r * r;
+    }
+    return sse;
+}
+
+// Levenberg-Marquardt on the free parameters from their current values,
+// with Marquardt's scaling of the damping by diag(A). Returns the final sum
+// of squares and the covariance of the free parameters.
+double LevenbergMarquardt(const Problem &problem, std::vector<Parameter> &parameters, const Options &options, std::vector<double> &covariance)
+{
+    std::vector<int> free;
+    std::vector<double> p;
+    for (size_t k = 0; k < parameters.size(); k++)
+    {
+        p.push_back(parameters[k].value);
+        if (!parameters[k].fixed)
+            free.push_back((int)k);
+    }
+    const int F = (int)free.size();
+
+    std::vector<double> A, g;
+    double sse = NormalEquations(problem, p, free, A, g, options.threads);
+    double lambda = 1e-3;
+    printf("%9s %20s %10s\n", "iteration", "sum of squares", "lambda");
+    printf("%9d %20.12g %10s\n", 0, sse, "");
+    for (int iteration = 1; iteration <= options.iterations && F > 0; iteration++)
+    {
+        bool improved = false;
+        double trial = sse;
+        while (lambda < 1e16)
+        {
+            std::vector<double> damped = A;
+            for (int j = 0; j < F; j++)
+                damped[j * F + j] += lambda * fmax(A[j * F + j], 1e-300);
+            std::vector<double> step(F);
+            for (int j = 0; j < F; j++)
+                step[j] = -g[j];
+            std::vector<double> q = p;
+            if (Solve(damped, step, F))
+            {
+                for (int j = 0; j < F; j++)
+                    q[free[j]] += step[j];
+                trial = SumOfSquares(problem, q);
+            }
+            if (trial < sse)
+            {
+                p = q;
+                lambda = fmax(lambda / 10, 1e-12);
+                improved = true;
+                break;
+            }
+            lambda *= 10;
+        }
+        if (!improved)
+            break;
+        const double decrease = (sse - trial) / fmax(sse, 1e-300);
+        sse = NormalEquations(problem, p, free, A, g, options.threads);
+        printf("%9d %20.12g %10.1e\n", iteration, sse, lambda);
+        if (decrease < 1e-14)
+            break;
+    }
+
+    for (size_t k = 0; k < parameters.size(); k++)
+        parameters[k].value = p[k];
+
+    // sigma^2 (J^T W J)^-1 with sigma^2 the residual variance
+    covariance.assign(F * F, 0.0);
+    for (int j = 0; j < F; j++)
+        covariance[j * F + j] = 1;
+    const long dof = (long)problem.Points() - F;
+    if (F > 0 && Solve(A, covariance, F, F))
+    {
+        for (double &c : covariance)
+            c *= sse / std::max(dof, 1L);
+    }
+    return sse;
+}
+
+// Grid of the swept parameters (the others at their values), its sums of
+// squares, and the best set copied into parameters
+void Sweep(const Problem &problem, std::vector<Parameter> &parameters, const Options &options, const std::vector<Point> &points)
+{
+    const int W = Simd::Pack<double>::WIDTH;
+    const int K = (int)parameters.size();
+    size_t sets = 1;
+    for (const Parameter &parameter : parameters)
+        sets *= parameter.count > 0 ? parameter.count : 1;
+    const size_t padded = (sets + 2 * W - 1) / (2 * W) * (2 * W);
+
+    // Sets by parameter, padded with copies of the last
+    std::vector<std::vector<double> > P(K, std::vector<double>(padded));
+    for (size_t s = 0; s < padded; s++)
+    {
+        size_t index = std::min(s, sets - 1);
+        for (int k = 0; k < K; k++)
+        {
+            const Parameter &parameter = parameters[k];
+            if (parameter.count <= 0)
+            {
+                P[k][s] = parameter.value;
+                continue;
+            }
+            const int j = index % parameter.count;
+            index /= parameter.count;
+            P[k][s] = parameter.count == 1 ? parameter.lo : parameter.lo + (parameter.hi - parameter.lo) * j / (parameter.count - 1);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<double> sse = SumsOfSquares(problem, P, padded, options.threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t best = std::min_element(sse.begin(), sse.begin() + sets) - sse.begin();
+
+    // The same sum through the models, point by point, as a calibration
+    // loop without the linearization would compute it
+    start = std::chrono::steady_clock::now();
+    Models models(options);
+    std::vector<double> p(K);
+    for (int k = 0; k < K; k++)
+        p[k] = P[k][best];
+    double direct = 0;
+    for (const Point &point : points)
+    {
+        const double r = models.LogSaturationRatio(point, p.data());
+        direct += point.weight * r * r;
+    }
+    const double directSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Sweep of %zu parameter sets over %zu points in %.3f s on %d threads (%.3g set-points/s, %d sets per vector)\n",
+           sets, problem.Points(), seconds, options.threads, sets * (double)problem.Points() / seconds, W);
+    printf("One set through the models takes %.3g s, %.0f times the sweep's %.3g s per set\n",
+           directSeconds, directSeconds / (seconds / sets), seconds / sets);
+    printf("Best set: sum of squares %.12g (%.12g through the models)", sse[best], direct);
+    for (int k = 0; k < K; k++)
+    {
+        if (parameters[k].count > 0)
+            printf(", %s = %.6g", parameters[k].name.c_str(), P[k][best]);
+        parameters[k].value = P[k][best];
+    }
+    printf("\n\n");
+}
+
+// Reads "T m_A m_B I [weight]" lines; '#' starts a comment
+bool Read(const std::string &path, std::vector<Point> &points)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to read %s\n", path.c_str());
+        return false;
+    }
+    char line[1024];
+    int number = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = 0;
+        Point point = {0, 0, 0, 0, 1};
+        const int fields = sscanf(line, "%lf %lf %lf %lf %lf", &point.T, &point.mA, &point.mB, &point.I, &point.weight);
+        if (fields <= 0)
+            continue;
+        if (fields < 4)
+        {
+            fprintf(stderr, "%s:%d: expected T m_A m_B I [weight]\n", path.c_str(), number);
+            fclose(file);
+            return false;
+        }
+        points.push_back(point);
+    }
+    fclose(file);
+    return true;
+}
+
+// Saturated solutions of the models at the truth p: T in 273-473 K, I and
+// m_B / m_A log-uniform over 1e-3-6 mol/kg and 0.1-10, with ln(IAP / K)
+// perturbed by the given noise
+std::vector<Point> Synthesize(const std::vector<double> &p, const Options &options)
+{
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> normal(0, 1);
+    Models models(options);
+    const double nu = options.nu_A + options.nu_B;
+    std::vector<Point> points;
+    for (long i = 0; i < options.synthetic; i++)
+    {
+        Point point = {273.15 + 200 * uniform(rng), 1e-3, 0, 1e-3 * pow(6e3, uniform(rng)), 1};
+        const double ratio = pow(10, 2 * uniform(rng) - 1);
+        // Fixed point of m_A with gamma at the previous m_A
+        for (int iteration = 0; iteration < 30; iteration++)
+        {
+            point.mB = ratio * point.mA;
+            point.mA *= exp(-models.LogSaturationRatio(point, p.data()) / nu);
+        }
+        point.mA *= exp(options.noise * normal(rng) / nu);
+        point.mB = ratio * point.mA;
+        points.push_back(point);
+    }
+    return points;
+}
+
+Parameter *Find(std::vector<Parameter> &parameters, const std::string &name)
+{
+    for (Parameter &parameter : parameters)
+        if (parameter.name == name)
+            return &parameter;
+    fprintf(stderr, "Unknown parameter %s\n", name.c_str());
+    exit(2);
+}
+
+void Usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <data file>\n"
+            "Data: lines of T [K], m_A, m_B, I [mol/kg] and an optional weight of saturated solutions\n"
+            "  --salt NU_A,NU_B,Z_A,Z_B  stoichiometry and charges (default 1,1,2,-2)\n"
+            "  --alphas A1,A2,B          alpha_1, alpha_2 and b of Pitzer's eq. (default 1.4,12,1.2)\n"
+            "  --equilibrium hoff|empirical  formulation of K: log_k, delta_h or A, B, C, D (default hoff)\n"
+            "  --set NAME=VALUE          initial value of a parameter\n"
+            "  --fix NAME[=VALUE]        keep a parameter at its value\n"
+            "  --sweep NAME=LO:HI:N      sweep N values of a parameter before the fit\n"
+            "  --threads N               threads (default: all CPUs)\n"
+            "  --iterations N            maximum Levenberg-Marquardt iterations (default 100)\n"
+            "  --synthetic N             fit N points generated from the --set values instead of a file,\n"
+            "                            starting from the defaults\n"
+            "  --noise S                 standard deviation of ln(IAP / K) of the synthetic points (default 0.01)\n"
+            "  --seed N                  seed of the synthetic points (default 1)\n",
+            program);
+    exit(2);
+}
+
+}; // namespace PitzerFit
+
+using namespace PitzerFit;
+
+int main(int argc, char **argv)
+{
+    Options options;
+    std::vector<std::pair<std::string, std::string> > settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--salt" && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &options.nu_A, &options.nu_B, &options.Z_A, &options.Z_B) != 4)
+                Usage(argv[0]);
+        }
+        else if (arg == "--alphas" && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%lf,%lf,%lf", &options.alpha_1, &options.alpha_2, &options.b) != 3)
+                Usage(argv[0]);
+        }
+        else if (arg == "--equilibrium" && i + 1 < argc)
+            options.empirical = std::string(argv[++i]) == "empirical";
+        else if ((arg == "--set" || arg == "--fix" || arg == "--sweep") && i + 1 < argc)
+            settings.push_back({arg, argv[++i]});
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--iterations" && i + 1 < argc)
+            options.iterations = atoi(argv[++i]);
+        else if (arg == "--synthetic" && i + 1 < argc)
+            options.synthetic = atol(argv[++i]);
+        else if (arg == "--noise" && i + 1 < argc)
+            options.noise = atof(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = (unsigned)atol(argv[++i]);
+        else if (arg[0] != '-' && options.data.empty())
+            options.data = arg;
+        else
+            Usage(argv[0]);
+    }
+    if (options.data.empty() == (options.synthetic == 0))
+        Usage(argv[0]);
+
+    std::vector<Parameter> parameters = DefaultParameters(options);
+    const std::vector<Parameter> defaults = parameters;
+    for (const auto &setting : settings)
+    {
+        const size_t equals = setting.second.find('=');
+        Parameter *parameter = Find(parameters, setting.second.substr(0, equals));
+        const char *value = equals == std::string::npos ? NULL : setting.second.c_str() + equals + 1;
+        if (setting.first == "--sweep")
+        {
+            if (value == NULL || sscanf(value, "%lf:%lf:%d", &parameter->lo, &parameter->hi, &parameter->count) != 3 || parameter->count < 1)
+                Usage(argv[0]);
+        }
+        else
+        {
+            if (value != NULL)
+                parameter->value = atof(value);
+            parameter->fixed |= setting.first == "--fix";
+        }
+    }
+
+    std::vector<Point> points;
+    if (options.synthetic > 0)
+    {
+        std::vector<double> truth;
+        for (const Parameter &parameter : parameters)
+            truth.push_back(parameter.value);
+        points = Synthesize(truth, options);
+        printf("%zu synthetic points, noise %g in ln(IAP / K), from", points.size(), options.noise);
+        for (const Parameter &parameter : parameters)
+            printf(" %s = %g", parameter.name.c_str(), parameter.value);
+        printf("\n");
+        for (size_t k = 0; k < parameters.size(); k++)
+        {
+            if (!parameters[k].fixed)
+                parameters[k].value = defaults[k].value;
+        }
+    }
+    else if (!Read(options.data, points))
+        return 1;
+    if (points.empty())
+    {
+        fprintf(stderr, "No data points\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> p_0;
+    for (const Parameter &parameter : parameters)
+        p_0.push_back(parameter.value);
+    const Problem problem = Linearize(points, p_0, options);
+    printf("Linearized %zu points in %.3f s\n\n", problem.Points(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    bool sweep = false;
+    for (const Parameter &parameter : parameters)
+        sweep |= parameter.count > 0;
+    if (sweep)
+        Sweep(problem, parameters, options, points);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<double> covariance;
+    const double sse = LevenbergMarquardt(problem, parameters, options, covariance);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int free = 0;
+    for (const Parameter &parameter : parameters)
+        free += !parameter.fixed;
+    printf("\n%-10s %20s %14s\n", "parameter", "value", "std error");
+    for (int k = 0, j = 0; k < (int)parameters.size(); k++)
+    {
+        if (parameters[k].fixed)
+        {
+            printf("%-10s %20.10g %14s\n", parameters[k].name.c_str(), parameters[k].value, "fixed");
+            continue;
+        }
+        printf("%-10s %20.10g %14.4g\n", parameters[k].name.c_str(), parameters[k].value, sqrt(covariance[j * free + j]));
+        j++;
+    }
+
+    // The fit through the models themselves, which checks the linearization
+    Models models(options);
+    std::vector<double> p;
+    for (const Parameter &parameter : parameters)
+        p.push_back(parameter.value);
+    double weights = 0, deviation = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        double r = problem.r_0[i];
+        for (size_t k = 0; k < p.size(); k++)
+            r += problem.J[k][i] * p[k];
+        deviation = fmax(deviation, fabs(models.LogSaturationRatio(points[i], p.data()) - r));
+        weights += points[i].weight;
+    }
+    printf("\nRMS ln(IAP / K) %.6g after %.3f s of fitting; the models differ from the linearization by at most %.3g\n",
+           sqrt(sse / fmax(weights, 1e-300)), seconds, deviation);
+    return 0;
+}
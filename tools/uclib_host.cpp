@@ -0,0 +1,737 @@
+/*
+MIT License
+
+Copyright (c) 2022 Jakob Roar Bentzon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Standalone stand-in for the STAR-CCM+ user-code loader.
+//
+// Loads a libuser.so, records everything uclib() registers through
+// ucfunc/ucarg/ucfunction and calls each registered field function on
+// synthetic cell arrays. The precision of the library (float or
+// DOUBLE_PRECISION) is taken from the argument sizes passed to ucarg, so the
+// same executable benchmarks both builds. With --replay the calls of a
+// trace written by the library (SCALE_TRACE_DIR) are replayed instead,
+// straight from the memory-mapped file. With --check-inplace it checks that
+// no function hands out results of inputs that have since changed in place.
+//
+// Build (the executable must export the uc* symbols to the library):
+//   g++ -O3 -Wno-write-strings -rdynamic tools/uclib_host.cpp -o uclib_host -ldl
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <x86intrin.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/trace_writer.h"
+
+namespace UclibHost
+{
+
+struct Argument
+{
+    std::string location;
+    std::string name;
+    int size;
+};
+
+struct Registration
+{
+    void *function;
+    std::string type;
+    std::string name;
+    std::vector<Argument> arguments;
+};
+
+std::vector<Registration> &Registry()
+{
+    static std::vector<Registration> registry;
+    return registry;
+}
+
+Registration *Find(void *function)
+{
+    for (size_t i = 0; i < Registry().size(); i++)
+    {
+        if (Registry()[i].function == function)
+            return &Registry()[i];
+    }
+    return NULL;
+}
+
+}; // namespace UclibHost
+
+extern "C"
+{
+    void ucfunc(void *function, char *type, char *name)
+    {
+        UclibHost::Registration registration;
+        registration.function = function;
+        registration.type = type;
+        registration.name = name;
+        UclibHost::Registry().push_back(registration);
+    }
+
+    void ucarg(void *function, char *location, char *name, int size)
+    {
+        UclibHost::Registration *registration = UclibHost::Find(function);
+        if (registration == NULL)
+        {
+            fprintf(stderr, "ucarg: '%s' given for a function that was not registered with ucfunc\n", name);
+            exit(1);
+        }
+        UclibHost::Argument argument = {location, name, size};
+        registration->arguments.push_back(argument);
+    }
+
+    // Registration and cell arguments in one call: numArgs pairs of
+    // (char *name, int size) follow the name.
+    void ucfunction(void *function, char *type, char *name, int numArgs, ...)
+    {
+        ucfunc(function, type, name);
+        va_list args;
+        va_start(args, numArgs);
+        for (int i = 0; i < numArgs; i++)
+        {
+            char *argName = va_arg(args, char *);
+            int argSize = va_arg(args, int);
+            ucarg(function, (char *)"Cell", argName, argSize);
+        }
+        va_end(args);
+    }
+}
+
+namespace UclibHost
+{
+
+const int MAX_ARGUMENTS = 16;
+
+// STAR-CCM+ calls a field function as f(result, size, arg_0, ..., arg_n)
+typedef void (*FieldFunction)(void *, int, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
+
+struct Options
+{
+    std::string library;
+    std::vector<long> cells;
+    std::string only;
+    double minSeconds;
+    unsigned seed;
+    long clusters;
+    double jitter;
+    double changes;
+    std::string replay;
+};
+
+// Cell array with a 64 byte aligned payload in the library's precision
+struct CellArray
+{
+    void *data;
+    int elementSize;
+    long size;
+
+    CellArray(long size, int elementSize) : data(NULL), elementSize(elementSize), size(size)
+    {
+        if (posix_memalign(&data, 64, size * elementSize + 64) != 0)
+        {
+            fprintf(stderr, "Unable to allocate %ld cells\n", size);
+            exit(1);
+        }
+    }
+
+    ~CellArray()
+    {
+        free(data);
+    }
+
+    void Set(long i, double value)
+    {
+        if (elementSize == sizeof(double))
+            ((double *)data)[i] = value;
+        else
+            ((float *)data)[i] = (float)value;
+    }
+
+    double Get(long i) const
+    {
+        if (elementSize == sizeof(double))
+            return ((double *)data)[i];
+        return ((float *)data)[i];
+    }
+};
+
+// Synthetic cell value for the arguments used by the reaction library:
+// temperatures clustered in a heat-exchanger range and brine mass fractions
+// of a seawater/formation-water mix. Unknown fields get small fractions.
+double Sample(const std::string &name, std::mt19937_64 &rng)
+{
+    std::normal_distribution<double> normal(0, 1);
+    double value;
+    if (name == "Temperature")
+        value = fmin(fmax(340 + 35 * normal(rng), 280), 450);
+    else if (name == "$yBa_2+")
+        value = 4e-5 * exp(0.8 * normal(rng));
+    else if (name == "$ySO4_2-")
+        value = 1.2e-3 * exp(0.8 * normal(rng));
+    else if (name == "$yEtc_1-")
+        value = fmin(fmax(0.035 + 0.008 * normal(rng), 0), 0.2);
+    else if (name == "$yEtc_2-")
+        value = fmin(fmax(0.004 + 0.0015 * normal(rng), 0), 0.05);
+    else if (name == "$TimeStep")
+        value = 1e-2;
+    else if (name == "pH")
+        value = 6.5 + 0.4 * normal(rng);
+    else
+        value = 1e-3 * fabs(normal(rng));
+    return value;
+}
+
+// Fills the arrays of one field function. With clusters > 0 every cell is a
+// copy of one of that many random states, perturbed by a relative jitter, as
+// in meshes where large regions share (nearly) the same state.
+void Fill(std::vector<CellArray *> &args, const Registration &registration, const Options &options, std::mt19937_64 &rng)
+{
+    std::vector<std::vector<double> > states(args.size());
+    for (size_t j = 0; j < args.size(); j++)
+    {
+        for (long k = 0; k < options.clusters; k++)
+        {
+            states[j].push_back(Sample(registration.arguments[j].name, rng));
+        }
+    }
+
+    std::normal_distribution<double> normal(0, 1);
+    for (long i = 0; i < args[0]->size; i++)
+    {
+        const long k = options.clusters > 0 ? (long)(rng() % options.clusters) : 0;
+        for (size_t j = 0; j < args.size(); j++)
+        {
+            double value;
+            if (options.clusters > 0)
+                value = states[j][k] * (1 + options.jitter * normal(rng));
+            else
+                value = Sample(registration.arguments[j].name, rng);
+            args[j]->Set(i, value);
+        }
+    }
+}
+
+// Changes the first argument of a random fraction of the cells by a relative
+// 1e-3, as between iterations of a converging solution
+void Perturb(std::vector<CellArray *> &args, double fraction, std::mt19937_64 &rng)
+{
+    const long cells = args[0]->size;
+    const long count = (long)(fraction * cells);
+    for (long c = 0; c < count; c++)
+    {
+        const long i = (long)(rng() % cells);
+        args[0]->Set(i, args[0]->Get(i) * (rng() % 2 ? 1.001 : 1 / 1.001));
+    }
+}
+
+void Call(const Registration &registration, void *result, void *const *inputs, size_t count, int size)
+{
+    void *p[MAX_ARGUMENTS] = {NULL};
+    for (size_t j = 0; j < count; j++)
+    {
+        p[j] = inputs[j];
+    }
+    FieldFunction f = (FieldFunction)registration.function;
+    f(result, size, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+}
+
+void Call(const Registration &registration, CellArray &result, std::vector<CellArray *> &args, int size)
+{
+    void *p[MAX_ARGUMENTS] = {NULL};
+    for (size_t j = 0; j < args.size(); j++)
+    {
+        p[j] = args[j]->data;
+    }
+    Call(registration, result.data, p, args.size(), size);
+}
+
+void Benchmark(const Registration &registration, long cells, const Options &options)
+{
+    if (registration.arguments.size() > (size_t)MAX_ARGUMENTS)
+    {
+        fprintf(stderr, "%s: more than %d arguments is not supported\n", registration.name.c_str(), MAX_ARGUMENTS);
+        return;
+    }
+
+    // The result has the size of the library's Real
+    int elementSize = registration.arguments.empty() ? sizeof(double) : registration.arguments[0].size;
+
+    std::mt19937_64 rng(options.seed);
+    CellArray result(cells, elementSize);
+    std::vector<CellArray *> args;
+    for (size_t j = 0; j < registration.arguments.size(); j++)
+    {
+        args.push_back(new CellArray(cells, registration.arguments[j].size));
+    }
+    if (!args.empty())
+        Fill(args, registration, options, rng);
+
+    // Warm up caches and any lazily initialised state
+    Call(registration, result, args, (int)cells);
+
+    long calls = 0;
+    double seconds = 0;
+    unsigned long long ticks = 0;
+    while (seconds < options.minSeconds || calls < 3)
+    {
+        if (options.changes > 0 && !args.empty())
+            Perturb(args, options.changes, rng);
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long tscStart = __rdtsc();
+        Call(registration, result, args, (int)cells);
+        ticks += __rdtsc() - tscStart;
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        calls++;
+    }
+
+    double checksum = 0;
+    long nonFinite = 0;
+    for (long i = 0; i < cells; i++)
+    {
+        double value = result.Get(i);
+        if (isfinite(value))
+            checksum += value;
+        else
+            nonFinite++;
+    }
+
+    const double totalCells = (double)cells * calls;
+    printf("%-36s %-6s %12ld %8ld %14.4e %10.3f %12.2f %16.9e %8ld\n",
+           registration.name.c_str(),
+           elementSize == sizeof(double) ? "double" : "float",
+           cells,
+           calls,
+           totalCells / seconds,
+           1e9 * seconds / totalCells,
+           ticks / totalCells,
+           checksum,
+           nonFinite);
+    fflush(stdout);
+
+    for (size_t j = 0; j < args.size(); j++)
+    {
+        delete args[j];
+    }
+}
+
+// Checks that results are recomputed after the inputs change in place, as
+// the solver updates its field arrays between iterations. The arrays are
+// shared by field name as in STAR-CCM+. For each function in turn: it is
+// called on one state, which leaves the other results of its pass, the
+// state is changed in place and every function must then give what a
+// second call gives. False if one differs beyond the precision of the build.
+bool CheckInPlace(long cells, const Options &options)
+{
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> change(-0.2, 0.2);
+    std::map<std::string, CellArray *> fields;
+    std::map<std::string, std::vector<double> > before, after;
+    int elementSize = sizeof(double);
+    for (const Registration &registration : Registry())
+    {
+        for (const Argument &argument : registration.arguments)
+        {
+            elementSize = argument.size;
+            if (fields.count(argument.name))
+                continue;
+            fields[argument.name] = new CellArray(cells, argument.size);
+            for (long i = 0; i < cells; i++)
+            {
+                const double value = Sample(argument.name, rng);
+                before[argument.name].push_back(value);
+                after[argument.name].push_back(value * (1 + change(rng)));
+            }
+        }
+    }
+    auto set = [&](std::map<std::string, std::vector<double> > &state)
+    {
+        for (auto &field : fields)
+        {
+            for (long i = 0; i < cells; i++)
+                field.second->Set(i, state[field.first][i]);
+        }
+    };
+    auto call = [&](const Registration &registration, CellArray &result)
+    {
+        std::vector<void *> p;
+        for (const Argument &argument : registration.arguments)
+            p.push_back(fields[argument.name]->data);
+        Call(registration, result.data, p.data(), p.size(), (int)cells);
+    };
+
+    const double tolerance = elementSize == sizeof(double) ? 1e-6 : 1e-3;
+    std::vector<double> difference(Registry().size(), 0);
+    CellArray first(cells, elementSize), second(cells, elementSize);
+    for (const Registration &starting : Registry())
+    {
+        if (starting.arguments.size() > (size_t)MAX_ARGUMENTS)
+            continue;
+        set(before);
+        call(starting, first);
+        set(after);
+        for (size_t f = 0; f < Registry().size(); f++)
+        {
+            const Registration &registration = Registry()[f];
+            if (registration.arguments.size() > (size_t)MAX_ARGUMENTS)
+                continue;
+            call(registration, first);
+            call(registration, second);
+            for (long i = 0; i < cells; i++)
+            {
+                const double a = first.Get(i), b = second.Get(i);
+                if (a != b)
+                    difference[f] = fmax(difference[f], fabs(a - b) / fmax(fabs(b), 1e-30));
+            }
+        }
+    }
+
+    bool pass = true;
+    printf("\n%-52s %16s\n", "function", "max difference");
+    for (size_t f = 0; f < Registry().size(); f++)
+    {
+        const bool stale = !(difference[f] <= tolerance);
+        printf("%-52s %16.3e %s\n", Registry()[f].name.c_str(), difference[f], stale ? "STALE" : "");
+        pass &= !stale;
+    }
+    printf("%s\n", pass ? "All functions recomputed after in-place changes" : "Results of changed inputs handed out");
+    for (auto &field : fields)
+        delete field.second;
+    return pass;
+}
+
+// Calls of a trace file, with the inputs pointing into the mapping
+struct TraceFile
+{
+    struct TracedCall
+    {
+        int function;
+        int size;
+        std::vector<void *> inputs;
+    };
+
+    int realSize = 0;
+    std::vector<std::string> functions;
+    std::vector<TracedCall> calls;
+
+    // Maps path read-only; false with a message if it is not a trace
+    bool Load(const std::string &path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(TraceHeader))
+        {
+            fprintf(stderr, "Unable to read trace %s\n", path.c_str());
+            return false;
+        }
+        char *base = (char *)mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            fprintf(stderr, "Unable to map trace %s\n", path.c_str());
+            return false;
+        }
+        const TraceHeader *header = (const TraceHeader *)base;
+        if (strcmp(header->magic, "SCALETR") != 0 || header->version != TRACE_VERSION)
+        {
+            fprintf(stderr, "%s is not a trace of version %d\n", path.c_str(), TRACE_VERSION);
+            return false;
+        }
+        realSize = header->realSize;
+
+        const char *end = base + status.st_size;
+        const char *p = base + sizeof(TraceHeader);
+        while (p + sizeof(TraceRecord) <= end)
+        {
+            const TraceRecord *record = (const TraceRecord *)p;
+            const char *payload = p + sizeof(TraceRecord);
+            const size_t bytes = record->type == TRACE_FUNCTION ? record->size : (size_t)record->arguments * record->size * realSize;
+            const char *next = payload + ((bytes + 7) & ~(size_t)7);
+            if (next > end)
+            {
+                fprintf(stderr, "%s is truncated after %zu calls\n", path.c_str(), calls.size());
+                break;
+            }
+            if (record->type == TRACE_FUNCTION)
+            {
+                functions.resize(std::max(functions.size(), (size_t)record->function + 1));
+                functions[record->function] = payload;
+            }
+            else
+            {
+                TracedCall call = {(int)record->function, record->size, {}};
+                for (uint32_t k = 0; k < record->arguments; k++)
+                {
+                    call.inputs.push_back((void *)(payload + (size_t)k * record->size * realSize));
+                }
+                calls.push_back(call);
+            }
+            p = next;
+        }
+        return true;
+    }
+};
+
+// Replays the traced calls of one function, in their order, until the
+// minimum time has passed
+void Replay(const Registration &registration, const TraceFile &trace, int function, const Options &options)
+{
+    std::vector<const TraceFile::TracedCall *> calls;
+    long cells = 0;
+    int largest = 0;
+    for (const TraceFile::TracedCall &call : trace.calls)
+    {
+        if (call.function != function)
+            continue;
+        calls.push_back(&call);
+        cells += call.size;
+        largest = std::max(largest, call.size);
+    }
+    if (calls.empty())
+        return;
+    if (registration.arguments.empty() || registration.arguments[0].size != trace.realSize || registration.arguments.size() != calls[0]->inputs.size())
+    {
+        fprintf(stderr, "%s: the trace does not match the arguments or precision of the library\n", registration.name.c_str());
+        return;
+    }
+
+    CellArray result(largest, trace.realSize);
+    auto pass = [&](double *checksum, long *nonFinite)
+    {
+        for (const TraceFile::TracedCall *call : calls)
+        {
+            Call(registration, result.data, call->inputs.data(), call->inputs.size(), call->size);
+            for (long i = 0; checksum != NULL && i < call->size; i++)
+            {
+                const double value = result.Get(i);
+                if (isfinite(value))
+                    *checksum += value;
+                else
+                    (*nonFinite)++;
+            }
+        }
+    };
+
+    // The untimed first pass warms up and gives the checksum
+    double checksum = 0;
+    long nonFinite = 0;
+    pass(&checksum, &nonFinite);
+
+    long passes = 0;
+    double seconds = 0;
+    unsigned long long ticks = 0;
+    while (seconds < options.minSeconds || passes < 3)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long tscStart = __rdtsc();
+        pass(NULL, NULL);
+        ticks += __rdtsc() - tscStart;
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        passes++;
+    }
+
+    const double totalCells = (double)cells * passes;
+    printf("%-36s %-6s %12ld %8ld %14.4e %10.3f %12.2f %16.9e %8ld\n",
+           registration.name.c_str(),
+           trace.realSize == sizeof(double) ? "double" : "float",
+           cells,
+           (long)calls.size() * passes,
+           totalCells / seconds,
+           1e9 * seconds / totalCells,
+           ticks / totalCells,
+           checksum,
+           nonFinite);
+    fflush(stdout);
+}
+
+void Usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <libuser.so>\n"
+            "  --cells N[,N...]   partition sizes to benchmark (default 1000,100000,1000000)\n"
+            "  --function NAME    only benchmark the field function with this name\n"
+            "  --min-time S       minimum measured time per case in seconds (default 0.5)\n"
+            "  --seed N           seed for the synthetic cell data (default 1)\n"
+            "  --clusters K       draw every cell from K random states (default 0: all cells independent)\n"
+            "  --jitter R         relative noise added to the clustered states (default 0)\n"
+            "  --changes F        change a fraction F of the cells between timed calls (default 0)\n"
+            "  --replay FILE      replay the calls of a trace written with SCALE_TRACE_DIR instead\n"
+            "  --check-inplace    check that results follow inputs changed in place, on the first --cells\n"
+            "  --list             print the registrations and exit\n",
+            program);
+}
+
+}; // namespace UclibHost
+
+int main(int argc, char **argv)
+{
+    using namespace UclibHost;
+
+    Options options;
+    options.minSeconds = 0.5;
+    options.seed = 1;
+    options.clusters = 0;
+    options.jitter = 0;
+    options.changes = 0;
+    bool listOnly = false;
+    bool checkInPlace = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--cells" && i + 1 < argc)
+        {
+            char *token = strtok(argv[++i], ",");
+            while (token != NULL)
+            {
+                options.cells.push_back((long)strtod(token, NULL));
+                token = strtok(NULL, ",");
+            }
+        }
+        else if (arg == "--function" && i + 1 < argc)
+            options.only = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.minSeconds = atof(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = (unsigned)atol(argv[++i]);
+        else if (arg == "--clusters" && i + 1 < argc)
+            options.clusters = atol(argv[++i]);
+        else if (arg == "--jitter" && i + 1 < argc)
+            options.jitter = atof(argv[++i]);
+        else if (arg == "--changes" && i + 1 < argc)
+            options.changes = atof(argv[++i]);
+        else if (arg == "--replay" && i + 1 < argc)
+            options.replay = argv[++i];
+        else if (arg == "--list")
+            listOnly = true;
+        else if (arg == "--check-inplace")
+            checkInPlace = true;
+        else if (arg[0] != '-' && options.library.empty())
+            options.library = arg;
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.library.empty())
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (options.cells.empty())
+    {
+        options.cells.push_back(1000);
+        options.cells.push_back(100000);
+        options.cells.push_back(1000000);
+    }
+
+    void *handle = dlopen(options.library.c_str(), RTLD_NOW);
+    if (handle == NULL)
+    {
+        fprintf(stderr, "%s\n", dlerror());
+        return 1;
+    }
+    void (*uclib)() = (void (*)())dlsym(handle, "uclib");
+    if (uclib == NULL)
+    {
+        fprintf(stderr, "%s does not export uclib()\n", options.library.c_str());
+        return 1;
+    }
+    uclib();
+
+    for (size_t f = 0; f < Registry().size(); f++)
+    {
+        const Registration &registration = Registry()[f];
+        printf("%s \"%s\"", registration.type.c_str(), registration.name.c_str());
+        for (size_t j = 0; j < registration.arguments.size(); j++)
+        {
+            const Argument &argument = registration.arguments[j];
+            printf("%s %s:%s[%d]", j == 0 ? ":" : ",", argument.location.c_str(), argument.name.c_str(), argument.size);
+        }
+        printf("\n");
+    }
+    if (listOnly)
+        return 0;
+    if (checkInPlace)
+    {
+        const bool pass = CheckInPlace(options.cells[0], options);
+        dlclose(handle);
+        return pass ? 0 : 1;
+    }
+
+    TraceFile trace;
+    if (!options.replay.empty())
+    {
+        if (!trace.Load(options.replay))
+            return 1;
+        printf("\nReplaying %zu calls of %zu functions from %s; cells is the sum over one pass\n", trace.calls.size(), trace.functions.size(), options.replay.c_str());
+    }
+
+    printf("\n%-36s %-6s %12s %8s %14s %10s %12s %16s %8s\n",
+           "function", "real", "cells", "calls", "cells/s", "ns/cell", "cycles/cell", "checksum", "nonfinite");
+    if (!options.replay.empty())
+    {
+        for (size_t function = 0; function < trace.functions.size(); function++)
+        {
+            const std::string &name = trace.functions[function];
+            const Registration *registration = NULL;
+            for (const Registration &r : Registry())
+            {
+                if (r.name == name)
+                    registration = &r;
+            }
+            if (registration == NULL)
+                printf("%s is not registered by the library\n", name.c_str());
+            else if (options.only.empty() || options.only == name)
+                Replay(*registration, trace, (int)function, options);
+        }
+        dlclose(handle);
+        return 0;
+    }
+    for (size_t f = 0; f < Registry().size(); f++)
+    {
+        const Registration &registration = Registry()[f];
+        if (!options.only.empty() && options.only != registration.name)
+            continue;
+        for (size_t c = 0; c < options.cells.size(); c++)
+        {
+            Benchmark(registration, options.cells[c], options);
+        }
+    }
+
+    dlclose(handle);
+    return 0;
+}